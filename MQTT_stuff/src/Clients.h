@@ -177,6 +177,7 @@ typedef struct
 	willMessages* will;
 	List* inboundMsgs;
 	List* outboundMsgs;				/**< in flight */
+	struct msgid_index* outboundIndex;	/**< outboundMsgs by message id, allocated on first use */
 	List* messageQueue;
 	unsigned int qentry_seqno;
 	void* phandle;  /* the persistence handle */
@@ -23,6 +23,10 @@
  * header file.  Malloc and free will be redefined, but will behave in exactly the same
  * way as normal, so no recoding is necessary.
  *
+ * The structures allocated for every publish come from fixed-size pools instead, through
+ * pool_malloc.  Pool items are freed with free like any other, which returns them to their pool.
+ * Likewise buffers borrowed from the application are handed back when their last reference is freed.
+ *
  * */
 
 #include "Tree.h"
@@ -67,6 +71,75 @@ typedef struct
 static Tree heap;	/**< Tree that holds the allocation records */
 static char* errmsg = "Memory allocation error";
 
+#if !defined(HEAP_POOL_SLABS)
+#define HEAP_POOL_SLABS 32 /**< the most slabs all the pools can be grown to, in total */
+#endif
+
+/**
+ * A free item in a pool.  The link is overlaid on the item storage.
+ */
+typedef struct pool_item
+{
+	struct pool_item* next;	/**< the next free item */
+} pool_item;
+
+/**
+ * A fixed-size object pool.  The items are carved out of one or more preallocated slabs,
+ * and kept on a free list when not in use, so that allocating and freeing them touches
+ * neither malloc nor the heap tracking tree.
+ */
+typedef struct
+{
+	int size;				/**< the size of each item, rounded up */
+	int count;				/**< the number of items in the pool's slabs */
+	int in_use;				/**< the number of items currently allocated */
+	int max_in_use;			/**< the most items allocated at any one time */
+	int overflows;			/**< the number of allocations which had to fall back to malloc */
+	pool_item* free_list;	/**< the first free item */
+} heap_pool;
+
+static heap_pool pools[HEAP_POOLS];
+
+/**
+ * A slab of pool items, so that a pointer can be matched to the pool it came from.
+ */
+static struct
+{
+	char* start;	/**< the first byte of the slab */
+	char* end;		/**< the byte after the end of the slab */
+	int pool;		/**< the pool the items belong to */
+} slabs[HEAP_POOL_SLABS];
+
+/**
+ * The number of slabs.  Slabs are only ever added, under heap_mutex, and an entry is complete
+ * before the count is raised to include it, so the table can be searched without the lock.
+ */
+static volatile int slab_count = 0;
+static char* slabs_low = NULL;	/**< the lowest address of any slab, for a quick check in free */
+static char* slabs_high = NULL;	/**< the byte after the highest slab */
+#if !defined(HEAP_BORROWED_REGIONS)
+#define HEAP_BORROWED_REGIONS 8 /**< the most sets of application buffers that can be registered */
+#endif
+
+/**
+ * A set of equal-sized buffers owned by the application, which the library may hold on to
+ * instead of copying from.  Each buffer has a reference count; when the last reference is
+ * freed, the buffer is handed back to the application through its release callback.
+ */
+static struct
+{
+	char* start;			/**< the first buffer */
+	char* end;				/**< the byte after the last buffer */
+	int size;				/**< the size of each buffer */
+	int* refs;				/**< the reference count of each buffer */
+	heap_release* release;	/**< called when a buffer has no more references */
+	void* context;			/**< passed to the release callback */
+} borrowed[HEAP_BORROWED_REGIONS];
+
+static int borrowed_count = 0;
+static char* borrowed_low = NULL;	/**< the lowest address of any borrowed buffer, for a quick check in free */
+static char* borrowed_high = NULL;	/**< the byte after the highest borrowed buffer */
+
 /**
  * Round allocation size up to a multiple of the size of an int.  Apart from possibly reducing fragmentation,
  * on the old v3 gcc compilers I was hitting some weird behaviour, which might have been errors in
@@ -236,6 +309,8 @@ int Internal_heap_unlink(char* file, int line, void* p)
  */
 void myfree(char* file, int line, void* p)
 {
+	if (Heap_poolFree(p))
+		return;
 	Thread_lock_mutex(heap_mutex);
 	if (Internal_heap_unlink(file, line, p))
 		free(((int*)p)-1);
@@ -311,16 +386,58 @@ void *myrealloc(char* file, int line, void* p, size_t size)
 }
 
 
+/**
+ * Widen an address range checked by free to include a slab or set of borrowed buffers.
+ * Must be called with heap_mutex held.
+ * @param low the lowest address of the range, updated
+ * @param high the byte after the range, updated
+ * @param start the first byte of the region
+ * @param end the byte after the end of the region
+ */
+static void Heap_addRegion(char** low, char** high, char* start, char* end)
+{
+	if (*low == NULL || start < *low)
+		*low = start;
+	if (end > *high)
+		*high = end;
+}
+
+
+/**
+ * Find the slab holding a pointer, without taking heap_mutex, so that freeing memory
+ * which is not a pool item costs a few comparisons rather than a lock.
+ * @param cp the pointer
+ * @return the index of the slab, or -1 if the pointer is not a pool item
+ */
+static int Heap_findSlab(char* cp)
+{
+	int count = slab_count;
+	int i;
+
+	if (cp < slabs_low || cp >= slabs_high)
+		return -1;
+	__sync_synchronize(); /* read the slab entries no earlier than the count */
+	for (i = 0; i < count; ++i)
+	{
+		if (cp >= slabs[i].start && cp < slabs[i].end)
+			return i;
+	}
+	return -1;
+}
+
+
 /**
  * Utility to find an item in the heap.  Lets you know if the heap already contains
  * the memory location in question.
  * @param p pointer to a memory location
- * @return pointer to the storage element if found, or NULL
+ * @return pointer to the storage element if found, p itself if it is a pool item, or NULL
  */
 void* Heap_findItem(void* p)
 {
 	Node* e = NULL;
 
+	if (Heap_findSlab((char*)p) >= 0)
+		return p;
 	Thread_lock_mutex(heap_mutex);
 	e = TreeFind(&heap, ((int*)p)-1);
 	Thread_unlock_mutex(heap_mutex);
@@ -328,6 +445,261 @@ void* Heap_findItem(void* p)
 }
 
 
+/**
+ * Make sure a pool has at least a number of items, by adding a slab for the difference.
+ * The item size is fixed by the first reservation; later ones for a larger size are ignored.
+ * Slabs are never freed, so that items still referenced at shutdown remain valid.
+ * @param pool the pool, one of ::heap_pools
+ * @param size the size of each item
+ * @param count the number of items the pool should hold
+ * @return 0 on success, -1 if the slab could not be allocated
+ */
+int Heap_poolReserve(int pool, size_t size, int count)
+{
+	heap_pool* hp = &pools[pool];
+	char* slab = NULL;
+	int rc = 0;
+	int i;
+
+	Thread_lock_mutex(heap_mutex);
+	if (hp->size == 0)
+		hp->size = roundup((size < sizeof(pool_item)) ? sizeof(pool_item) : size);
+	if (size > hp->size || count <= hp->count)
+		goto exit;
+	if (slab_count == HEAP_POOL_SLABS || (slab = malloc((count - hp->count) * hp->size)) == NULL)
+	{
+		Log(LOG_ERROR, 13, errmsg);
+		rc = -1;
+		goto exit;
+	}
+	for (i = count - hp->count - 1; i >= 0; --i)
+	{
+		pool_item* item = (pool_item*)(slab + i * hp->size);
+
+		item->next = hp->free_list;
+		hp->free_list = item;
+	}
+	slabs[slab_count].start = slab;
+	slabs[slab_count].end = slab + (count - hp->count) * hp->size;
+	slabs[slab_count].pool = pool;
+	Heap_addRegion(&slabs_low, &slabs_high, slab, slabs[slab_count].end);
+	__sync_synchronize(); /* complete the entry before Heap_findSlab can see it */
+	++slab_count;
+	Log(TRACE_MIN, -1, "Reserved %d items of %d bytes in pool %d", count - hp->count, hp->size, pool);
+	hp->count = count;
+exit:
+	Thread_unlock_mutex(heap_mutex);
+	return rc;
+}
+
+
+/**
+ * Allocates an item from a pool.  Use the pool_malloc macro rather than calling this directly.
+ * If the pool is empty, or the item is bigger than the pool's item size, the item is
+ * allocated with malloc instead, and tracked as usual.
+ * @param file use the __FILE__ macro to indicate which file this item was allocated in
+ * @param line use the __LINE__ macro to indicate which line this item was allocated at
+ * @param pool the pool, one of ::heap_pools
+ * @param size the size of the item to be allocated
+ * @return pointer to the allocated item, or NULL if there was an error
+ */
+void* Heap_poolAlloc(char* file, int line, int pool, size_t size)
+{
+	heap_pool* hp = &pools[pool];
+	pool_item* item = NULL;
+
+	if (size <= hp->size)
+	{
+		Thread_lock_mutex(heap_mutex);
+		if ((item = hp->free_list) != NULL)
+		{
+			hp->free_list = item->next;
+			if (++(hp->in_use) > hp->max_in_use)
+				hp->max_in_use = hp->in_use;
+		}
+		else
+			++(hp->overflows);
+		Thread_unlock_mutex(heap_mutex);
+	}
+	if (item)
+		return item;
+#if !defined(NO_HEAP_TRACKING)
+	return mymalloc(file, line, size);
+#else
+	return malloc(size);
+#endif
+}
+
+
+/**
+ * Returns an item to its pool, if it came from one, or drops a reference to a borrowed buffer.
+ * @param p pointer to the item
+ * @return boolean - whether p was a pool item or borrowed buffer
+ */
+int Heap_poolFree(void* p)
+{
+	char* cp = (char*)p;
+	heap_release* release = NULL;
+	void* context = NULL;
+	char* buffer = NULL;
+	int rc = 0;
+	int i;
+
+	if ((i = Heap_findSlab(cp)) >= 0)
+	{
+		heap_pool* hp = &pools[slabs[i].pool];
+
+		Thread_lock_mutex(heap_mutex);
+		((pool_item*)p)->next = hp->free_list;
+		hp->free_list = (pool_item*)p;
+		--(hp->in_use);
+		Thread_unlock_mutex(heap_mutex);
+		return 1;
+	}
+	if (cp < borrowed_low || cp >= borrowed_high)
+		return 0;
+	Thread_lock_mutex(heap_mutex);
+	for (i = 0; i < borrowed_count; ++i)
+	{
+		if (cp >= borrowed[i].start && cp < borrowed[i].end)
+		{
+			int index = (cp - borrowed[i].start) / borrowed[i].size;
+
+			if (borrowed[i].refs[index] <= 0)
+				Log(LOG_ERROR, 13, "Freeing borrowed buffer %p which is not in use", p);
+			else if (--(borrowed[i].refs[index]) == 0)
+			{
+				release = borrowed[i].release;
+				context = borrowed[i].context;
+				buffer = borrowed[i].start + index * borrowed[i].size;
+			}
+			rc = 1;
+		}
+	}
+	Thread_unlock_mutex(heap_mutex);
+	if (release)
+		(*release)(context, buffer); /* outside the lock, as the application may allocate */
+	return rc;
+}
+
+
+/**
+ * Register a set of application buffers which the library may borrow instead of copying.
+ * @param buffers the first of count contiguous buffers
+ * @param size the size of each buffer
+ * @param count the number of buffers
+ * @param release called, outside any library lock, when the library has finished with a buffer
+ * @param context passed to the release callback
+ * @return 0 on success, -1 if the buffers overlap a registered set or there is no room
+ */
+int Heap_registerBuffers(void* buffers, int size, int count, heap_release* release, void* context)
+{
+	char* start = (char*)buffers;
+	char* end = start + size * count;
+	int rc = -1;
+	int i;
+
+	Thread_lock_mutex(heap_mutex);
+	for (i = 0; i < borrowed_count; ++i)
+	{
+		if (start < borrowed[i].end && end > borrowed[i].start)
+			goto exit;
+	}
+	if (borrowed_count == HEAP_BORROWED_REGIONS || (borrowed[i].refs = malloc(count * sizeof(int))) == NULL)
+		goto exit;
+	memset(borrowed[i].refs, '\0', count * sizeof(int));
+	borrowed[i].start = start;
+	borrowed[i].end = end;
+	borrowed[i].size = size;
+	borrowed[i].release = release;
+	borrowed[i].context = context;
+	++borrowed_count;
+	Heap_addRegion(&borrowed_low, &borrowed_high, start, end);
+	rc = 0;
+exit:
+	Thread_unlock_mutex(heap_mutex);
+	return rc;
+}
+
+
+/**
+ * Remove a set of buffers registered with Heap_registerBuffers.
+ * @param buffers the first buffer, as registered
+ * @return 0 on success, -1 if the set is not registered or a buffer is still in use
+ */
+int Heap_unregisterBuffers(void* buffers)
+{
+	int rc = -1;
+	int i, j;
+
+	Thread_lock_mutex(heap_mutex);
+	for (i = 0; i < borrowed_count; ++i)
+	{
+		if (borrowed[i].start == (char*)buffers)
+			break;
+	}
+	if (i == borrowed_count)
+		goto exit;
+	for (j = (borrowed[i].end - borrowed[i].start) / borrowed[i].size - 1; j >= 0; --j)
+	{
+		if (borrowed[i].refs[j] > 0)
+			goto exit;
+	}
+	free(borrowed[i].refs);
+	borrowed[i] = borrowed[--borrowed_count];
+	rc = 0;
+exit:
+	Thread_unlock_mutex(heap_mutex);
+	return rc;
+}
+
+
+/**
+ * Take a reference to a registered application buffer, so that it is not released until
+ * the reference is freed with free.
+ * @param p pointer to the data within the buffer
+ * @param len the length of the data, which must not run past the end of the buffer
+ * @return boolean - whether the data is in a registered buffer and a reference was taken
+ */
+int Heap_borrowBuffer(void* p, int len)
+{
+	char* cp = (char*)p;
+	int rc = 0;
+	int i;
+
+	if (cp < borrowed_low || cp >= borrowed_high)
+		return 0;
+	Thread_lock_mutex(heap_mutex);
+	for (i = 0; i < borrowed_count; ++i)
+	{
+		if (cp >= borrowed[i].start && cp < borrowed[i].end)
+		{
+			int index = (cp - borrowed[i].start) / borrowed[i].size;
+
+			if (len >= 0 && cp + len <= borrowed[i].start + (index + 1) * borrowed[i].size)
+			{
+				++(borrowed[i].refs[index]);
+				rc = 1;
+			}
+			break;
+		}
+	}
+	Thread_unlock_mutex(heap_mutex);
+	return rc;
+}
+
+
+/**
+ * Frees a block of memory when heap tracking is off, returning pool items to their pool.
+ * @param p pointer to the item to be freed
+ */
+void Heap_free(void* p)
+{
+	if (!Heap_poolFree(p))
+		free(p);
+}
+
+
 /**
  * Scans the heap and reports any items currently allocated.
  * To be used at shutdown if any heap items have not been freed.
@@ -365,7 +737,15 @@ int Heap_initialize()
  */
 void Heap_terminate()
 {
+	int i;
+
 	Log(TRACE_MIN, -1, "Maximum heap use was %d bytes", state.max_size);
+	for (i = 0; i < HEAP_POOLS; ++i)
+	{
+		if (pools[i].count > 0)
+			Log(TRACE_MIN, -1, "Pool %d: %d items of %d bytes, max in use %d, %d overflows, %d still in use",
+				i, pools[i].count, pools[i].size, pools[i].max_in_use, pools[i].overflows, pools[i].in_use);
+	}
 	if (state.current_size > 20) /* One log list is freed after this function is called */
 	{
 		Log(LOG_ERROR, -1, "Some memory not freed at shutdown, possible memory leak");
@@ -49,8 +49,38 @@
  */
 #define free(x) myfree(__FILE__, __LINE__, x)
 
+#else
+/**
+ * redefines free to use "Heap_free" so that pooled items are returned to their pool
+ * @param x the item to be freed
+ */
+#define free(x) Heap_free(x)
+
 #endif
 
+/**
+ * allocates an item from a preallocated pool, falling back to malloc if the pool is empty or
+ * the item is too big for it.  The result is released with free as usual, and must not be realloc'd.
+ * @param p the pool to allocate from, one of ::heap_pools
+ * @param x the size of the item to be allocated
+ * @return the pointer to the item allocated, or NULL
+ */
+#define pool_malloc(p, x) Heap_poolAlloc(__FILE__, __LINE__, p, x)
+
+/**
+ * The fixed-size object pools, one for each of the structures allocated for every publish.
+ */
+enum heap_pools
+{
+	POOL_COMMAND,		/**< MQTTAsync_queuedCommand */
+	POOL_LIST_ELEMENT,	/**< ListElement */
+	POOL_PUBLISH,		/**< Publish */
+	POOL_MESSAGE,		/**< Messages */
+	POOL_PUBLICATION,	/**< Publications */
+	POOL_BUFFER,		/**< topic and payload copies up to the pool item size */
+	HEAP_POOLS
+};
+
 /**
  * Information about the state of the heap.
  */
@@ -74,4 +104,20 @@ int HeapDumpString(FILE* file, char* str);
 void* Heap_findItem(void* p);
 void Heap_unlink(char* file, int line, void* p);
 
+int Heap_poolReserve(int pool, size_t size, int count);
+void* Heap_poolAlloc(char* file, int line, int pool, size_t size);
+int Heap_poolFree(void* p);
+
+/**
+ * Callback which hands a borrowed buffer back to the application.
+ * @param context the context registered with the buffers
+ * @param buffer the start of the buffer
+ */
+typedef void heap_release(void* context, void* buffer);
+
+int Heap_registerBuffers(void* buffers, int size, int count, heap_release* release, void* context);
+int Heap_unregisterBuffers(void* buffers);
+int Heap_borrowBuffer(void* p, int len);
+void Heap_free(void* p);
+
 #endif
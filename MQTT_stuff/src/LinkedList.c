@@ -90,7 +90,7 @@ void ListAppendNoMalloc(List* aList, void* content, ListElement* newel, int size
  */
 void ListAppend(List* aList, void* content, int size)
 {
-	ListElement* newel = malloc(sizeof(ListElement));
+	ListElement* newel = pool_malloc(POOL_LIST_ELEMENT, sizeof(ListElement));
 	ListAppendNoMalloc(aList, content, newel, size);
 }
 
@@ -105,7 +105,7 @@ void ListAppend(List* aList, void* content, int size)
  */
 void ListInsert(List* aList, void* content, int size, ListElement* index)
 {
-	ListElement* newel = malloc(sizeof(ListElement));
+	ListElement* newel = pool_malloc(POOL_LIST_ELEMENT, sizeof(ListElement));
 
 	if ( index == NULL )
 		ListAppendNoMalloc(aList, content, newel, size);
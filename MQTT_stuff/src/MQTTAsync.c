@@ -115,7 +115,7 @@ static pthread_mutex_t mqttasync_mutex_store = PTHREAD_MUTEX_INITIALIZER;
 static mutex_type mqttasync_mutex = &mqttasync_mutex_store;
 static pthread_mutex_t mqttcommand_mutex_store = PTHREAD_MUTEX_INITIALIZER;
 static mutex_type mqttcommand_mutex = &mqttcommand_mutex_store;
-static cond_type_struct send_cond_store = { PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+static cond_type_struct send_cond_store = { PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, 0 };
 static cond_type send_cond = &send_cond_store;
 
 void MQTTAsync_init()
@@ -284,6 +284,63 @@ typedef struct
 	unsigned int seqno; /* only used on restore */
 } MQTTAsync_queuedCommand;
 
+
+/**
+ * A connect or disconnect deadline the send thread has to check
+ */
+typedef struct
+{
+	long due; /**< milliseconds after timeouts_epoch */
+	MQTTAsyncs* client;
+} MQTTAsync_timeout;
+
+/* binary min-heap of deadlines ordered by due time, protected by mqttasync_mutex */
+static MQTTAsync_timeout* timeouts = NULL;
+static int timeouts_count = 0;
+static int timeouts_size = 0;
+static START_TIME_TYPE timeouts_epoch;
+
+/*
+ * Commands are handed to the send thread through a bounded lock-free queue, so that
+ * publishing does not contend with the send thread for mqttcommand_mutex.  Any number of
+ * threads may add; the queue is drained into the commands list by whoever holds
+ * mqttcommand_mutex, normally the send thread.  The cells are preallocated and each has a
+ * sequence number telling producers and the consumer whose turn it is (D. Vyukov's
+ * bounded queue).
+ */
+#if !defined(MQTTASYNC_COMMAND_QUEUE_SIZE)
+#define MQTTASYNC_COMMAND_QUEUE_SIZE 1024 /* must be a power of 2 */
+#endif
+
+#if defined(WIN32)
+#define MQTTAsync_cas(p, old, new) (InterlockedCompareExchange((LONG volatile*)(p), (new), (old)) == (LONG)(old))
+#define MQTTAsync_barrier() MemoryBarrier()
+#else
+#define MQTTAsync_cas(p, old, new) __sync_bool_compare_and_swap((p), (old), (new))
+#define MQTTAsync_barrier() __sync_synchronize()
+#endif
+
+typedef struct
+{
+	volatile unsigned int sequence;
+	MQTTAsync_queuedCommand* command;
+	int size;
+} MQTTAsync_commandCell;
+
+static MQTTAsync_commandCell command_queue[MQTTASYNC_COMMAND_QUEUE_SIZE];
+static volatile unsigned int command_queue_in = 0; /* next cell to fill, moved by producers */
+static volatile unsigned int command_queue_out = 0; /* next cell to drain, moved by the consumer */
+
+void MQTTAsync_initCommandQueue(void);
+int MQTTAsync_enqueueCommand(MQTTAsync_queuedCommand* command, int command_size);
+void MQTTAsync_drainCommandQueue(void);
+int MQTTAsync_commandsQueued(void);
+
+void MQTTAsync_addTimeout(MQTTAsyncs* m, long timeout);
+void MQTTAsync_removeTimeouts(MQTTAsyncs* m);
+long MQTTAsync_nextTimeout(void);
+void MQTTAsync_wakeSendThread(void);
+
 void MQTTAsync_freeCommand(MQTTAsync_queuedCommand *command);
 void MQTTAsync_freeCommand1(MQTTAsync_queuedCommand *command);
 int MQTTAsync_deliverMessage(MQTTAsyncs* m, char* topicName, int topicLen, MQTTAsync_message* mm);
@@ -366,6 +423,7 @@ int MQTTAsync_create(MQTTAsync* handle, char* serverURI, char* clientId,
 		Socket_setWriteCompleteCallback(MQTTAsync_writeComplete);
 		handles = ListInitialize();
 		commands = ListInitialize();
+		MQTTAsync_initCommandQueue();
 #if defined(OPENSSL)
 		SSLSocket_initialize();
 #endif
@@ -427,10 +485,14 @@ void MQTTAsync_terminate(void)
 		ListElement* elem = NULL;
 		ListFree(bstate->clients);
 		ListFree(handles);
+		MQTTAsync_drainCommandQueue();
 		while (ListNextElement(commands, &elem))
 			MQTTAsync_freeCommand1((MQTTAsync_queuedCommand*)(elem->content));
 		ListFree(commands);
 		handles = NULL;
+		free(timeouts);
+		timeouts = NULL;
+		timeouts_count = timeouts_size = 0;
 		Socket_outTerminate();
 #if defined(OPENSSL)
 		SSLSocket_terminate();
@@ -681,7 +743,10 @@ int MQTTAsync_restoreCommands(MQTTAsyncs* client)
 				{
 					cmd->client = client;	
 					cmd->seqno = atoi(msgkeys[i]+2);
+					MQTTAsync_lock_mutex(mqttcommand_mutex);
+					MQTTAsync_drainCommandQueue();
 					MQTTPersistence_insertInOrder(commands, cmd, sizeof(MQTTAsync_queuedCommand));
+					MQTTAsync_unlock_mutex(mqttcommand_mutex);
 					free(buffer);
 					client->command_seqno = max(client->command_seqno, cmd->seqno);
 					commands_restored++;
@@ -701,18 +766,105 @@ int MQTTAsync_restoreCommands(MQTTAsyncs* client)
 #endif
 
 
+/**
+ * Set up the cells of the command queue
+ */
+void MQTTAsync_initCommandQueue(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < MQTTASYNC_COMMAND_QUEUE_SIZE; ++i)
+	{
+		command_queue[i].sequence = i;
+		command_queue[i].command = NULL;
+	}
+	command_queue_in = command_queue_out = 0;
+}
+
+
+/**
+ * Add a command to the lock-free queue, from any thread
+ * @param command the command
+ * @param command_size the size to record for it in the commands list
+ * @return 0 if queued, -1 if the queue is full
+ */
+int MQTTAsync_enqueueCommand(MQTTAsync_queuedCommand* command, int command_size)
+{
+	MQTTAsync_commandCell* cell;
+	unsigned int pos = command_queue_in;
+
+	while (1)
+	{
+		int diff;
+
+		cell = &command_queue[pos & (MQTTASYNC_COMMAND_QUEUE_SIZE - 1)];
+		diff = (int)(cell->sequence - pos);
+		MQTTAsync_barrier();
+		if (diff == 0)
+		{
+			if (MQTTAsync_cas(&command_queue_in, pos, pos + 1))
+				break;
+		}
+		else if (diff < 0)
+			return -1; /* the consumer has not emptied this cell yet */
+		pos = command_queue_in;
+	}
+	cell->command = command;
+	cell->size = command_size;
+	MQTTAsync_barrier();
+	cell->sequence = pos + 1; /* publish the cell to the consumer */
+	return 0;
+}
+
+
+/**
+ * Move everything in the lock-free queue onto the end of the commands list, in the order
+ * it was added.  Must be called with mqttcommand_mutex held, which makes the caller the
+ * single consumer.
+ */
+void MQTTAsync_drainCommandQueue(void)
+{
+	while (1)
+	{
+		unsigned int pos = command_queue_out;
+		MQTTAsync_commandCell* cell = &command_queue[pos & (MQTTASYNC_COMMAND_QUEUE_SIZE - 1)];
+
+		if ((int)(cell->sequence - (pos + 1)) < 0)
+			break; /* empty, or the producer has not finished filling the cell */
+		MQTTAsync_barrier();
+		ListAppend(commands, cell->command, cell->size);
+		cell->command = NULL;
+		command_queue_out = pos + 1;
+		MQTTAsync_barrier();
+		cell->sequence = pos + MQTTASYNC_COMMAND_QUEUE_SIZE; /* hand the cell back to producers */
+	}
+}
+
+
+/**
+ * How many commands are waiting, in the list and in the queue.  Only a hint when read
+ * without mqttcommand_mutex.
+ * @return the number of commands
+ */
+int MQTTAsync_commandsQueued(void)
+{
+	return commands->count + (int)(command_queue_in - command_queue_out);
+}
+
+
 int MQTTAsync_addCommand(MQTTAsync_queuedCommand* command, int command_size)
 {
 	int rc = 0;
 	
 	FUNC_ENTRY;
-	MQTTAsync_lock_mutex(mqttcommand_mutex);
 	command->command.start_time = MQTTAsync_start_clock();
 	if (command->command.type == CONNECT || 
 		(command->command.type == DISCONNECT && command->command.details.dis.internal))
 	{
 		MQTTAsync_queuedCommand* head = NULL; 
 		
+		MQTTAsync_lock_mutex(mqttcommand_mutex);
+		MQTTAsync_drainCommandQueue(); /* so that the head of the list really is the head */
 		if (commands->first)
 			head = (MQTTAsync_queuedCommand*)(commands->first->content);
 		
@@ -720,23 +872,173 @@ int MQTTAsync_addCommand(MQTTAsync_queuedCommand* command, int command_size)
 			MQTTAsync_freeCommand(command); /* ignore duplicate connect or disconnect command */
 		else
 			ListInsert(commands, command, command_size, commands->first); /* add to the head of the list */
+		MQTTAsync_unlock_mutex(mqttcommand_mutex);
 	}
-	else
-	{
-		ListAppend(commands, command, command_size);
 #if !defined(NO_PERSISTENCE)
-		if (command->client->c->persistence)
-			MQTTAsync_persistCommand(command);
+	else if (command->client->c->persistence)
+	{	/* persisted sequence numbers have to follow the order of the list */
+		MQTTAsync_lock_mutex(mqttcommand_mutex);
+		MQTTAsync_drainCommandQueue();
+		ListAppend(commands, command, command_size);
+		MQTTAsync_persistCommand(command);
+		MQTTAsync_unlock_mutex(mqttcommand_mutex);
+	}
 #endif
+	else if (MQTTAsync_enqueueCommand(command, command_size) != 0)
+	{	/* queue full, the send thread is behind: append behind what is queued already */
+		MQTTAsync_lock_mutex(mqttcommand_mutex);
+		MQTTAsync_drainCommandQueue();
+		ListAppend(commands, command, command_size);
+		MQTTAsync_unlock_mutex(mqttcommand_mutex);
 	}
-	MQTTAsync_unlock_mutex(mqttcommand_mutex);
+	MQTTAsync_wakeSendThread();
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ * Wake the send thread, or make sure its next wait returns at once if it is busy
+ */
+void MQTTAsync_wakeSendThread(void)
+{
 #if !defined(WIN32)
 	Thread_signal_cond(send_cond);
 #else
 	if (!Thread_check_sem(send_sem))
 		Thread_post_sem(send_sem);
 #endif
-	FUNC_EXIT_RC(rc);
+}
+
+
+void MQTTAsync_swapTimeouts(int a, int b)
+{
+	MQTTAsync_timeout t = timeouts[a];
+
+	timeouts[a] = timeouts[b];
+	timeouts[b] = t;
+}
+
+
+void MQTTAsync_siftDownTimeout(int i)
+{
+	while (1)
+	{
+		int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < timeouts_count && timeouts[left].due < timeouts[smallest].due)
+			smallest = left;
+		if (right < timeouts_count && timeouts[right].due < timeouts[smallest].due)
+			smallest = right;
+		if (smallest == i)
+			break;
+		MQTTAsync_swapTimeouts(i, smallest);
+		i = smallest;
+	}
+}
+
+
+/**
+ * Add a deadline for a client to the timeout heap.  The entry is only a reminder to look
+ * at the client again; the client state decides whether anything has actually timed out.
+ * @param m the client
+ * @param timeout milliseconds from now
+ */
+void MQTTAsync_addTimeout(MQTTAsyncs* m, long timeout)
+{
+	int i;
+
+	FUNC_ENTRY;
+	if (timeouts_count == timeouts_size)
+	{
+		int newsize = (timeouts_size == 0) ? 8 : timeouts_size * 2;
+		MQTTAsync_timeout* newtimeouts = NULL;
+
+		/* the tracking realloc in Heap.h does not accept NULL */
+		if (timeouts == NULL)
+			newtimeouts = malloc(newsize * sizeof(MQTTAsync_timeout));
+		else
+			newtimeouts = realloc(timeouts, newsize * sizeof(MQTTAsync_timeout));
+
+		if (newtimeouts == NULL)
+			goto exit;
+		timeouts = newtimeouts;
+		timeouts_size = newsize;
+	}
+	if (timeouts_count == 0) /* restart the clock so due times stay small */
+		timeouts_epoch = MQTTAsync_start_clock();
+	if (timeout < 0)
+		timeout = 0;
+
+	i = timeouts_count++;
+	timeouts[i].due = MQTTAsync_elapsed(timeouts_epoch) + timeout;
+	timeouts[i].client = m;
+	while (i > 0 && timeouts[(i - 1) / 2].due > timeouts[i].due)
+	{
+		MQTTAsync_swapTimeouts(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+exit:
+	FUNC_EXIT;
+}
+
+
+/**
+ * Remove a client's deadlines from the timeout heap, when the client is destroyed
+ * @param m the client
+ */
+void MQTTAsync_removeTimeouts(MQTTAsyncs* m)
+{
+	int i, j = 0;
+
+	FUNC_ENTRY;
+	for (i = 0; i < timeouts_count; ++i)
+	{
+		if (timeouts[i].client != m)
+			timeouts[j++] = timeouts[i];
+	}
+	if (j < timeouts_count)
+	{
+		timeouts_count = j;
+		for (i = timeouts_count / 2 - 1; i >= 0; --i)
+			MQTTAsync_siftDownTimeout(i);
+	}
+	FUNC_EXIT;
+}
+
+
+/**
+ * Take the earliest deadline off the timeout heap if it is due
+ * @return the client whose deadline it was, or NULL if none is due
+ */
+MQTTAsyncs* MQTTAsync_popDueTimeout(void)
+{
+	MQTTAsyncs* m = NULL;
+
+	if (timeouts_count > 0 && timeouts[0].due <= MQTTAsync_elapsed(timeouts_epoch))
+	{
+		m = timeouts[0].client;
+		timeouts[0] = timeouts[--timeouts_count];
+		MQTTAsync_siftDownTimeout(0);
+	}
+	return m;
+}
+
+
+/**
+ * How long until the earliest deadline on the timeout heap
+ * @return milliseconds, 0 if it is due already, -1 if there are none
+ */
+long MQTTAsync_nextTimeout(void)
+{
+	long rc = -1;
+
+	if (timeouts_count > 0)
+	{
+		rc = timeouts[0].due - MQTTAsync_elapsed(timeouts_epoch);
+		if (rc < 0)
+			rc = 0;
+	}
 	return rc;
 }
 
@@ -896,20 +1198,110 @@ void MQTTAsync_writeComplete(int socket)
 			MQTTAsync_freeCommand(com);
 		}
 	}
+	if (MQTTAsync_commandsQueued() > 0) /* commands for this socket were held back until the write finished */
+		MQTTAsync_wakeSendThread();
 	FUNC_EXIT;
 }
 			
 
-void MQTTAsync_processCommand()
+#if !defined(MQTTASYNC_BATCH_MAX)
+#define MQTTASYNC_BATCH_MAX (SOCKET_BATCH_IOVECS / 5) /* a publish takes up to 5 iovecs */
+#endif
+#if !defined(MQTTASYNC_BATCH_BYTES)
+#define MQTTASYNC_BATCH_BYTES 65536 /* stop adding publishes to a batch when it gets this big */
+#endif
+
+/**
+ * Write a run of publish commands for one client with one system call
+ * @param batch the commands, already taken off the command queue
+ * @param count the number of commands
+ */
+static void MQTTAsync_processPublishes(MQTTAsync_queuedCommand** batch, int count)
+{
+	MQTTAsyncs* m = batch[0]->client;
+	int i, rc = TCPSOCKET_COMPLETE;
+
+	FUNC_ENTRY;
+	Socket_startBatch(m->c->net.socket);
+	for (i = 0; i < count && rc != SOCKET_ERROR; ++i)
+	{
+		MQTTAsync_command* command = &batch[i]->command;
+		Messages* msg = NULL;
+		Publish p;
+
+		p.payload = command->details.pub.payload;
+		p.payloadlen = command->details.pub.payloadlen;
+		p.topic = command->details.pub.destinationName;
+		p.msgId = -1;
+		rc = MQTTProtocol_startPublish(m->c, &p, command->details.pub.qos, command->details.pub.retained, &msg);
+		if (command->details.pub.qos > 0)
+		{
+			command->details.pub.destinationName = NULL; /* this will be freed by the protocol code */
+			command->token = m->c->msgID;
+		}
+	}
+	if (rc != SOCKET_ERROR)
+		rc = Socket_endBatch(m->c->net.socket);
+	else
+		Socket_startBatch(-1); /* drop the batch without writing it */
+
+	if (rc == SOCKET_ERROR)
+		MQTTAsync_disconnect_internal(m, 0);
+	for (i = 0; i < count; ++i)
+	{
+		MQTTAsync_command* command = &batch[i]->command;
+
+		if (rc == SOCKET_ERROR)
+		{
+			if (command->onFailure)
+			{
+				Log(TRACE_MIN, -1, "Calling command failure for client %s", m->c->clientID);
+				(*(command->onFailure))(command->context, NULL);
+			}
+			MQTTAsync_freeCommand(batch[i]);
+		}
+		else if (command->details.pub.qos == 0)
+		{
+			/* an interrupted batch write has copied what is left, so the command is done with */
+			if (command->onSuccess)
+			{
+				MQTTAsync_successData data;
+
+				data.token = command->token;
+				data.alt.pub.destinationName = command->details.pub.destinationName;
+				data.alt.pub.message.payload = command->details.pub.payload;
+				data.alt.pub.message.payloadlen = command->details.pub.payloadlen;
+				data.alt.pub.message.qos = command->details.pub.qos;
+				data.alt.pub.message.retained = command->details.pub.retained;
+				Log(TRACE_MIN, -1, "Calling publish success for client %s", m->c->clientID);
+				(*(command->onSuccess))(command->context, &data);
+			}
+			MQTTAsync_freeCommand(batch[i]);
+		}
+		else
+			ListAppend(m->responses, batch[i], sizeof(batch[i]));
+	}
+	FUNC_EXIT;
+}
+
+
+/**
+ * Process the first command that can be processed now
+ * @return 1 if a command was processed, 0 if every queued command has to wait
+ */
+int MQTTAsync_processCommand()
 {
 	int rc = 0;
 	MQTTAsync_queuedCommand* command = NULL;
+	MQTTAsync_queuedCommand* batch[MQTTASYNC_BATCH_MAX];
+	int batched = 0;
 	ListElement* cur_command = NULL;
 	List* ignored_clients = NULL;
 	
 	FUNC_ENTRY;
 	MQTTAsync_lock_mutex(mqttasync_mutex);
 	MQTTAsync_lock_mutex(mqttcommand_mutex);
+	MQTTAsync_drainCommandQueue();
 	
 	/* only the first command in the list must be processed for any particular client, so if we skip
 	   a command for a client, we must skip all following commands for that client.  Use a list of 
@@ -940,7 +1332,52 @@ void MQTTAsync_processCommand()
 		ListAppend(ignored_clients, cmd->client, sizeof(cmd->client));
 	}
 	ListFreeNoContent(ignored_clients);
-	if (command)
+	if (command && command->command.type == PUBLISH
+#if defined(OPENSSL)
+		&& !command->client->ssl /* SSL_write takes one buffer at a time anyway */
+#endif
+		)
+	{
+		/* gather the publishes queued behind this one for the same client, to write them together */
+		int msgids = command->client->c->outboundMsgs->count + (command->command.details.pub.qos > 0);
+		long bytes = 0L;
+
+		cur_command = NULL;
+		while (ListNextElement(commands, &cur_command) && batched < MQTTASYNC_BATCH_MAX)
+		{
+			MQTTAsync_queuedCommand* cmd = (MQTTAsync_queuedCommand*)(cur_command->content);
+
+			if (cmd->client != command->client)
+				continue;
+			if (cmd->command.type != PUBLISH)
+				break;
+			if (cmd != command)
+			{
+				if (cmd->command.details.pub.qos > 0 && msgids >= MAX_MSG_ID - 1)
+					break;
+				if (bytes + cmd->command.details.pub.payloadlen + strlen(cmd->command.details.pub.destinationName) + 9 >
+					MQTTASYNC_BATCH_BYTES)
+					break;
+				msgids += (cmd->command.details.pub.qos > 0);
+			}
+			bytes += cmd->command.details.pub.payloadlen + strlen(cmd->command.details.pub.destinationName) + 9;
+			batch[batched++] = cmd;
+		}
+	}
+	if (batched > 1)
+	{
+		int i;
+
+		for (i = 0; i < batched; ++i)
+		{
+			ListDetach(commands, batch[i]);
+#if !defined(NO_PERSISTENCE)
+			if (batch[i]->client->c->persistence)
+				MQTTAsync_unpersistCommand(batch[i]);
+#endif
+		}
+	}
+	else if (command)
 	{
 		ListDetach(commands, command);
 #if !defined(NO_PERSISTENCE)
@@ -952,6 +1389,12 @@ void MQTTAsync_processCommand()
 	
 	if (!command)
 		goto exit; /* nothing to do */
+
+	if (batched > 1)
+	{
+		MQTTAsync_processPublishes(batch, batched);
+		goto exit;
+	}
 	
 	if (command->command.type == CONNECT)
 	{
@@ -1024,7 +1467,7 @@ void MQTTAsync_processCommand()
 		Messages* msg = NULL;
 		Publish* p = NULL;
 	
-		p = malloc(sizeof(Publish));
+		p = pool_malloc(POOL_PUBLISH, sizeof(Publish));
 
 		p->payload = command->command.details.pub.payload;
 		p->payloadlen = command->command.details.pub.payloadlen;
@@ -1073,11 +1516,17 @@ void MQTTAsync_processCommand()
 	if (command->command.type == CONNECT && rc != SOCKET_ERROR && rc != MQTTASYNC_PERSISTENCE_ERROR)
 	{
 		command->client->connect = command->command;
+		if (command->client->c->connect_state != 0)
+			MQTTAsync_addTimeout(command->client, command->command.details.conn.timeout * 1000 -
+				MQTTAsync_elapsed(command->command.start_time));
 		MQTTAsync_freeCommand(command);
 	}
 	else if (command->command.type == DISCONNECT)
 	{
 		command->client->disconnect = command->command;
+		if (command->client->c->connect_state == -2)
+			MQTTAsync_addTimeout(command->client, command->command.details.dis.timeout -
+				MQTTAsync_elapsed(command->command.start_time));
 		MQTTAsync_freeCommand(command);
 	}
 	else if (command->command.type == PUBLISH && command->command.details.pub.qos == 0)
@@ -1125,89 +1574,103 @@ void MQTTAsync_processCommand()
 
 exit:
 	MQTTAsync_unlock_mutex(mqttasync_mutex);
-	FUNC_EXIT;
+	rc = (command != NULL);
+	FUNC_EXIT_RC(rc);
+	return rc;
 }
 
 
-void MQTTAsync_checkTimeouts()
+/**
+ * Check a client for connect and disconnect timeouts
+ * @param m the client
+ */
+void MQTTAsync_checkClientTimeouts(MQTTAsyncs* m)
 {
-	ListElement* current = NULL;
-	static time_t last = 0L;
-	time_t now;
-
+	ListElement* cur_response = NULL;
+	int i = 0, 
+		timed_out_count = 0;
+	
 	FUNC_ENTRY;
-	time(&(now));
-	if (difftime(now, last) < 3)
+	/* check connect timeout */
+	if (m->c->connect_state != 0 && MQTTAsync_elapsed(m->connect.start_time) >= (m->connect.details.conn.timeout * 1000))
+	{
+		if (m->connect.details.conn.currentURI < m->connect.details.conn.serverURIcount)
+		{
+			MQTTAsync_queuedCommand* conn;
+			
+			MQTTAsync_closeOnly(m->c);
+			/* put the connect command back to the head of the command queue, using the next serverURI */
+			conn = malloc(sizeof(MQTTAsync_queuedCommand));
+			memset(conn, '\0', sizeof(MQTTAsync_queuedCommand));
+			conn->client = m;
+			conn->command = m->connect; 
+			Log(TRACE_MIN, -1, "Connect failed, now trying %s", 
+				m->connect.details.conn.serverURIs[m->connect.details.conn.currentURI]);
+			MQTTAsync_addCommand(conn, sizeof(m->connect));
+		}
+		else
+		{
+			MQTTAsync_closeSession(m->c);
+			MQTTAsync_freeConnect(m->connect);
+			if (m->connect.onFailure)
+			{
+				Log(TRACE_MIN, -1, "Calling connect failure for client %s", m->c->clientID);
+				(*(m->connect.onFailure))(m->connect.context, NULL);
+			}
+		}
 		goto exit;
+	}
 
-	MQTTAsync_lock_mutex(mqttasync_mutex);
-	last = now;
-	while (ListNextElement(handles, &current))		/* for each client */
+	/* check disconnect timeout */
+	if (m->c->connect_state == -2)
+		MQTTAsync_checkDisconnect(m, &m->disconnect);
+
+	timed_out_count = 0;
+	/* check response timeouts */
+	while (ListNextElement(m->responses, &cur_response))
 	{
-		ListElement* cur_response = NULL;
-		int i = 0, 
-			timed_out_count = 0;
-		
-		MQTTAsyncs* m = (MQTTAsyncs*)(current->content);
+		MQTTAsync_queuedCommand* com = (MQTTAsync_queuedCommand*)(cur_response->content);
 		
-		/* check connect timeout */
-		if (m->c->connect_state != 0 && MQTTAsync_elapsed(m->connect.start_time) > (m->connect.details.conn.timeout * 1000))
+		if (1 /*MQTTAsync_elapsed(com->command.start_time) < 120000*/)	
+			break; /* command has not timed out */
+		else
 		{
-			if (m->connect.details.conn.currentURI < m->connect.details.conn.serverURIcount)
-			{
-				MQTTAsync_queuedCommand* conn;
-				
-				MQTTAsync_closeOnly(m->c);
-				/* put the connect command back to the head of the command queue, using the next serverURI */
-				conn = malloc(sizeof(MQTTAsync_queuedCommand));
-				memset(conn, '\0', sizeof(MQTTAsync_queuedCommand));
-				conn->client = m;
-				conn->command = m->connect; 
-				Log(TRACE_MIN, -1, "Connect failed, now trying %s", 
-					m->connect.details.conn.serverURIs[m->connect.details.conn.currentURI]);
-				MQTTAsync_addCommand(conn, sizeof(m->connect));
-			}
-			else
-			{
-				MQTTAsync_closeSession(m->c);
-				MQTTAsync_freeConnect(m->connect);
-				if (m->connect.onFailure)
-				{
-					Log(TRACE_MIN, -1, "Calling connect failure for client %s", m->c->clientID);
-					(*(m->connect.onFailure))(m->connect.context, NULL);
-				}
+			if (com->command.onFailure)
+			{		
+				Log(TRACE_MIN, -1, "Calling %s failure for client %s", 
+							MQTTPacket_name(com->command.type), m->c->clientID);
+				(*(com->command.onFailure))(com->command.context, NULL);
 			}
-			continue;
+			timed_out_count++;
 		}
-	
-		/* check disconnect timeout */
+	}
+	for (i = 0; i < timed_out_count; ++i)
+		ListRemoveHead(m->responses);	/* remove the first response in the list */
+exit:
+	FUNC_EXIT;
+}
+
+
+/**
+ * Act on the deadlines that are due, and finish disconnects whose in-flight message flows
+ * have completed since the last look.  Called by the send thread each time it wakes.
+ */
+void MQTTAsync_checkTimeouts()
+{
+	ListElement* current = NULL;
+	MQTTAsyncs* m = NULL;
+
+	FUNC_ENTRY;
+	MQTTAsync_lock_mutex(mqttasync_mutex);
+	while ((m = MQTTAsync_popDueTimeout()) != NULL)
+		MQTTAsync_checkClientTimeouts(m);
+	while (ListNextElement(handles, &current))
+	{
+		m = (MQTTAsyncs*)(current->content);
 		if (m->c->connect_state == -2)
 			MQTTAsync_checkDisconnect(m, &m->disconnect);
-	
-		timed_out_count = 0;
-		/* check response timeouts */
-		while (ListNextElement(m->responses, &cur_response))
-		{
-			MQTTAsync_queuedCommand* com = (MQTTAsync_queuedCommand*)(cur_response->content);
-			
-			if (1 /*MQTTAsync_elapsed(com->command.start_time) < 120000*/)	
-				break; /* command has not timed out */
-			else
-			{
-				if (com->command.onFailure)
-				{		
-					Log(TRACE_MIN, -1, "Calling %s failure for client %s", 
-								MQTTPacket_name(com->command.type), m->c->clientID);
-					(*(com->command.onFailure))(com->command.context, NULL);
-				}
-				timed_out_count++;
-			}
-		}
-		for (i = 0; i < timed_out_count; ++i)
-			ListRemoveHead(m->responses);	/* remove the first response in the list */
 	}
 	MQTTAsync_unlock_mutex(mqttasync_mutex);
-exit:
 	FUNC_EXIT;
 }
 
@@ -1220,17 +1683,25 @@ thread_return_type WINAPI MQTTAsync_sendThread(void* n)
 	MQTTAsync_unlock_mutex(mqttasync_mutex);
 	while (!tostop)
 	{
-		/*int rc;*/
-		
-		while (commands->count > 0)
-			MQTTAsync_processCommand();
+		long timeout;
+
+		/* stop when the commands left have to wait, for a connect or a pending write */
+		while (MQTTAsync_commandsQueued() > 0 && MQTTAsync_processCommand())
+			;
+		MQTTAsync_checkTimeouts();
+
+		/* sleep until a command is queued, the receive thread reports progress, or the
+		   next deadline.  Commands that are waiting are retried every second regardless. */
+		MQTTAsync_lock_mutex(mqttasync_mutex);
+		timeout = MQTTAsync_nextTimeout();
+		MQTTAsync_unlock_mutex(mqttasync_mutex);
+		if (MQTTAsync_commandsQueued() > 0 && (timeout < 0 || timeout > 1000))
+			timeout = 1000;
 #if !defined(WIN32)
-		/*rc =*/ Thread_wait_cond(send_cond, 1);
+		Thread_wait_cond_ms(send_cond, timeout);
 #else
-		/*rc =*/ Thread_wait_sem(send_sem, 1000);
+		Thread_wait_sem(send_sem, (timeout < 0) ? INFINITE : timeout);
 #endif
-			
-		MQTTAsync_checkTimeouts();
 	}
 	sendThread_state = STOPPING;
 	MQTTAsync_lock_mutex(mqttasync_mutex);
@@ -1282,6 +1753,8 @@ void MQTTAsync_removeResponsesAndCommands(MQTTAsyncs* m)
 	
 	/* remove commands in the command queue relating to this client */
 	count = 0;
+	MQTTAsync_lock_mutex(mqttcommand_mutex);
+	MQTTAsync_drainCommandQueue();
 	current = ListNextElement(commands, &next);
 	ListNextElement(commands, &next);
 	while (current)
@@ -1297,6 +1770,7 @@ void MQTTAsync_removeResponsesAndCommands(MQTTAsyncs* m)
 		current = next;
 		ListNextElement(commands, &next);
 	}
+	MQTTAsync_unlock_mutex(mqttcommand_mutex);
 	Log(TRACE_MINIMUM, -1, "%d commands removed for client %s", count, m->c->clientID);
 	FUNC_EXIT;
 }
@@ -1313,6 +1787,7 @@ void MQTTAsync_destroy(MQTTAsync* handle)
 		goto exit;
 
 	MQTTAsync_removeResponsesAndCommands(m);
+	MQTTAsync_removeTimeouts(m);
 	ListFree(m->responses);
 	
 	if (m->c)
@@ -1591,16 +2066,15 @@ thread_return_type WINAPI MQTTAsync_receiveThread(void* n)
 				}
 			}
 		}
+		/* what was just read may let the send thread go on: a CONNACK, an ack that frees a
+		   message id, or the last in-flight flow of a disconnect */
+		if (MQTTAsync_commandsQueued() > 0 || m->c->connect_state == -2)
+			MQTTAsync_wakeSendThread();
 	}
 	receiveThread_state = STOPPED;
 	MQTTAsync_unlock_mutex(mqttasync_mutex);
-#if !defined(WIN32)
 	if (sendThread_state != STOPPED)
-		Thread_signal_cond(send_cond);
-#else
-	if (sendThread_state != STOPPED && !Thread_check_sem(send_sem))
-		Thread_post_sem(send_sem);
-#endif
+		MQTTAsync_wakeSendThread();
 	FUNC_EXIT;
 	return 0;
 }
@@ -1632,6 +2106,7 @@ void MQTTAsync_stop()
 		{
 			int count = 0;
 			tostop = 1;
+			MQTTAsync_wakeSendThread();
 			while ((sendThread_state != STOPPED || receiveThread_state != STOPPED) && ++count < 100)
 			{
 				MQTTAsync_unlock_mutex(mqttasync_mutex);
@@ -1734,6 +2209,7 @@ int MQTTAsync_cleanSession(Clients* client)
 #endif
 	MQTTProtocol_emptyMessageList(client->inboundMsgs);
 	MQTTProtocol_emptyMessageList(client->outboundMsgs);
+	MQTTProtocol_indexOutbound(client);
 	MQTTAsync_emptyMessageQueue(client);
 	client->msgID = 0;
 	
@@ -1981,6 +2457,35 @@ void Protocol_processPublication(Publish* publish, Clients* client)
 }
 
 
+#if !defined(MQTTASYNC_POOL_ITEMS)
+#define MQTTASYNC_POOL_ITEMS 64 /* pool items reserved on top of the in-flight window */
+#endif
+#if !defined(MQTTASYNC_POOL_BUFFER_SIZE)
+#define MQTTASYNC_POOL_BUFFER_SIZE 256 /* topics and payloads larger than this are malloc'd */
+#endif
+
+/**
+ * Size the heap pools used on the publish path for a client's in-flight window.  Each
+ * publish needs a command, a topic and payload copy, and for QoS > 0 a message and
+ * publication, with a list element for each list they are on.  The pools only ever grow,
+ * so they end up sized for the largest window of any client.
+ * @param maxInflight the number of messages the client may have in flight
+ */
+static void MQTTAsync_reservePools(int maxInflight)
+{
+	int count = ((maxInflight > 0) ? maxInflight : 0) + MQTTASYNC_POOL_ITEMS;
+
+	FUNC_ENTRY;
+	Heap_poolReserve(POOL_COMMAND, sizeof(MQTTAsync_queuedCommand), count);
+	Heap_poolReserve(POOL_LIST_ELEMENT, sizeof(ListElement), 4 * count);
+	Heap_poolReserve(POOL_PUBLISH, sizeof(Publish), 4);
+	Heap_poolReserve(POOL_MESSAGE, sizeof(Messages), count);
+	Heap_poolReserve(POOL_PUBLICATION, sizeof(Publications), count);
+	Heap_poolReserve(POOL_BUFFER, MQTTASYNC_POOL_BUFFER_SIZE, 3 * count);
+	FUNC_EXIT;
+}
+
+
 int MQTTAsync_connect(MQTTAsync handle, MQTTAsync_connectOptions* options)
 {
 	MQTTAsyncs* m = handle;
@@ -2051,6 +2556,7 @@ int MQTTAsync_connect(MQTTAsync handle, MQTTAsync_connectOptions* options)
 	m->c->keepAliveInterval = options->keepAliveInterval;
 	m->c->cleansession = options->cleansession;
 	m->c->maxInflightMessages = options->maxInflight;
+	MQTTAsync_reservePools(options->maxInflight);
 
 	if (m->c->will)
 	{
@@ -2379,8 +2885,13 @@ int MQTTAsync_unsubscribe(MQTTAsync handle, char* topic, MQTTAsync_responseOptio
 }
 
 
-int MQTTAsync_send(MQTTAsync handle, char* destinationName, int payloadlen, void* payload,
-							 int qos, int retained, MQTTAsync_responseOptions* response)
+/**
+ * Queue a publish command, copying the payload or borrowing it from a registered buffer.
+ * @param borrow boolean - whether to borrow the payload rather than copy it
+ * @return ::MQTTASYNC_SUCCESS or an error code
+ */
+static int MQTTAsync_queuePublish(MQTTAsync handle, char* destinationName, int payloadlen, void* payload,
+							 int qos, int retained, MQTTAsync_responseOptions* response, int borrow)
 {
 	int rc = MQTTASYNC_SUCCESS;
 	MQTTAsyncs* m = handle;
@@ -2397,12 +2908,14 @@ int MQTTAsync_send(MQTTAsync handle, char* destinationName, int payloadlen, void
 		rc = MQTTASYNC_BAD_QOS;
 	else if (m->c->outboundMsgs->count >= MAX_MSG_ID - 1)
 		rc = MQTTASYNC_NO_MORE_MSGIDS;
+	else if (borrow && !Heap_borrowBuffer(payload, payloadlen))
+		rc = MQTTASYNC_BAD_BUFFER;
 
 	if (rc != MQTTASYNC_SUCCESS)
 		goto exit;
 	
 	/* Add publish request to operation queue */
-	pub = malloc(sizeof(MQTTAsync_queuedCommand));
+	pub = pool_malloc(POOL_COMMAND, sizeof(MQTTAsync_queuedCommand));
 	memset(pub, '\0', sizeof(MQTTAsync_queuedCommand));
 	pub->client = m;
 	pub->command.type = PUBLISH;
@@ -2412,11 +2925,16 @@ int MQTTAsync_send(MQTTAsync handle, char* destinationName, int payloadlen, void
 		pub->command.onFailure = response->onFailure;
 		pub->command.context = response->context;
 	}
-	pub->command.details.pub.destinationName = malloc(strlen(destinationName) + 1);
+	pub->command.details.pub.destinationName = pool_malloc(POOL_BUFFER, strlen(destinationName) + 1);
 	strcpy(pub->command.details.pub.destinationName, destinationName);
 	pub->command.details.pub.payloadlen = payloadlen;
-	pub->command.details.pub.payload = malloc(payloadlen);
-	memcpy(pub->command.details.pub.payload, payload, payloadlen);
+	if (borrow)
+		pub->command.details.pub.payload = payload; /* freeing it drops the reference taken above */
+	else
+	{
+		pub->command.details.pub.payload = pool_malloc(POOL_BUFFER, payloadlen);
+		memcpy(pub->command.details.pub.payload, payload, payloadlen);
+	}
 	pub->command.details.pub.qos = qos;
 	pub->command.details.pub.retained = retained;
 	rc = MQTTAsync_addCommand(pub, sizeof(pub));
@@ -2427,6 +2945,58 @@ exit:
 }
 
 
+int MQTTAsync_send(MQTTAsync handle, char* destinationName, int payloadlen, void* payload,
+							 int qos, int retained, MQTTAsync_responseOptions* response)
+{
+	int rc = MQTTASYNC_SUCCESS;
+
+	FUNC_ENTRY;
+	rc = MQTTAsync_queuePublish(handle, destinationName, payloadlen, payload, qos, retained, response, 0);
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTAsync_sendBuffer(MQTTAsync handle, char* destinationName, int payloadlen, void* payload,
+							 int qos, int retained, MQTTAsync_responseOptions* response)
+{
+	int rc = MQTTASYNC_SUCCESS;
+
+	FUNC_ENTRY;
+	rc = MQTTAsync_queuePublish(handle, destinationName, payloadlen, payload, qos, retained, response, 1);
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTAsync_registerBuffers(void* buffers, int size, int count, MQTTAsync_bufferReleased* release, void* context)
+{
+	int rc = MQTTASYNC_SUCCESS;
+
+	FUNC_ENTRY;
+	if (buffers == NULL || release == NULL)
+		rc = MQTTASYNC_NULL_PARAMETER;
+	else if (size <= 0 || count <= 0 || Heap_registerBuffers(buffers, size, count, release, context) != 0)
+		rc = MQTTASYNC_FAILURE;
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int MQTTAsync_unregisterBuffers(void* buffers)
+{
+	int rc = MQTTASYNC_SUCCESS;
+
+	FUNC_ENTRY;
+	if (buffers == NULL)
+		rc = MQTTASYNC_NULL_PARAMETER;
+	else if (Heap_unregisterBuffers(buffers) != 0)
+		rc = MQTTASYNC_FAILURE;
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 
 int MQTTAsync_sendMessage(MQTTAsync handle, char* destinationName, MQTTAsync_message* message,
 													 MQTTAsync_responseOptions* response)
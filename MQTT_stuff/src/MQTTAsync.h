@@ -144,6 +144,11 @@
  * Return code: All 65535 MQTT msgids are being used
  */
 #define MQTTASYNC_NO_MORE_MSGIDS -10
+/**
+ * Return code: The payload passed to MQTTAsync_sendBuffer() is not within one of the
+ * buffers registered with MQTTAsync_registerBuffers()
+ */
+#define MQTTASYNC_BAD_BUFFER -11
 
 /**
  * A handle representing an MQTT client. A valid client handle is available
@@ -346,6 +351,20 @@ typedef void MQTTAsync_onSuccess(void* context, MQTTAsync_successData* response)
  */
 typedef void MQTTAsync_onFailure(void* context,  MQTTAsync_failureData* response);
 
+/**
+ * This is a callback function. The client application
+ * must provide an implementation of this function to get back buffers lent
+ * to the client library with ::MQTTAsync_sendBuffer(). The function is
+ * registered with the client library by passing it as an argument to
+ * ::MQTTAsync_registerBuffers(). It is called from one of the library's threads
+ * once the library has finished with the buffer, at which point the application
+ * may reuse it.
+ * @param context A pointer to the <i>context</i> value originally passed to
+ * ::MQTTAsync_registerBuffers(), which contains any application-specific context.
+ * @param buffer The start of the buffer being handed back.
+ */
+typedef void MQTTAsync_bufferReleased(void* context, void* buffer);
+
 typedef struct
 {
 	/** The eyecatcher for this structure.  Must be MQTR */
@@ -437,6 +456,10 @@ DLLExport int MQTTAsync_setCallbacks(MQTTAsync handle, void* context, MQTTAsync_
  * storage and provides some protection against message loss in the case of 
  * unexpected failure.
  * <br>
+ * ::MQTTCLIENT_PERSISTENCE_LOG: Like ::MQTTCLIENT_PERSISTENCE_DEFAULT, but
+ * the status is held in a single append-only log file rather than in a file
+ * per message, which is much cheaper to update.
+ * <br>
  * ::MQTTCLIENT_PERSISTENCE_USER: Use an application-specific persistence
  * implementation. Using this type of persistence gives control of the 
  * persistence mechanism to the application. The application has to implement
@@ -446,6 +469,9 @@ DLLExport int MQTTAsync_setCallbacks(MQTTAsync handle, void* context, MQTTAsync_
  * be set to NULL. For ::MQTTCLIENT_PERSISTENCE_DEFAULT persistence, it
  * should be set to the location of the persistence directory (if set 
  * to NULL, the persistence directory used is the working directory).
+ * For ::MQTTCLIENT_PERSISTENCE_LOG persistence, it should point to a
+ * ::MQTTClient_logPersistenceOptions structure (if set to NULL, the defaults
+ * are used).
  * Applications that use ::MQTTCLIENT_PERSISTENCE_USER persistence set this
  * argument to point to a valid MQTTClient_persistence structure.
  * @return ::MQTTASYNC_SUCCESS if the client is successfully created, otherwise
@@ -589,6 +615,7 @@ typedef struct
 	int cleansession;
 	/** 
       * This controls how many messages can be in-flight simultaneously. 
+      * It is also used to size the preallocated memory pools for publishing.
 	  */
 	int maxInflight;		
 	/** 
@@ -851,6 +878,58 @@ DLLExport int MQTTAsync_send(MQTTAsync handle, char* destinationName, int payloa
 DLLExport int MQTTAsync_sendMessage(MQTTAsync handle, char* destinationName, MQTTAsync_message* msg, MQTTAsync_responseOptions* response);
 
 
+/**
+  * This function registers a set of equal-sized application buffers which can
+  * then be published from without being copied, using ::MQTTAsync_sendBuffer().
+  * The buffers are shared by all clients.
+  * @param buffers A pointer to the first of <i>count</i> contiguous buffers.
+  * @param size The size of each buffer in bytes.
+  * @param count The number of buffers.
+  * @param release A pointer to an ::MQTTAsync_bufferReleased() callback function,
+  * called whenever the client library has finished with one of the buffers.
+  * @param context A pointer to any application-specific context. The
+  * <i>context</i> pointer is passed to the release callback.
+  * @return ::MQTTASYNC_SUCCESS if the buffers are registered.
+  * An error code is returned if the buffers overlap ones already registered, or
+  * too many sets are registered.
+  */
+DLLExport int MQTTAsync_registerBuffers(void* buffers, int size, int count, MQTTAsync_bufferReleased* release, void* context);
+
+/**
+  * This function removes a set of buffers registered with ::MQTTAsync_registerBuffers().
+  * @param buffers The pointer to the first buffer, as registered.
+  * @return ::MQTTASYNC_SUCCESS if the buffers are removed.
+  * An error code is returned if the buffers are not registered or one of them
+  * has not yet been released.
+  */
+DLLExport int MQTTAsync_unregisterBuffers(void* buffers);
+
+/**
+  * This function publishes a message in the same way as ::MQTTAsync_send(),
+  * except that the payload is not copied. Instead the client library borrows
+  * the registered buffer containing the payload, and writes the payload to the
+  * network straight from it. The application must not modify the buffer until
+  * it is handed back through the ::MQTTAsync_bufferReleased() callback, which
+  * happens once the message has been written for QoS 0, or the delivery has
+  * completed for QoS 1 and 2.
+  * @param handle A valid client handle from a successful call to
+  * MQTTAsync_create().
+  * @param destinationName The topic associated with this message.
+  * @param payloadlen The length of the payload in bytes.
+  * @param payload A pointer to the payload, which must lie entirely within one of
+  * the buffers registered with ::MQTTAsync_registerBuffers().
+  * @param qos The @ref qos of the message.
+  * @param retained The retained flag for the message.
+  * @param response A pointer to an ::MQTTAsync_responseOptions structure. Used to set callback functions.
+  * This is optional and can be set to NULL.
+  * @return ::MQTTASYNC_SUCCESS if the message is accepted for publication, in which
+  * case the buffer will be released later. Otherwise an error code is returned
+  * and the buffer is not held by the library.
+  */
+DLLExport int MQTTAsync_sendBuffer(MQTTAsync handle, char* destinationName, int payloadlen, void* payload, int qos, int retained,
+																 MQTTAsync_responseOptions* response);
+
+
 /**
   * This function sets a pointer to an array of tokens for 
   * messages that are currently in-flight (pending completion). 
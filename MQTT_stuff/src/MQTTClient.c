@@ -679,6 +679,7 @@ int MQTTClient_cleanSession(Clients* client)
 #endif
 	MQTTProtocol_emptyMessageList(client->inboundMsgs);
 	MQTTProtocol_emptyMessageList(client->outboundMsgs);
+	MQTTProtocol_indexOutbound(client);
 	MQTTClient_emptyMessageQueue(client);
 	client->msgID = 0;
 	FUNC_EXIT_RC(rc);
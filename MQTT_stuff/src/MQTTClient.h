@@ -369,6 +369,10 @@ DLLExport int MQTTClient_setCallbacks(MQTTClient handle, void* context, MQTTClie
  * storage and provides some protection against message loss in the case of 
  * unexpected failure.
  * <br>
+ * ::MQTTCLIENT_PERSISTENCE_LOG: Like ::MQTTCLIENT_PERSISTENCE_DEFAULT, but
+ * the status is held in a single append-only log file rather than in a file
+ * per message, which is much cheaper to update.
+ * <br>
  * ::MQTTCLIENT_PERSISTENCE_USER: Use an application-specific persistence
  * implementation. Using this type of persistence gives control of the 
  * persistence mechanism to the application. The application has to implement
@@ -378,6 +382,9 @@ DLLExport int MQTTClient_setCallbacks(MQTTClient handle, void* context, MQTTClie
  * be set to NULL. For ::MQTTCLIENT_PERSISTENCE_DEFAULT persistence, it
  * should be set to the location of the persistence directory (if set 
  * to NULL, the persistence directory used is the working directory).
+ * For ::MQTTCLIENT_PERSISTENCE_LOG persistence, it should point to a
+ * ::MQTTClient_logPersistenceOptions structure (if set to NULL, the defaults
+ * are used).
  * Applications that use ::MQTTCLIENT_PERSISTENCE_USER persistence set this
  * argument to point to a valid MQTTClient_persistence structure.
  * @return ::MQTTCLIENT_SUCCESS if the client is successfully created, otherwise
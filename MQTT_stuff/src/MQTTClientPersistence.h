@@ -73,6 +73,12 @@
   * persistence mechanism (see MQTTClient_create()).
   */
 #define MQTTCLIENT_PERSISTENCE_USER 2
+/**
+  * This <i>persistence_type</i> value specifies a file system-based persistence
+  * mechanism that keeps all of a client's state in one append-only log file
+  * (see MQTTClient_create() and ::MQTTClient_logPersistenceOptions).
+  */
+#define MQTTCLIENT_PERSISTENCE_LOG 3
 
 /** 
   * Application-specific persistence functions must return this error code if 
@@ -247,4 +253,44 @@ typedef struct {
 	Persistence_containskey pcontainskey;
 } MQTTClient_persistence;
 
+
+/**
+  * @brief The settings for ::MQTTCLIENT_PERSISTENCE_LOG persistence.
+  *
+  * A pointer to this structure is passed as the persistence context when the
+  * client is created, or NULL to use the defaults set by
+  * MQTTClient_logPersistenceOptions_initializer.  The log is written to the file
+  * <i>clientID-serverURI</i>.log in the directory.  Records are appended to it as
+  * messages are put and removed, and the live records are copied to a new file
+  * when enough of it is dead.  The structure is copied, so it need not outlive
+  * the create call.
+  */
+typedef struct
+{
+	/** The eyecatcher for this structure.  must be MQLP. */
+	char struct_id[4];
+	/** The version number of this structure.  Must be 0 */
+	int struct_version;
+	/** The directory for the log file.  NULL means the working directory. */
+	char* directory;
+	/**
+	  * Flush the log to the storage device (fsync) after this many records
+	  * have been appended.  1 syncs every record, 0 leaves it to the system.
+	  */
+	int syncRecords;
+	/**
+	  * Also flush the log when a record is appended this many milliseconds or
+	  * more after the last flush.  0 means no time limit.  The log is always
+	  * flushed when it is closed.
+	  */
+	int syncInterval;
+	/**
+	  * Compact the log once it is larger than this many bytes and at least half
+	  * of it is taken up by removed or replaced records.
+	  */
+	int compactSize;
+} MQTTClient_logPersistenceOptions;
+
+#define MQTTClient_logPersistenceOptions_initializer { {'M', 'Q', 'L', 'P'}, 0, NULL, 32, 200, 65536 }
+
 #endif
@@ -26,6 +26,7 @@
 
 #include "MQTTPersistence.h"
 #include "MQTTPersistenceDefault.h"
+#include "MQTTPersistenceLog.h"
 #include "MQTTProtocolClient.h"
 #include "Heap.h"
 
@@ -75,6 +76,28 @@ int MQTTPersistence_create(MQTTClient_persistence** persistence, int type, void*
 			else
 				rc = MQTTCLIENT_PERSISTENCE_ERROR;
 			break;
+		case MQTTCLIENT_PERSISTENCE_LOG :
+			per = malloc(sizeof(MQTTClient_persistence));
+			if ( per != NULL && (per->context = plogoptions(pcontext)) != NULL )
+			{
+				/* append-only log functions */
+				per->popen        = plogopen;
+				per->pclose       = plogclose;
+				per->pput         = plogput;
+				per->pget         = plogget;
+				per->premove      = plogremove;
+				per->pkeys        = plogkeys;
+				per->pclear       = plogclear;
+				per->pcontainskey = plogcontainskey;
+			}
+			else
+			{
+				if ( per != NULL )
+					free(per);
+				per = NULL;
+				rc = MQTTCLIENT_PERSISTENCE_ERROR;
+			}
+			break;
 		case MQTTCLIENT_PERSISTENCE_USER :
 			per = (MQTTClient_persistence *)pcontext;
 			if ( per == NULL || (per != NULL && (per->context == NULL || per->pclear == NULL ||
@@ -135,6 +158,11 @@ int MQTTPersistence_close(Clients *c)
 #if !defined(NO_PERSISTENCE)
 		if ( c->persistence->popen == pstopen )
 			free(c->persistence);
+		else if ( c->persistence->popen == plogopen )
+		{
+			plogfreeoptions(c->persistence->context);
+			free(c->persistence);
+		}
 #endif
 		c->persistence = NULL;
 	}
@@ -252,6 +280,7 @@ int MQTTPersistence_restore(Clients *c)
 	Log(TRACE_MINIMUM, -1, "%d sent messages and %d received messages restored for client %s\n", 
 		msgs_sent, msgs_rcvd, c->clientID);
 	MQTTPersistence_wrapMsgID(c);
+	MQTTProtocol_indexOutbound(c);
 
 	FUNC_EXIT_RC(rc);
 	return rc;
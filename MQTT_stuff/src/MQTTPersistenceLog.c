@@ -0,0 +1,817 @@
+/*******************************************************************************
+ * Copyright (c) 2009, 2013 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+/**
+ * @file
+ * \brief A persistence implementation that keeps each client's state in one append-only log.
+ *
+ * Every put and remove appends a checksummed record to the log file, so persisting a
+ * message and forgetting it again costs two sequential writes rather than a file create
+ * and an unlink.  An index in memory maps each live key to its record in the log.
+ *
+ * When the log is opened it is read from the start to rebuild the index.  Reading stops
+ * at the first record that is cut short or fails its checksum, which is where the last
+ * write before a crash ended, and the log is truncated there.  Once the log has grown
+ * past the compaction size and at least half of it is dead, the live records are copied
+ * to a new file which replaces it.
+ *
+ * A record is a 12 byte header followed by the key and the data.  The header holds the
+ * CRC-32 of the rest of the record, the record type, an unused byte, and the lengths of
+ * the key and data, all little endian.
+ */
+
+#if !defined(NO_PERSISTENCE)
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(WIN32)
+	#include <windows.h>
+	#include <io.h>
+	#define fsync _commit
+	#define fileno _fileno
+	#define ftruncate _chsize
+#else
+	#include <sys/time.h>
+	#include <unistd.h>
+#endif
+
+#include "MQTTClientPersistence.h"
+#include "MQTTPersistenceDefault.h"
+#include "MQTTPersistenceLog.h"
+#include "Tree.h"
+#include "Log.h"
+#include "StackTrace.h"
+#include "Heap.h"
+
+/** Length of a record header */
+#define PLOG_HEADER_LENGTH 12
+/** Record type: the data for a key */
+#define PLOG_PUT 'P'
+/** Record type: a key has been removed */
+#define PLOG_REMOVE 'R'
+
+/**
+ * Where the data for a key is in the log
+ */
+typedef struct
+{
+	char* key;
+	long offset;	/**< offset of the record in the log */
+	int datalen;	/**< length of the data, which follows the header and key */
+	long newoffset;	/**< offset of the record in the log being compacted into */
+} plog_entry;
+
+/**
+ * An open log, the handle passed to the persistence functions
+ */
+typedef struct
+{
+	char* filename;
+	FILE* fp;
+	Tree* index;	/**< plog_entry structures by key */
+	long size;		/**< length of the log */
+	long live;		/**< bytes of the log in records which are still current */
+	int unsynced;	/**< records appended since the log was last flushed to the device */
+	long lastsync;	/**< when the log was last flushed to the device, in milliseconds */
+	MQTTClient_logPersistenceOptions opts;
+} plog_handle;
+
+static unsigned int plog_crc_table[256];
+static int plog_crc_ready = 0;
+
+
+/**
+ * Build the CRC-32 table, the first time a log is opened
+ */
+static void plogcrcinit(void)
+{
+	int i, j;
+
+	if (plog_crc_ready)
+		return;
+	for (i = 0; i < 256; ++i)
+	{
+		unsigned int c = (unsigned int)i;
+
+		for (j = 0; j < 8; ++j)
+			c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+		plog_crc_table[i] = c;
+	}
+	plog_crc_ready = 1;
+}
+
+
+/**
+ * Add bytes to a CRC-32
+ * @param crc the CRC of the bytes so far, 0 to start
+ * @param buf the bytes
+ * @param len the number of bytes
+ * @return the CRC including the new bytes
+ */
+static unsigned int plogcrc(unsigned int crc, char* buf, int len)
+{
+	crc = ~crc;
+	while (len-- > 0)
+		crc = plog_crc_table[(crc ^ (unsigned char)*buf++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+
+static void plogwriteint(char* ptr, unsigned int value, int len)
+{
+	while (len-- > 0)
+	{
+		*ptr++ = (char)(value & 0xFF);
+		value >>= 8;
+	}
+}
+
+
+static unsigned int plogreadint(char* ptr, int len)
+{
+	unsigned int value = 0;
+
+	while (len-- > 0)
+		value = (value << 8) | (unsigned char)ptr[len];
+	return value;
+}
+
+
+static long plogmillis(void)
+{
+#if defined(WIN32)
+	return GetTickCount();
+#else
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000L + now.tv_usec / 1000;
+#endif
+}
+
+
+/**
+ * Tree callback function for comparing index entries by key
+ */
+static int plogcompare(void* a, void* b, int content)
+{
+	return strcmp(((plog_entry*)a)->key, (content) ? ((plog_entry*)b)->key : (char*)b);
+}
+
+
+/**
+ * Point the index entry for a key at a record, adding the entry if there isn't one
+ * @param h the log
+ * @param key the key
+ * @param offset the offset of the record in the log
+ * @param datalen the length of the data in the record
+ */
+static void plogset(plog_handle* h, char* key, long offset, int datalen)
+{
+	Node* node = TreeFind(h->index, key);
+	plog_entry* e = NULL;
+
+	if (node)
+	{
+		e = (plog_entry*)(node->content);
+		h->live -= PLOG_HEADER_LENGTH + strlen(e->key) + e->datalen;
+	}
+	else
+	{
+		e = malloc(sizeof(plog_entry));
+		e->key = malloc(strlen(key) + 1);
+		strcpy(e->key, key);
+		TreeAdd(h->index, e, sizeof(plog_entry));
+	}
+	e->offset = offset;
+	e->datalen = datalen;
+	h->live += PLOG_HEADER_LENGTH + strlen(key) + datalen;
+}
+
+
+/**
+ * Remove the index entry for a key, if there is one
+ * @param h the log
+ * @param key the key
+ */
+static void plogunset(plog_handle* h, char* key)
+{
+	plog_entry* e = TreeRemoveKey(h->index, key);
+
+	if (e)
+	{
+		h->live -= PLOG_HEADER_LENGTH + strlen(e->key) + e->datalen;
+		free(e->key);
+		free(e);
+	}
+}
+
+
+/**
+ * Remove all the index entries
+ * @param h the log
+ */
+static void plogunsetall(plog_handle* h)
+{
+	Node* node = NULL;
+
+	while ((node = TreeNextElement(h->index, NULL)) != NULL)
+		plogunset(h, ((plog_entry*)(node->content))->key);
+	h->live = 0L;
+}
+
+
+/**
+ * Free an open log's storage, closing the file
+ * @param h the log
+ */
+static void plogfree(plog_handle* h)
+{
+	if (h->fp)
+		fclose(h->fp);
+	if (h->index)
+	{
+		plogunsetall(h);
+		TreeFree(h->index);
+	}
+	free(h->filename);
+	free(h);
+}
+
+
+/**
+ * Flush the log to the storage device, if enough records have been appended since it
+ * last was or enough time has passed
+ * @param h the log
+ * @param force flush it whatever the options say, if there is anything to flush
+ * @return 0 if success, #MQTTCLIENT_PERSISTENCE_ERROR otherwise.
+ */
+static int plogsync(plog_handle* h, int force)
+{
+	long now = 0L;
+	int rc = 0;
+
+	if (h->unsynced == 0)
+		goto exit;
+	if (force || (h->opts.syncRecords > 0 && h->unsynced >= h->opts.syncRecords) ||
+		(h->opts.syncInterval > 0 && (now = plogmillis()) - h->lastsync >= h->opts.syncInterval))
+	{
+		if (fsync(fileno(h->fp)) != 0)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		h->unsynced = 0;
+		h->lastsync = (now) ? now : plogmillis();
+	}
+exit:
+	return rc;
+}
+
+
+/**
+ * Append a record to the log.  If it can't all be written, the log is cut back to where
+ * it was so that the next record doesn't follow a damaged one.
+ * @param h the log
+ * @param type the record type
+ * @param key the key
+ * @param bufcount the number of buffers of data
+ * @param buffers the buffers
+ * @param buflens the length of the data in each buffer
+ * @return 0 if success, #MQTTCLIENT_PERSISTENCE_ERROR otherwise.
+ */
+static int plogappend(plog_handle* h, char type, char* key, int bufcount, char* buffers[], int buflens[])
+{
+	char header[PLOG_HEADER_LENGTH];
+	int keylen = strlen(key);
+	int datalen = 0;
+	unsigned int crc;
+	int i, rc = 0;
+
+	FUNC_ENTRY;
+	for (i = 0; i < bufcount; ++i)
+		datalen += buflens[i];
+	header[4] = type;
+	header[5] = 0;
+	plogwriteint(&header[6], keylen, 2);
+	plogwriteint(&header[8], datalen, 4);
+	crc = plogcrc(0, &header[4], PLOG_HEADER_LENGTH - 4);
+	crc = plogcrc(crc, key, keylen);
+	for (i = 0; i < bufcount; ++i)
+		crc = plogcrc(crc, buffers[i], buflens[i]);
+	plogwriteint(header, crc, 4);
+
+	if (fseek(h->fp, 0L, SEEK_END) != 0 || fwrite(header, 1, PLOG_HEADER_LENGTH, h->fp) != PLOG_HEADER_LENGTH ||
+		fwrite(key, 1, keylen, h->fp) != keylen)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	for (i = 0; rc == 0 && i < bufcount; ++i)
+	{
+		if (fwrite(buffers[i], 1, buflens[i], h->fp) != buflens[i])
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+	if (rc == 0 && fflush(h->fp) != 0)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+
+	if (rc != 0)
+	{
+		Log(LOG_ERROR, -1, "Error %d appending to persistence log %s", errno, h->filename);
+		fflush(h->fp);
+		clearerr(h->fp);
+		if (ftruncate(fileno(h->fp), h->size) != 0)
+			Log(LOG_SEVERE, -1, "Error %d truncating persistence log %s", errno, h->filename);
+	}
+	else
+	{
+		h->size += PLOG_HEADER_LENGTH + keylen + datalen;
+		++(h->unsynced);
+		rc = plogsync(h, 0);
+	}
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ * Copy the live records to a new log file, which then replaces the old one.  If anything
+ * goes wrong the old log stays as it was.
+ * @param h the log
+ * @return 0 if success, #MQTTCLIENT_PERSISTENCE_ERROR otherwise.
+ */
+static int plogcompact(plog_handle* h)
+{
+	char* tmpname = NULL;
+	FILE* tmp = NULL;
+	Node* node = NULL;
+	char* buf = NULL;
+	int buflen = 0;
+	long offset = 0L;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	tmpname = malloc(strlen(h->filename) + 2);
+	sprintf(tmpname, "%s~", h->filename);
+	if ((tmp = fopen(tmpname, "wb")) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	while (rc == 0 && (node = TreeNextElement(h->index, node)) != NULL)
+	{
+		plog_entry* e = (plog_entry*)(node->content);
+		int len = PLOG_HEADER_LENGTH + strlen(e->key) + e->datalen;
+
+		if (len > buflen)
+		{
+			if (buf)
+				free(buf);
+			if ((buf = malloc(len)) == NULL)
+			{
+				rc = MQTTCLIENT_PERSISTENCE_ERROR;
+				break;
+			}
+			buflen = len;
+		}
+		if (fseek(h->fp, e->offset, SEEK_SET) != 0 || fread(buf, 1, len, h->fp) != len ||
+			fwrite(buf, 1, len, tmp) != len)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		e->newoffset = offset;
+		offset += len;
+	}
+	if (fflush(tmp) != 0 || fsync(fileno(tmp)) != 0)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	if (fclose(tmp) != 0)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+
+	if (rc == 0)
+	{
+		FILE* fp = h->fp;
+
+#if defined(WIN32)
+		fclose(fp);
+		fp = NULL;
+		remove(h->filename); /* rename won't replace a file */
+#endif
+		if (rename(tmpname, h->filename) != 0)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		else
+		{
+			if (fp)
+				fclose(fp);
+			h->fp = fopen(h->filename, "a+b");
+			node = NULL;
+			while ((node = TreeNextElement(h->index, node)) != NULL)
+				((plog_entry*)(node->content))->offset = ((plog_entry*)(node->content))->newoffset;
+			Log(TRACE_MINIMUM, -1, "Persistence log %s compacted from %ld to %ld bytes", h->filename, h->size, offset);
+			h->size = h->live = offset;
+			h->unsynced = 0;
+			if (h->fp == NULL)
+				rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		}
+	}
+	if (rc != 0)
+	{
+		Log(LOG_ERROR, -1, "Error %d compacting persistence log %s", errno, h->filename);
+		remove(tmpname);
+	}
+
+exit:
+	if (buf)
+		free(buf);
+	free(tmpname);
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ * Compact the log if it is big enough and at least half dead.  A failure to compact is
+ * not a failure of the operation that led to it, so is only logged.
+ * @param h the log
+ */
+static void plogcheckcompact(plog_handle* h)
+{
+	if (h->size > h->opts.compactSize && h->live * 2 <= h->size)
+		plogcompact(h);
+}
+
+
+/**
+ * Read the log from the start to rebuild the index, and cut off any damaged tail
+ * @param h the log, with an empty index
+ * @return 0 if success, #MQTTCLIENT_PERSISTENCE_ERROR otherwise.
+ */
+static int plogreplay(plog_handle* h)
+{
+	char header[PLOG_HEADER_LENGTH];
+	char* body = NULL;
+	int bodylen = 0;
+	long offset = 0L;
+	long filesize = 0L;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (fseek(h->fp, 0L, SEEK_END) != 0 || (filesize = ftell(h->fp)) < 0 || fseek(h->fp, 0L, SEEK_SET) != 0)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	while (fread(header, 1, PLOG_HEADER_LENGTH, h->fp) == PLOG_HEADER_LENGTH)
+	{
+		int keylen = plogreadint(&header[6], 2);
+		int datalen = plogreadint(&header[8], 4);
+		int len = keylen + datalen;
+
+		if (keylen == 0 || datalen < 0 || len < 0 || offset + PLOG_HEADER_LENGTH + len > filesize)
+			break; /* a damaged header, or a record cut short: the end of the log */
+		if (len >= bodylen)
+		{
+			if (body)
+				free(body);
+			if ((body = malloc(len + 1)) == NULL)
+			{
+				rc = MQTTCLIENT_PERSISTENCE_ERROR;
+				goto exit;
+			}
+			bodylen = len + 1;
+		}
+		if (fread(body, 1, len, h->fp) != len ||
+			plogcrc(plogcrc(0, &header[4], PLOG_HEADER_LENGTH - 4), body, len) != plogreadint(header, 4))
+			break;
+
+		body[keylen] = '\0';
+		if (header[4] == PLOG_PUT)
+			plogset(h, body, offset, datalen);
+		else if (header[4] == PLOG_REMOVE)
+			plogunset(h, body);
+		else
+			break;
+		offset += PLOG_HEADER_LENGTH + len;
+	}
+	h->size = offset;
+
+	if (filesize != offset)
+	{
+		Log(LOG_ERROR, -1, "Persistence log %s is damaged after %ld bytes of %ld, truncating it",
+			h->filename, offset, filesize);
+		if (ftruncate(fileno(h->fp), offset) != 0)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+	Log(TRACE_MINIMUM, -1, "%d keys in persistence log %s, %ld of %ld bytes live", h->index->count,
+		h->filename, h->live, h->size);
+exit:
+	if (body)
+		free(body);
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ * Make a copy of the options for log persistence, to be the context of the
+ * ::MQTTClient_persistence structure.
+ * @param pcontext a pointer to a ::MQTTClient_logPersistenceOptions structure, or NULL
+ * for the defaults
+ * @return the copy, or NULL if the options are not valid
+ */
+void* plogoptions(void* pcontext)
+{
+	MQTTClient_logPersistenceOptions defaults = MQTTClient_logPersistenceOptions_initializer;
+	MQTTClient_logPersistenceOptions* from = (pcontext) ? pcontext : &defaults;
+	MQTTClient_logPersistenceOptions* opts = NULL;
+	char* dir = (from->directory) ? from->directory : ".";
+
+	FUNC_ENTRY;
+	if (strncmp(from->struct_id, "MQLP", 4) != 0 || from->struct_version != 0 ||
+		from->syncRecords < 0 || from->syncInterval < 0 || from->compactSize < 0)
+		goto exit;
+	if ((opts = malloc(sizeof(MQTTClient_logPersistenceOptions))) == NULL)
+		goto exit;
+	*opts = *from;
+	opts->directory = malloc(strlen(dir) + 1);
+	strcpy(opts->directory, dir);
+exit:
+	FUNC_EXIT;
+	return opts;
+}
+
+
+/**
+ * Free a copy of the options made by plogoptions()
+ * @param context the copy
+ */
+void plogfreeoptions(void* context)
+{
+	MQTTClient_logPersistenceOptions* opts = context;
+
+	free(opts->directory);
+	free(opts);
+}
+
+
+/** Open the log for the client, creating it if need be, and read it to build the index.
+ *  See ::Persistence_open
+ */
+int plogopen(void** handle, char* clientID, char* serverURI, void* context)
+{
+	MQTTClient_logPersistenceOptions* opts = context;
+	plog_handle* h = NULL;
+	char* ptr = NULL;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	*handle = NULL;
+	plogcrcinit();
+	if ((rc = pstmkdir(opts->directory)) != 0)
+		goto exit;
+
+	h = malloc(sizeof(plog_handle));
+	memset(h, '\0', sizeof(plog_handle));
+	h->opts = *opts;
+	/* consider '/' + '-' + '\0'; serverURI=address:port, but ":" is not allowed in Windows file names */
+	h->filename = malloc(strlen(opts->directory) + strlen(clientID) + strlen(serverURI) +
+		strlen(LOG_FILENAME_EXTENSION) + 3);
+	sprintf(h->filename, "%s/%s-", opts->directory, clientID);
+	for (ptr = &h->filename[strlen(h->filename)]; *serverURI; ++serverURI)
+		*ptr++ = (*serverURI == ':' || *serverURI == '/' || *serverURI == '\\') ? '-' : *serverURI;
+	strcpy(ptr, LOG_FILENAME_EXTENSION);
+	h->index = TreeInitialize(plogcompare);
+
+	if ((h->fp = fopen(h->filename, "a+b")) == NULL || plogreplay(h) != 0)
+	{
+		Log(LOG_ERROR, -1, "Error %d opening persistence log %s", errno, h->filename);
+		plogfree(h);
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	h->lastsync = plogmillis();
+	plogcheckcompact(h);
+	*handle = h;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Flush and close the log, deleting it if nothing in it is live.
+ *  See ::Persistence_close
+ */
+int plogclose(void* handle)
+{
+	plog_handle* h = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || h->fp == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	rc = plogsync(h, 1);
+	if (h->index->count == 0)
+	{
+		fclose(h->fp);
+		h->fp = NULL;
+		if (remove(h->filename) != 0 && errno != ENOENT)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+	plogfree(h);
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Append the data for a key to the log.
+ *  See ::Persistence_put
+ */
+int plogput(void* handle, char* key, int bufcount, char* buffers[], int buflens[])
+{
+	plog_handle* h = handle;
+	long offset = 0L;
+	int i, datalen = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || h->fp == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	offset = h->size;
+	for (i = 0; i < bufcount; ++i)
+		datalen += buflens[i];
+	if ((rc = plogappend(h, PLOG_PUT, key, bufcount, buffers, buflens)) == 0)
+	{
+		plogset(h, key, offset, datalen);
+		plogcheckcompact(h);
+	}
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Read the data for a key from the log.
+ *  See ::Persistence_get
+ */
+int plogget(void* handle, char* key, char** buffer, int* buflen)
+{
+	plog_handle* h = handle;
+	plog_entry* e = NULL;
+	Node* node = NULL;
+	char* buf = NULL;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || h->fp == NULL || (node = TreeFind(h->index, key)) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	e = (plog_entry*)(node->content);
+	buf = malloc((e->datalen > 0) ? e->datalen : 1);
+	if (fseek(h->fp, e->offset + PLOG_HEADER_LENGTH + strlen(e->key), SEEK_SET) != 0 ||
+		fread(buf, 1, e->datalen, h->fp) != e->datalen)
+	{
+		free(buf);
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	*buffer = buf;
+	*buflen = e->datalen;
+	/* the caller must free buf */
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Record in the log that a key has been removed.
+ *  See ::Persistence_remove
+ */
+int plogremove(void* handle, char* key)
+{
+	plog_handle* h = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || h->fp == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	if (TreeFind(h->index, key) == NULL)
+		goto exit; /* nothing to remove */
+	if ((rc = plogappend(h, PLOG_REMOVE, key, 0, NULL, NULL)) == 0)
+	{
+		plogunset(h, key);
+		plogcheckcompact(h);
+	}
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Returns the live keys in the log, from the index.
+ *  See ::Persistence_keys
+ */
+int plogkeys(void* handle, char*** keys, int* nkeys)
+{
+	plog_handle* h = handle;
+	char** fkeys = NULL;
+	Node* node = NULL;
+	int i = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	if (h->index->count > 0)
+		fkeys = (char**)malloc(h->index->count * sizeof(char*));
+	while ((node = TreeNextElement(h->index, node)) != NULL)
+	{
+		char* key = ((plog_entry*)(node->content))->key;
+
+		fkeys[i] = malloc(strlen(key) + 1);
+		strcpy(fkeys[i++], key);
+	}
+	*nkeys = i;
+	*keys = fkeys;
+	/* the caller must free keys */
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Empty the log.
+ *  See ::Persistence_clear
+ */
+int plogclear(void* handle)
+{
+	plog_handle* h = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || h->fp == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	fflush(h->fp);
+	if (ftruncate(fileno(h->fp), 0L) != 0)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	plogunsetall(h);
+	h->size = 0L;
+	h->unsynced = 1; /* make sure the truncation is flushed too */
+	rc = plogsync(h, 1);
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/** Returns whether the log holds data for a key.
+ *  See ::Persistence_containskey
+ */
+int plogcontainskey(void* handle, char* key)
+{
+	plog_handle* h = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (h == NULL || TreeFind(h->index, key) == NULL)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+#endif /* NO_PERSISTENCE */
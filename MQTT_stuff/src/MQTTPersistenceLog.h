@@ -0,0 +1,37 @@
+/*******************************************************************************
+ * Copyright (c) 2009, 2013 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution. 
+ *
+ * The Eclipse Public License is available at 
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at 
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#if !defined(MQTTPERSISTENCELOG_H)
+#define MQTTPERSISTENCELOG_H
+
+#include "MQTTClientPersistence.h"
+
+/** Extension of the log file name */
+#define LOG_FILENAME_EXTENSION ".log"
+
+/* prototypes of the functions for the log file persistence */
+void* plogoptions(void* pcontext);
+void plogfreeoptions(void* context);
+int plogopen(void** handle, char* clientID, char* serverURI, void* context);
+int plogclose(void* handle);
+int plogput(void* handle, char* key, int bufcount, char* buffers[], int buflens[]);
+int plogget(void* handle, char* key, char** buffer, int* buflen);
+int plogremove(void* handle, char* key);
+int plogkeys(void* handle, char*** keys, int* nkeys);
+int plogclear(void* handle);
+int plogcontainskey(void* handle, char* key);
+
+#endif
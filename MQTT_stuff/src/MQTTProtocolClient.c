@@ -58,6 +58,131 @@ int messageIDCompare(void* a, void* b)
 }
 
 
+#define MSGID_PAGE_SIZE 256 /**< list elements in each page of a msgid_index */
+
+/**
+ * The messages in a client's outboundMsgs list by message id.  A bit is set for each id in
+ * use, so that a free one can be found a word at a time, and the list elements are kept in
+ * pages allocated as they are first needed, ids being assigned in sequence.
+ */
+struct msgid_index
+{
+	unsigned int used[(MAX_MSG_ID + 32) / 32];
+	ListElement** pages[(MAX_MSG_ID + MSGID_PAGE_SIZE) / MSGID_PAGE_SIZE];
+};
+
+
+/**
+ * Get the message id index for a client, creating it if need be
+ * @param client a client structure
+ * @return the index, or NULL if there is no memory for it
+ */
+static struct msgid_index* MQTTProtocol_getIndex(Clients* client)
+{
+	if (client->outboundIndex == NULL && (client->outboundIndex = malloc(sizeof(struct msgid_index))) != NULL)
+		memset(client->outboundIndex, '\0', sizeof(struct msgid_index));
+	return client->outboundIndex;
+}
+
+
+/**
+ * Free the message id index for a client
+ * @param client a client structure
+ */
+static void MQTTProtocol_freeIndex(Clients* client)
+{
+	int i;
+
+	if (client->outboundIndex == NULL)
+		return;
+	for (i = 0; i < sizeof(client->outboundIndex->pages) / sizeof(client->outboundIndex->pages[0]); ++i)
+	{
+		if (client->outboundIndex->pages[i])
+			free(client->outboundIndex->pages[i]);
+	}
+	free(client->outboundIndex);
+	client->outboundIndex = NULL;
+}
+
+
+/**
+ * Record where the message with an id is in outboundMsgs
+ * @param client a client structure
+ * @param msgid the message id
+ * @param e the list element holding the message, or NULL if the id is now free
+ */
+static void MQTTProtocol_setOutbound(Clients* client, int msgid, ListElement* e)
+{
+	struct msgid_index* index = MQTTProtocol_getIndex(client);
+	ListElement** page = NULL;
+
+	if (index == NULL || msgid <= 0 || msgid > MAX_MSG_ID)
+		return;
+	if ((page = index->pages[msgid / MSGID_PAGE_SIZE]) == NULL)
+	{
+		if (e == NULL || (page = malloc(MSGID_PAGE_SIZE * sizeof(ListElement*))) == NULL)
+			return;
+		memset(page, '\0', MSGID_PAGE_SIZE * sizeof(ListElement*));
+		index->pages[msgid / MSGID_PAGE_SIZE] = page;
+	}
+	page[msgid % MSGID_PAGE_SIZE] = e;
+	if (e)
+		index->used[msgid / 32] |= 1U << (msgid % 32);
+	else
+		index->used[msgid / 32] &= ~(1U << (msgid % 32));
+}
+
+
+/**
+ * Find a message in a client's outboundMsgs list by message id.  The message's element is made
+ * the current one in the list, so that removing it does not need a search either.
+ * @param client a client structure
+ * @param msgid the message id
+ * @return the message, or NULL if there is no message with that id
+ */
+Messages* MQTTProtocol_findOutbound(Clients* client, int msgid)
+{
+	ListElement* e = NULL;
+
+	if (client->outboundIndex && msgid > 0 && msgid <= MAX_MSG_ID && client->outboundIndex->pages[msgid / MSGID_PAGE_SIZE])
+		e = client->outboundIndex->pages[msgid / MSGID_PAGE_SIZE][msgid % MSGID_PAGE_SIZE];
+	if (e == NULL)
+		return NULL;
+	client->outboundMsgs->current = e;
+	return (Messages*)(e->content);
+}
+
+
+/**
+ * Remove a message from a client's outboundMsgs list, freeing its message id
+ * @param client a client structure
+ * @param m the message
+ */
+static void MQTTProtocol_removeOutbound(Clients* client, Messages* m)
+{
+	MQTTProtocol_findOutbound(client, m->msgid);
+	MQTTProtocol_setOutbound(client, m->msgid, NULL);
+	ListRemove(client->outboundMsgs, m);
+}
+
+
+/**
+ * Rebuild the message id index for a client from its outboundMsgs list, after the list has
+ * been changed wholesale: emptied, or restored from persistence
+ * @param client a client structure
+ */
+void MQTTProtocol_indexOutbound(Clients* client)
+{
+	ListElement* current = NULL;
+
+	FUNC_ENTRY;
+	MQTTProtocol_freeIndex(client);
+	while (ListNextElement(client->outboundMsgs, &current))
+		MQTTProtocol_setOutbound(client, ((Messages*)(current->content))->msgid, current);
+	FUNC_EXIT;
+}
+
+
 /**
  * Assign a new message id for a client.  Make sure it isn't already being used and does
  * not exceed the maximum.
@@ -66,19 +191,26 @@ int messageIDCompare(void* a, void* b)
  */
 int MQTTProtocol_assignMsgId(Clients* client)
 {
-	int start_msgid = client->msgID;
-	int msgid = start_msgid;
+	struct msgid_index* index = MQTTProtocol_getIndex(client);
+	int msgid = client->msgID;
+	int tried = 1;
 
 	FUNC_ENTRY;
-	msgid = (msgid == MAX_MSG_ID) ? 1 : msgid + 1;
-	while (ListFindItem(client->outboundMsgs, &msgid, messageIDCompare) != NULL)
+	msgid = (msgid >= MAX_MSG_ID) ? 1 : msgid + 1;
+	while (index == NULL || (index->used[msgid / 32] & (1U << (msgid % 32))))
 	{
-		msgid = (msgid == MAX_MSG_ID) ? 1 : msgid + 1;
-		if (msgid == start_msgid) 
+		if (index && index->used[msgid / 32] == ~0U)
+		{	/* skip the rest of a word with every id in use */
+			tried += 31 - msgid % 32;
+			msgid |= 31;
+		}
+		if (index == NULL || tried >= MAX_MSG_ID)
 		{ /* we've tried them all - none free */
 			msgid = 0;
 			break;
 		}
+		msgid = (msgid >= MAX_MSG_ID) ? 1 : msgid + 1;
+		++tried;
 	}
 	if (msgid != 0)
 		client->msgID = msgid;
@@ -148,6 +280,7 @@ int MQTTProtocol_startPublish(Clients* pubclient, Publish* publish, int qos, int
 		p.msgId = publish->msgId = MQTTProtocol_assignMsgId(pubclient);
 		*mm = MQTTProtocol_createMessage(publish, mm, qos, retained);
 		ListAppend(pubclient->outboundMsgs, *mm, (*mm)->len);
+		MQTTProtocol_setOutbound(pubclient, (*mm)->msgid, pubclient->outboundMsgs->last);
 		/* we change these pointers to the saved message location just in case the packet could not be written
 		entirely; the socket buffer will use these locations to finish writing the packet */
 		p.payload = (*mm)->publish->payload;
@@ -169,7 +302,7 @@ int MQTTProtocol_startPublish(Clients* pubclient, Publish* publish, int qos, int
  */
 Messages* MQTTProtocol_createMessage(Publish* publish, Messages **mm, int qos, int retained)
 {
-	Messages* m = malloc(sizeof(Messages));
+	Messages* m = pool_malloc(POOL_MESSAGE, sizeof(Messages));
 
 	FUNC_ENTRY;
 	m->len = sizeof(Messages);
@@ -204,7 +337,7 @@ Messages* MQTTProtocol_createMessage(Publish* publish, Messages **mm, int qos, i
  */
 Publications* MQTTProtocol_storePublication(Publish* publish, int* len)
 {
-	Publications* p = malloc(sizeof(Publications));
+	Publications* p = pool_malloc(POOL_PUBLICATION, sizeof(Publications));
 
 	FUNC_ENTRY;
 	p->refcount = 1;
@@ -214,15 +347,20 @@ Publications* MQTTProtocol_storePublication(Publish* publish, int* len)
 		p->topic = publish->topic;
 	else
 	{
-		p->topic = malloc(*len);
+		p->topic = pool_malloc(POOL_BUFFER, *len);
 		strcpy(p->topic, publish->topic);
 	}
 	*len += sizeof(Publications);
 
 	p->topiclen = publish->topiclen;
 	p->payloadlen = publish->payloadlen;
-	p->payload = malloc(publish->payloadlen);
-	memcpy(p->payload, publish->payload, p->payloadlen);
+	if (Heap_borrowBuffer(publish->payload, publish->payloadlen))
+		p->payload = publish->payload; /* an application buffer, which we hold a reference to instead */
+	else
+	{
+		p->payload = pool_malloc(POOL_BUFFER, publish->payloadlen);
+		memcpy(p->payload, publish->payload, p->payloadlen);
+	}
 	*len += publish->payloadlen;
 
 	ListAppend(&(state.publications), p, *len);
@@ -312,6 +450,7 @@ int MQTTProtocol_handlePubacks(void* pack, int sock)
 {
 	Puback* puback = (Puback*)pack;
 	Clients* client = NULL;
+	Messages* m = NULL;
 	int rc = TCPSOCKET_COMPLETE;
 
 	FUNC_ENTRY;
@@ -319,11 +458,10 @@ int MQTTProtocol_handlePubacks(void* pack, int sock)
 	Log(LOG_PROTOCOL, 14, NULL, sock, client->clientID, puback->msgId);
 
 	/* look for the message by message id in the records of outbound messages for this client */
-	if (ListFindItem(client->outboundMsgs, &(puback->msgId), messageIDCompare) == NULL)
+	if ((m = MQTTProtocol_findOutbound(client, puback->msgId)) == NULL)
 		Log(TRACE_MIN, 3, NULL, "PUBACK", client->clientID, puback->msgId);
 	else
 	{
-		Messages* m = (Messages*)(client->outboundMsgs->current->content);
 		if (m->qos != 1)
 			Log(TRACE_MIN, 4, NULL, "PUBACK", client->clientID, puback->msgId, m->qos);
 		else
@@ -333,7 +471,7 @@ int MQTTProtocol_handlePubacks(void* pack, int sock)
 				rc = MQTTPersistence_remove(client, PERSISTENCE_PUBLISH_SENT, m->qos, puback->msgId);
 			#endif
 			MQTTProtocol_removePublication(m->publish);
-			ListRemove(client->outboundMsgs, m);
+			MQTTProtocol_removeOutbound(client, m);
 		}
 	}
 	free(pack);
@@ -352,6 +490,7 @@ int MQTTProtocol_handlePubrecs(void* pack, int sock)
 {
 	Pubrec* pubrec = (Pubrec*)pack;
 	Clients* client = NULL;
+	Messages* m = NULL;
 	int rc = TCPSOCKET_COMPLETE;
 
 	FUNC_ENTRY;
@@ -359,15 +498,13 @@ int MQTTProtocol_handlePubrecs(void* pack, int sock)
 	Log(LOG_PROTOCOL, 15, NULL, sock, client->clientID, pubrec->msgId);
 
 	/* look for the message by message id in the records of outbound messages for this client */
-	client->outboundMsgs->current = NULL;
-	if (ListFindItem(client->outboundMsgs, &(pubrec->msgId), messageIDCompare) == NULL)
+	if ((m = MQTTProtocol_findOutbound(client, pubrec->msgId)) == NULL)
 	{
 		if (pubrec->header.bits.dup == 0)
 			Log(TRACE_MIN, 3, NULL, "PUBREC", client->clientID, pubrec->msgId);
 	}
 	else
 	{
-		Messages* m = (Messages*)(client->outboundMsgs->current->content);
 		if (m->qos != 2)
 		{
 			if (pubrec->header.bits.dup == 0)
@@ -461,6 +598,7 @@ int MQTTProtocol_handlePubcomps(void* pack, int sock)
 {
 	Pubcomp* pubcomp = (Pubcomp*)pack;
 	Clients* client = NULL;
+	Messages* m = NULL;
 	int rc = TCPSOCKET_COMPLETE;
 
 	FUNC_ENTRY;
@@ -468,14 +606,13 @@ int MQTTProtocol_handlePubcomps(void* pack, int sock)
 	Log(LOG_PROTOCOL, 19, NULL, sock, client->clientID, pubcomp->msgId);
 
 	/* look for the message by message id in the records of outbound messages for this client */
-	if (ListFindItem(client->outboundMsgs, &(pubcomp->msgId), messageIDCompare) == NULL)
+	if ((m = MQTTProtocol_findOutbound(client, pubcomp->msgId)) == NULL)
 	{
 		if (pubcomp->header.bits.dup == 0)
 			Log(TRACE_MIN, 3, NULL, "PUBCOMP", client->clientID, pubcomp->msgId);
 	}
 	else
 	{
-		Messages* m = (Messages*)(client->outboundMsgs->current->content);
 		if (m->qos != 2)
 			Log(TRACE_MIN, 4, NULL, "PUBCOMP", client->clientID, pubcomp->msgId, m->qos);
 		else
@@ -489,7 +626,7 @@ int MQTTProtocol_handlePubcomps(void* pack, int sock)
 					rc = MQTTPersistence_remove(client, PERSISTENCE_PUBLISH_SENT, m->qos, pubcomp->msgId);
 				#endif
 				MQTTProtocol_removePublication(m->publish);
-				ListRemove(client->outboundMsgs, m);
+				MQTTProtocol_removeOutbound(client, m);
 				(++state.msgs_sent);
 			}
 		}
@@ -653,6 +790,7 @@ void MQTTProtocol_freeClient(Clients* client)
 	FUNC_ENTRY;
 	/* free up pending message lists here, and any other allocated data */
 	MQTTProtocol_freeMessageList(client->outboundMsgs);
+	MQTTProtocol_freeIndex(client);
 	MQTTProtocol_freeMessageList(client->inboundMsgs);
 	ListFree(client->messageQueue);
 	free(client->clientID);
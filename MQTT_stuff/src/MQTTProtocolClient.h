@@ -33,6 +33,8 @@ Messages* MQTTProtocol_createMessage(Publish* publish, Messages** mm, int qos, i
 Publications* MQTTProtocol_storePublication(Publish* publish, int* len);
 int messageIDCompare(void* a, void* b);
 int MQTTProtocol_assignMsgId(Clients* client);
+Messages* MQTTProtocol_findOutbound(Clients* client, int msgid);
+void MQTTProtocol_indexOutbound(Clients* client);
 void MQTTProtocol_removePublication(Publications* p);
 
 int MQTTProtocol_handlePublishes(void* pack, int sock);
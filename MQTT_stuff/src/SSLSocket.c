@@ -740,7 +740,7 @@ int SSLSocket_putdatas(SSL* ssl, int socket, char* buf0, int buf0len, int count,
 			SocketBuffer_pendingWrite(socket, ssl, 1, &iovec, iovec.iov_len, 0);
 			*sockmem = socket;
 			ListAppend(s.write_pending, sockmem, sizeof(int));
-			FD_SET(socket, &(s.pending_wset));
+			Socket_addPendingWrite(socket);
 			rc = TCPSOCKET_INTERRUPTED;
 			iovec.iov_base = NULL; /* don't free it because it hasn't been completely written yet */
 		}
@@ -36,12 +36,35 @@
 #include <string.h>
 #include <signal.h>
 #include <ctype.h>
+#if !defined(WIN32)
+#include <sys/uio.h>
+#endif
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#endif
 
 #include "Heap.h"
 
 int Socket_close_only(int socket);
 int Socket_continueWrites(fd_set* pwset);
 
+#if defined(USE_EPOLL)
+/** socket has had data to read since it was last found empty */
+#define SOCKET_READABLE 0x01
+/** socket has had room to write since a write last fell short */
+#define SOCKET_WRITEABLE 0x02
+/** socket is in the ready ring */
+#define SOCKET_QUEUED 0x04
+
+/** maximum events collected by one epoll_wait call, any more are returned by the next */
+#define MAX_EPOLL_EVENTS 64
+
+int Socket_trackSocket(int socket);
+void Socket_setState(int socket, int flags);
+void Socket_clearState(int socket, int flags);
+#endif
+
 #if defined(WIN32)
 #define iov_len len
 #define iov_base buf
@@ -51,7 +74,24 @@ int Socket_continueWrites(fd_set* pwset);
  * Structure to hold all socket data for the module
  */
 Sockets s;
+#if !defined(USE_EPOLL)
 static fd_set wset;
+#endif
+
+/**
+ * Packets put to a socket between Socket_startBatch and Socket_endBatch, to be written with
+ * one system call.  Only one batch is open at a time, by a caller holding the lock that all
+ * writes are made under.
+ */
+static struct
+{
+	int socket;			/**< the socket being batched, or -1 */
+	int count;			/**< the number of iovecs in use */
+	unsigned long total;	/**< the number of bytes in the batch */
+	int used;			/**< the number of bytes of copy in use */
+	iobuf iovecs[SOCKET_BATCH_IOVECS];
+	char copy[SOCKET_BATCH_IOVECS * SOCKET_BATCH_COPY];	/**< small buffers, which the caller frees straight away */
+} batch = { -1 };
 
 /**
  * Set a socket non-blocking, OS independently
@@ -126,10 +166,31 @@ void Socket_outInitialize()
 	s.connect_pending = ListInitialize();
 	s.write_pending = ListInitialize();
 	s.cur_clientsds = NULL;
+#if defined(USE_EPOLL)
+	{
+		struct rlimit limit;
+
+		if ((s.epfd = epoll_create1(EPOLL_CLOEXEC)) == SOCKET_ERROR)
+			Socket_error("epoll_create1", 0);
+		/* size the state table once for every descriptor the process can ever open, the
+		   hard limit, as the receive thread reads it without a lock and it can't move */
+		s.nsockstate = SOCKET_STATE_MAX;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_max != RLIM_INFINITY &&
+				limit.rlim_max < SOCKET_STATE_MAX)
+			s.nsockstate = (limit.rlim_max > FD_SETSIZE) ? limit.rlim_max : FD_SETSIZE;
+		/* not calloc, which Heap.h does not track */
+		if ((s.sockstate = malloc(s.nsockstate)) != NULL)
+			memset(s.sockstate, '\0', s.nsockstate);
+		s.ready_size = (s.nsockstate < SOCKET_READY_INITIAL) ? s.nsockstate : SOCKET_READY_INITIAL;
+		s.ready = malloc(s.ready_size * sizeof(int));
+		s.ready_first = s.ready_count = s.ready_pass = 0;
+	}
+#else
 	FD_ZERO(&(s.rset));														/* Initialize the descriptor set */
 	FD_ZERO(&(s.pending_wset));
 	s.maxfdp1 = 0;
 	memcpy((void*)&(s.rset_saved), (void*)&(s.rset), sizeof(s.rset_saved));
+#endif
 	FUNC_EXIT;
 }
 
@@ -143,6 +204,15 @@ void Socket_outTerminate()
 	ListFree(s.connect_pending);
 	ListFree(s.write_pending);
 	ListFree(s.clientsds);
+#if defined(USE_EPOLL)
+	if (s.epfd != SOCKET_ERROR)
+		close(s.epfd);
+	free(s.sockstate);
+	free(s.ready);
+	s.sockstate = NULL;
+	s.ready = NULL;
+	s.nsockstate = s.ready_size = 0;
+#endif
 	SocketBuffer_terminate();
 #if defined(WIN32)
 	WSACleanup();
@@ -165,9 +235,28 @@ int Socket_addSocket(int newSd)
 		int* pnewSd = (int*)malloc(sizeof(newSd));
 		*pnewSd = newSd;
 		ListAppend(s.clientsds, pnewSd, sizeof(newSd));
+#if defined(USE_EPOLL)
+		if (Socket_trackSocket(newSd) == SOCKET_ERROR)
+			rc = SOCKET_ERROR;
+		else
+		{
+			struct epoll_event event;
+
+			/* a descriptor number can be reused while a stale entry is still in the ready ring */
+			Socket_clearState(newSd, SOCKET_READABLE | SOCKET_WRITEABLE);
+			memset(&event, '\0', sizeof(event));
+			event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			event.data.fd = newSd;
+			if ((rc = epoll_ctl(s.epfd, EPOLL_CTL_ADD, newSd, &event)) == SOCKET_ERROR)
+				Socket_error("epoll_ctl add", newSd);
+		}
+		if (rc == 0)
+			rc = Socket_setnonblocking(newSd);
+#else
 		FD_SET(newSd, &(s.rset_saved));
 		s.maxfdp1 = max(s.maxfdp1, newSd + 1);
 		rc = Socket_setnonblocking(newSd);
+#endif
 	}
 	else
 		Log(TRACE_MIN, -1, "addSocket: socket %d already in the list", newSd);
@@ -177,6 +266,204 @@ int Socket_addSocket(int newSd)
 }
 
 
+#if defined(USE_EPOLL)
+
+/**
+ * Check there is readiness state for a socket descriptor.  The table is never resized,
+ * so a descriptor beyond it can't be used.
+ * @param socket the socket descriptor
+ * @return completion code
+ */
+int Socket_trackSocket(int socket)
+{
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (s.sockstate == NULL || socket < 0)
+		rc = SOCKET_ERROR;
+	else if (socket >= s.nsockstate)
+	{
+		Log(LOG_ERROR, -1, "Socket %d is beyond the %d descriptors tracked", socket, s.nsockstate);
+		rc = SOCKET_ERROR;
+	}
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ * Set readiness flags for a socket.  The flags are shared by the send and receive
+ * threads, so they are changed atomically.
+ * @param socket the socket
+ * @param flags the flags to set
+ */
+void Socket_setState(int socket, int flags)
+{
+	if (socket >= 0 && socket < s.nsockstate)
+		__sync_fetch_and_or(&s.sockstate[socket], (unsigned char)flags);
+}
+
+
+/**
+ * Clear readiness flags for a socket
+ * @param socket the socket
+ * @param flags the flags to clear
+ */
+void Socket_clearState(int socket, int flags)
+{
+	if (socket >= 0 && socket < s.nsockstate)
+		__sync_fetch_and_and(&s.sockstate[socket], (unsigned char)~flags);
+}
+
+
+/**
+ * The epoll equivalent of isReady(): don't accept work from a client unless it is
+ * accepting work back.  A socket whose TCP connect is pending is ready as soon as it
+ * is writeable.
+ * @param socket the socket to check
+ * @return boolean - is the socket ready to go?
+ */
+int Socket_isReady(int socket)
+{
+	int state = s.sockstate[socket];
+
+	if ((state & SOCKET_WRITEABLE) && ListFindItem(s.connect_pending, &socket, intcompare))
+		return 1;
+	return (state & SOCKET_READABLE) && (state & SOCKET_WRITEABLE) && Socket_noPendingWrites(socket);
+}
+
+
+/**
+ * Add a socket to the tail of the ready ring, unless it is already there.  The ring
+ * is only used by the thread calling Socket_getReadySocket.
+ * @param socket the socket to add
+ */
+void Socket_queueReady(int socket)
+{
+	if (s.ready_count == s.ready_size)
+	{	/* a socket is only in the ring once, so it never needs more than the state table */
+		int newsize = (s.ready_size * 2 < s.nsockstate) ? s.ready_size * 2 : s.nsockstate;
+		int* newready = malloc(newsize * sizeof(int));
+		int i;
+
+		if (newready == NULL)
+			return;
+		for (i = 0; i < s.ready_count; ++i)
+			newready[i] = s.ready[(s.ready_first + i) % s.ready_size];
+		free(s.ready);
+		s.ready = newready;
+		s.ready_size = newsize;
+		s.ready_first = 0;
+	}
+
+	if ((s.sockstate[socket] & SOCKET_QUEUED) == 0)
+	{
+		Socket_setState(socket, SOCKET_QUEUED);
+		s.ready[(s.ready_first + s.ready_count) % s.ready_size] = socket;
+		++(s.ready_count);
+	}
+}
+
+
+/**
+ *  Returns the next socket ready for communications as indicated by epoll.
+ *
+ *  Sockets are registered edge triggered, so a socket stays readable until a read on
+ *  it would block, and writeable until a write falls short.  Ready sockets are kept in
+ *  a ring and handed out round robin, one pass over the ring between epoll_wait calls,
+ *  the same order of service the select version gives.
+ *  @param more_work flag to indicate more work is waiting, and thus a timeout value of 0 should
+ *  be used for the wait
+ *  @param tp the timeout to be used for the wait, unless overridden
+ *  @return the socket next ready, or 0 if none is ready
+ */
+int Socket_getReadySocket(int more_work, struct timeval *tp)
+{
+	int rc = 0, waited = 0;
+
+	FUNC_ENTRY;
+	if (s.clientsds->count == 0)
+		goto exit;
+
+	while (rc == 0)
+	{
+		if (s.ready_pass == 0)
+		{
+			struct epoll_event events[MAX_EPOLL_EVENTS];
+			int timeout = 1000; /* milliseconds */
+			int i, count;
+
+			if (waited)
+				break;
+
+			/* the ring is only a hint that sockets may still be ready: check without waiting,
+			   and if none of them are, go round once more and wait for real */
+			if (more_work || s.ready_count > 0)
+				timeout = 0;
+			else if (tp)
+				timeout = tp->tv_sec * 1000 + (tp->tv_usec + 999) / 1000;
+			waited = more_work || s.ready_count == 0;
+
+			if ((count = epoll_wait(s.epfd, events, MAX_EPOLL_EVENTS, timeout)) == SOCKET_ERROR)
+			{
+				Socket_error("epoll_wait", 0);
+				goto exit;
+			}
+			Log(TRACE_MAX, -1, "Return code %d from epoll_wait", count);
+
+			for (i = 0; i < count; ++i)
+			{
+				int flags = 0;
+
+				/* as with select, a socket in error is reported readable and writeable so that
+				   the next read finds the error */
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+					flags |= SOCKET_READABLE;
+				if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+					flags |= SOCKET_WRITEABLE;
+				Socket_setState(events[i].data.fd, flags);
+			}
+
+			if (Socket_continueWrites(NULL) == SOCKET_ERROR)
+				goto exit;
+
+			for (i = 0; i < count; ++i)
+				Socket_queueReady(events[i].data.fd);
+
+			s.ready_pass = s.ready_count;
+		}
+
+		while (s.ready_pass > 0)
+		{
+			int socket = s.ready[s.ready_first];
+
+			s.ready_first = (s.ready_first + 1) % s.ready_size;
+			--(s.ready_count);
+			--(s.ready_pass);
+
+			if (!Socket_isReady(socket))
+			{	/* it comes back into the ring with its next edge */
+				Socket_clearState(socket, SOCKET_QUEUED);
+				continue;
+			}
+
+			ListRemoveItem(s.connect_pending, &socket, intcompare);
+
+			/* stays in the ring until a read or write on it would block */
+			s.ready[(s.ready_first + s.ready_count) % s.ready_size] = socket;
+			++(s.ready_count);
+
+			rc = socket;
+			break;
+		}
+	}
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+} /* end getReadySocket */
+
+#else
+
 /**
  * Don't accept work from a client unless it is accepting work back, i.e. its socket is writeable
  * this seems like a reasonable form of flow control, and practically, seems to work.
@@ -192,8 +479,9 @@ int isReady(int socket, fd_set* read_set, fd_set* write_set)
 	FUNC_ENTRY;
 	if  (ListFindItem(s.connect_pending, &socket, intcompare) && FD_ISSET(socket, write_set))
 		ListRemoveItem(s.connect_pending, &socket, intcompare);
-	else
-		rc = FD_ISSET(socket, read_set) && FD_ISSET(socket, write_set) && Socket_noPendingWrites(socket);
+	else /* bytes already read ahead count as readable: select can't see them */
+		rc = (FD_ISSET(socket, read_set) || SocketBuffer_readPending(socket) > 0) &&
+			FD_ISSET(socket, write_set) && Socket_noPendingWrites(socket);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -233,6 +521,13 @@ int Socket_getReadySocket(int more_work, struct timeval *tp)
 	{
 		int rc1;
 		fd_set pwset;
+		ListElement* cur = NULL;
+
+		while (timeout.tv_sec + timeout.tv_usec > 0 && ListNextElement(s.clientsds, &cur))
+		{
+			if (SocketBuffer_readPending(*((int*)(cur->content))) > 0)
+				timeout = zero; /* don't wait for the network with packets already read */
+		}
 
 		memcpy((void*)&(s.rset), (void*)&(s.rset_saved), sizeof(s.rset));
 		memcpy((void*)&(pwset), (void*)&(s.pending_wset), sizeof(pwset));
@@ -283,37 +578,80 @@ exit:
 	return rc;
 } /* end getReadySocket */
 
+#endif
+
 
 /**
- *  Reads one byte from a socket
+ *  Reads as much as is available from a socket into its read ahead buffer, after any
+ *  bytes still to be parsed.
  *  @param socket the socket to read from
- *  @param c the character read, returned
- *  @return completion code
+ *  @param rb the read ahead buffer for the socket
+ *  @return completion code, TCPSOCKET_INTERRUPTED if nothing could be read without blocking
  */
-int Socket_getch(int socket, char* c)
+static int Socket_fill(int socket, read_buffer* rb)
 {
 	int rc = SOCKET_ERROR;
 
 	FUNC_ENTRY;
-	if ((rc = SocketBuffer_getQueuedChar(socket, c)) != SOCKETBUFFER_INTERRUPTED)
-		goto exit;
+	if (rb->index > 0)
+	{
+		memmove(rb->buf, &rb->buf[rb->index], rb->datalen - rb->index);
+		rb->datalen -= rb->index;
+		rb->index = 0;
+	}
 
-	if ((rc = recv(socket, c, (size_t)1, 0)) == SOCKET_ERROR)
+	if ((rc = recv(socket, &rb->buf[rb->datalen], (size_t)(sizeof(rb->buf) - rb->datalen), 0)) == SOCKET_ERROR)
 	{
-		int err = Socket_error("recv - getch", socket);
+		int err = Socket_error("recv - fill", socket);
 		if (err == EWOULDBLOCK || err == EAGAIN)
 		{
 			rc = TCPSOCKET_INTERRUPTED;
-			SocketBuffer_interrupted(socket, 0);
+#if defined(USE_EPOLL)
+			Socket_clearState(socket, SOCKET_READABLE);
+#endif
 		}
 	}
 	else if (rc == 0)
 		rc = SOCKET_ERROR; 	/* The return value from recv is 0 when the peer has performed an orderly shutdown. */
-	else if (rc == 1)
+	else
 	{
-		SocketBuffer_queueChar(socket, *c);
+		rb->datalen += rc;
 		rc = TCPSOCKET_COMPLETE;
 	}
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+/**
+ *  Reads one byte from a socket
+ *  @param socket the socket to read from
+ *  @param c the character read, returned
+ *  @return completion code
+ */
+int Socket_getch(int socket, char* c)
+{
+	int rc = SOCKET_ERROR;
+	read_buffer* rb = NULL;
+
+	FUNC_ENTRY;
+	if ((rc = SocketBuffer_getQueuedChar(socket, c)) != SOCKETBUFFER_INTERRUPTED)
+		goto exit;
+
+	if ((rb = SocketBuffer_getRead(socket)) == NULL)
+	{
+		rc = SOCKET_ERROR;
+		goto exit;
+	}
+	if (rb->index == rb->datalen && (rc = Socket_fill(socket, rb)) != TCPSOCKET_COMPLETE)
+	{
+		if (rc == TCPSOCKET_INTERRUPTED)
+			SocketBuffer_interrupted(socket, 0);
+		goto exit;
+	}
+	*c = rb->buf[(rb->index)++];
+	SocketBuffer_queueChar(socket, *c);
+	rc = TCPSOCKET_COMPLETE;
 exit:
 	FUNC_EXIT_RC(rc);
 	return rc;
@@ -322,7 +660,8 @@ exit:
 
 /**
  *  Attempts to read a number of bytes from a socket, non-blocking. If a previous read did not
- *  finish, then retrieve that data.
+ *  finish, then retrieve that data.  When the read ahead buffer holds all the bytes, they are
+ *  returned where they are, valid until the next read from the socket.
  *  @param socket the socket to read from
  *  @param bytes the number of bytes to read
  *  @param actual_len the actual number of bytes read
@@ -330,8 +669,9 @@ exit:
  */
 char *Socket_getdata(int socket, int bytes, int* actual_len)
 {
-	int rc;
+	int rc = TCPSOCKET_COMPLETE, len;
 	char* buf;
+	read_buffer* rb = NULL;
 
 	FUNC_ENTRY;
 	if (bytes == 0)
@@ -341,8 +681,40 @@ char *Socket_getdata(int socket, int bytes, int* actual_len)
 	}
 
 	buf = SocketBuffer_getQueuedData(socket, bytes, actual_len);
+	if ((rb = SocketBuffer_getRead(socket)) == NULL)
+	{
+		buf = NULL;
+		goto exit;
+	}
 
-	if ((rc = recv(socket, buf + (*actual_len), (size_t)(bytes - (*actual_len)), 0)) == SOCKET_ERROR)
+	len = rb->datalen - rb->index;
+	if (*actual_len == 0 && len < bytes && bytes <= sizeof(rb->buf))
+	{
+		if ((rc = Socket_fill(socket, rb)) == SOCKET_ERROR)
+		{
+			buf = NULL;
+			goto exit;
+		}
+		len = rb->datalen - rb->index;
+	}
+	if (*actual_len == 0 && len >= bytes)
+	{	/* the whole packet is here: parse it in place */
+		buf = &rb->buf[rb->index];
+		rb->index += bytes;
+		*actual_len = bytes;
+		SocketBuffer_complete(socket);
+		goto exit;
+	}
+
+	/* take what has been read already, and read the rest straight into the packet buffer */
+	if (len > bytes - *actual_len)
+		len = bytes - *actual_len;
+	memcpy(buf + (*actual_len), &rb->buf[rb->index], len);
+	rb->index += len;
+	*actual_len += len;
+	if (*actual_len == bytes || rc == TCPSOCKET_INTERRUPTED)
+		; /* nothing more to read, or we already know the socket would block */
+	else if ((rc = recv(socket, buf + (*actual_len), (size_t)(bytes - (*actual_len)), 0)) == SOCKET_ERROR)
 	{
 		rc = Socket_error("recv - getdata", socket);
 		if (rc != EAGAIN && rc != EWOULDBLOCK)
@@ -350,6 +722,9 @@ char *Socket_getdata(int socket, int bytes, int* actual_len)
 			buf = NULL;
 			goto exit;
 		}
+#if defined(USE_EPOLL)
+		Socket_clearState(socket, SOCKET_READABLE);
+#endif
 	}
 	else if (rc == 0) /* rc 0 means the other end closed the socket, albeit "gracefully" */
 	{
@@ -412,16 +787,144 @@ int Socket_writev(int socket, iobuf* iovecs, int count, unsigned long* bytes)
 	{
 		int err = Socket_error("writev - putdatas", socket);
 		if (err == EWOULDBLOCK || err == EAGAIN)
+		{
 			rc = TCPSOCKET_INTERRUPTED;
+#if defined(USE_EPOLL)
+			Socket_clearState(socket, SOCKET_WRITEABLE);
+#endif
+		}
 	}
 	else
+	{
+#if defined(USE_EPOLL)
+		unsigned long total = 0L;
+		int i;
+
+		for (i = 0; i < count; ++i)
+			total += iovecs[i].iov_len;
+		if (rc < total) /* the send buffer is full, wait for the next EPOLLOUT edge */
+			Socket_clearState(socket, SOCKET_WRITEABLE);
+#endif
 		*bytes = rc;
+	}
 #endif
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
 
 
+/**
+ *  Add a buffer to the open batch.  Small buffers are copied, next to the previous copy if
+ *  possible so that they share an iovec; larger ones must stay valid until the batch ends.
+ *  @param buf the buffer
+ *  @param len the length of data in the buffer
+ *  @return completion code, SOCKET_ERROR if the batch is full
+ */
+static int Socket_addToBatch(char* buf, int len)
+{
+	iobuf* last = (batch.count > 0) ? &batch.iovecs[batch.count - 1] : NULL;
+	int rc = TCPSOCKET_COMPLETE;
+
+	if (len == 0)
+		goto exit;
+	if (len <= SOCKET_BATCH_COPY && batch.used + len <= sizeof(batch.copy) &&
+		last && (char*)last->iov_base + last->iov_len == &batch.copy[batch.used])
+		last->iov_len += len;
+	else if (batch.count == SOCKET_BATCH_IOVECS || (len <= SOCKET_BATCH_COPY && batch.used + len > sizeof(batch.copy)))
+	{
+		Log(LOG_SEVERE, -1, "Write batch for socket %d is full", batch.socket);
+		rc = SOCKET_ERROR;
+		goto exit;
+	}
+	else
+	{
+		batch.iovecs[batch.count].iov_base = (len <= SOCKET_BATCH_COPY) ? &batch.copy[batch.used] : buf;
+		batch.iovecs[batch.count++].iov_len = len;
+	}
+	if (len <= SOCKET_BATCH_COPY)
+	{
+		memcpy(&batch.copy[batch.used], buf, len);
+		batch.used += len;
+	}
+	batch.total += len;
+exit:
+	return rc;
+}
+
+
+/**
+ *  Start collecting the packets put to a socket, instead of writing each one as it comes.
+ *  Until Socket_endBatch, Socket_putdatas returns TCPSOCKET_COMPLETE without writing, and
+ *  buffers larger than SOCKET_BATCH_COPY must not be freed.
+ *  @param socket the socket
+ */
+void Socket_startBatch(int socket)
+{
+	FUNC_ENTRY;
+	batch.socket = socket;
+	batch.count = batch.used = 0;
+	batch.total = 0L;
+	FUNC_EXIT;
+}
+
+
+/**
+ *  Write the packets collected since Socket_startBatch in one system call.  If the socket
+ *  only takes part of them, the rest is copied and left as a pending write, so the caller's
+ *  buffers can be freed either way.
+ *  @param socket the socket
+ *  @return completion code, TCPSOCKET_INTERRUPTED if some of the batch is still to be written
+ */
+int Socket_endBatch(int socket)
+{
+	unsigned long bytes = 0L;
+	int rc = TCPSOCKET_COMPLETE;
+
+	FUNC_ENTRY;
+	batch.socket = -1;
+	if (batch.count == 0)
+		goto exit;
+	if ((rc = Socket_writev(socket, batch.iovecs, batch.count, &bytes)) != SOCKET_ERROR)
+	{
+		if (bytes == batch.total)
+			rc = TCPSOCKET_COMPLETE;
+		else
+		{
+			int* sockmem = (int*)malloc(sizeof(int));
+			unsigned long offset = 0L;
+			iobuf rest;
+			int i;
+
+			Log(TRACE_MIN, -1, "Partial batch write: %ld bytes of %ld actually written on socket %d",
+					bytes, batch.total, socket);
+			rest.iov_len = batch.total - bytes;
+			rest.iov_base = malloc(rest.iov_len);
+			for (i = 0; i < batch.count; ++i)
+			{
+				unsigned long len = batch.iovecs[i].iov_len;
+				unsigned long skip = (bytes > 0) ? ((bytes < len) ? bytes : len) : 0L;
+
+				memcpy((char*)rest.iov_base + offset, (char*)batch.iovecs[i].iov_base + skip, len - skip);
+				offset += len - skip;
+				bytes -= skip;
+			}
+#if defined(OPENSSL)
+			SocketBuffer_pendingWrite(socket, NULL, 1, &rest, rest.iov_len, 0);
+#else
+			SocketBuffer_pendingWrite(socket, 1, &rest, rest.iov_len, 0);
+#endif
+			*sockmem = socket;
+			ListAppend(s.write_pending, sockmem, sizeof(int));
+			Socket_addPendingWrite(socket);
+			rc = TCPSOCKET_INTERRUPTED;
+		}
+	}
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 /**
  *  Attempts to write a series of buffers to a socket in *one* system call so that they are
  *  sent as one packet.
@@ -447,6 +950,14 @@ int Socket_putdatas(int socket, char* buf0, int buf0len, int count, char** buffe
 		goto exit;
 	}
 
+	if (socket == batch.socket)
+	{
+		rc = Socket_addToBatch(buf0, buf0len);
+		for (i = 0; i < count && rc == TCPSOCKET_COMPLETE; i++)
+			rc = Socket_addToBatch(buffers[i], buflens[i]);
+		goto exit;
+	}
+
 	for (i = 0; i < count; i++)
 		total += buflens[i];
 
@@ -474,7 +985,7 @@ int Socket_putdatas(int socket, char* buf0, int buf0len, int count, char** buffe
 #endif
 			*sockmem = socket;
 			ListAppend(s.write_pending, sockmem, sizeof(int));
-			FD_SET(socket, &(s.pending_wset));
+			Socket_addPendingWrite(socket);
 			rc = TCPSOCKET_INTERRUPTED;
 		}
 	}
@@ -492,7 +1003,9 @@ exit:
  */
 void Socket_addPendingWrite(int socket)
 {
+#if !defined(USE_EPOLL) /* with epoll every socket is always registered for EPOLLOUT */
 	FD_SET(socket, &(s.pending_wset));
+#endif
 }
 
 
@@ -502,8 +1015,10 @@ void Socket_addPendingWrite(int socket)
  */
 void Socket_clearPendingWrite(int socket)
 {
+#if !defined(USE_EPOLL)
 	if (FD_ISSET(socket, &(s.pending_wset)))
 		FD_CLR(socket, &(s.pending_wset));
+#endif
 }
 
 
@@ -543,10 +1058,18 @@ int Socket_close_only(int socket)
 void Socket_close(int socket)
 {
 	FUNC_ENTRY;
+#if defined(USE_EPOLL)
+	if (epoll_ctl(s.epfd, EPOLL_CTL_DEL, socket, NULL) == SOCKET_ERROR)
+		Socket_error("epoll_ctl del", socket);
+	Socket_close_only(socket);
+	/* a stale entry left in the ready ring is dropped when it comes round */
+	Socket_clearState(socket, SOCKET_READABLE | SOCKET_WRITEABLE);
+#else
 	Socket_close_only(socket);
 	FD_CLR(socket, &(s.rset_saved));
 	if (FD_ISSET(socket, &(s.pending_wset)))
 		FD_CLR(socket, &(s.pending_wset));
+#endif
 	if (s.cur_clientsds != NULL && *(int*)(s.cur_clientsds->content) == socket)
 		s.cur_clientsds = s.cur_clientsds->next;
 	ListRemoveItem(s.connect_pending, &socket, intcompare);
@@ -557,6 +1080,7 @@ void Socket_close(int socket)
 		Log(TRACE_MIN, -1, "Removed socket %d", socket);
 	else
 		Log(TRACE_MIN, -1, "Failed to remove socket %d", socket);
+#if !defined(USE_EPOLL)
 	if (socket + 1 >= s.maxfdp1)
 	{
 		/* now we have to reset s.maxfdp1 */
@@ -568,6 +1092,7 @@ void Socket_close(int socket)
 		++(s.maxfdp1);
 		Log(TRACE_MAX, -1, "Reset max fdp1 to %d", s.maxfdp1);
 	}
+#endif
 	FUNC_EXIT;
 }
 
@@ -741,7 +1266,8 @@ int Socket_continueWrite(int socket)
 		if ((rc = (pw->bytes == pw->total)))
 		{  /* topic and payload buffers are freed elsewhere, when all references to them have been removed */
 			free(pw->iovecs[0].iov_base);
-			free(pw->iovecs[1].iov_base);
+			if (pw->count > 1) /* the rest of a batch is one buffer */
+				free(pw->iovecs[1].iov_base);
 			if (pw->count == 5)
 				free(pw->iovecs[3].iov_base);
 			Log(TRACE_MIN, -1, "ContinueWrite: partial write now complete for socket %d", socket);		
@@ -759,7 +1285,7 @@ exit:
 
 /**
  *  Continue any outstanding writes for a socket set
- *  @param pwset the set of sockets
+ *  @param pwset the set of sockets, unused with epoll where the socket state says which are writeable
  *  @return completion code
  */
 int Socket_continueWrites(fd_set* pwset)
@@ -771,11 +1297,16 @@ int Socket_continueWrites(fd_set* pwset)
 	while (curpending)
 	{
 		int socket = *(int*)(curpending->content);
-		if (FD_ISSET(socket, pwset) && Socket_continueWrite(socket))
+#if defined(USE_EPOLL)
+		int writeable = (s.sockstate[socket] & SOCKET_WRITEABLE);
+#else
+		int writeable = FD_ISSET(socket, pwset);
+#endif
+		if (writeable && Socket_continueWrite(socket))
 		{
 			if (!SocketBuffer_writeComplete(socket))
 				Log(LOG_SEVERE, -1, "Failed to remove pending write from socket buffer list");
-			FD_CLR(socket, &(s.pending_wset));
+			Socket_clearPendingWrite(socket);
 			if (!ListRemove(s.write_pending, curpending->content))
 			{
 				Log(LOG_SEVERE, -1, "Failed to remove pending write from list");
@@ -36,6 +36,9 @@
 #define socklen_t int
 #else
 #define INVALID_SOCKET SOCKET_ERROR
+#if defined(__linux__) && !defined(OPENSSL) && !defined(NO_EPOLL)
+#define USE_EPOLL
+#endif
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <sys/time.h>
@@ -48,6 +51,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #endif
 
 /** socket operation completed successfully */
@@ -60,6 +64,22 @@
 #define TCPSOCKET_INTERRUPTED -22
 #define SSL_FATAL -3
 
+/** the most buffers written by one batch, see Socket_startBatch */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define SOCKET_BATCH_IOVECS IOV_MAX
+#else
+#define SOCKET_BATCH_IOVECS 1024
+#endif
+/** buffers up to this size are copied into a batch, larger ones are written from where they are */
+#define SOCKET_BATCH_COPY 32
+
+#if defined(USE_EPOLL)
+/** the most socket descriptors given readiness state, used when the hard RLIMIT_NOFILE is higher */
+#define SOCKET_STATE_MAX 1048576
+/** initial capacity of the ready ring, it grows as more sockets are ready at once */
+#define SOCKET_READY_INITIAL 64
+#endif
+
 #if !defined(INET6_ADDRSTRLEN)
 #define INET6_ADDRSTRLEN 46 /** only needed for gcc/cygwin on windows */
 #endif
@@ -96,14 +116,27 @@ BE*/
  */
 typedef struct
 {
+#if defined(USE_EPOLL)
+	int epfd; /**< epoll instance all client sockets are registered with, edge triggered */
+	unsigned char* sockstate; /**< readiness flags, indexed by socket descriptor */
+	int nsockstate; /**< number of entries in sockstate */
+	int* ready; /**< ring of sockets that may be ready, each socket at most once */
+	int ready_size; /**< capacity of the ready ring */
+	int ready_first; /**< index of the oldest entry in the ready ring */
+	int ready_count; /**< number of entries in the ready ring */
+	int ready_pass; /**< entries left to hand out before epoll_wait is called again */
+#else
 	fd_set rset, /**< socket read set (see select doc) */
 		rset_saved; /**< saved socket read set */
 	int maxfdp1; /**< max descriptor used +1 (again see select doc) */
+#endif
 	List* clientsds; /**< list of client socket descriptors */
 	ListElement* cur_clientsds; /**< current client socket descriptor (iterator) */
 	List* connect_pending; /**< list of sockets for which a connect is pending */
 	List* write_pending; /**< list of sockets for which a write is pending */
+#if !defined(USE_EPOLL)
 	fd_set pending_wset; /**< socket pending write set for select */
+#endif
 } Sockets;
 
 
@@ -122,6 +155,9 @@ char* Socket_getpeer(int sock);
 void Socket_addPendingWrite(int socket);
 void Socket_clearPendingWrite(int socket);
 
+void Socket_startBatch(int socket);
+int Socket_endBatch(int socket);
+
 typedef void Socket_writeComplete(int socket);
 void Socket_setWriteCompleteCallback(Socket_writeComplete*);
 
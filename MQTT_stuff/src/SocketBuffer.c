@@ -53,6 +53,12 @@ static List* queues;
  */
 static List writes;
 
+/**
+ * Read ahead buffers, indexed by socket descriptor
+ */
+static read_buffer** reads = NULL;
+static int nreads = 0;
+
 /**
  * List callback function for comparing socket_queues by socket
  * @param a first integer value
@@ -113,6 +119,16 @@ void SocketBuffer_terminate(void)
 		free(((socket_queue*)(cur->content))->buf);
 	ListFree(queues);
 	SocketBuffer_freeDefQ();
+	while (nreads > 0)
+	{
+		if (reads[--nreads])
+			free(reads[nreads]);
+	}
+	if (reads)
+	{
+		free(reads);
+		reads = NULL;
+	}
 	FUNC_EXIT;
 }
 
@@ -131,6 +147,11 @@ void SocketBuffer_cleanup(int socket)
 	}
 	if (def_queue->socket == socket)
 		def_queue->socket = def_queue->index = def_queue->headerlen = def_queue->datalen = 0;
+	if (socket >= 0 && socket < nreads && reads[socket])
+	{
+		free(reads[socket]);
+		reads[socket] = NULL;
+	}
 	FUNC_EXIT;
 }
 
@@ -255,6 +276,51 @@ char* SocketBuffer_complete(int socket)
 }
 
 
+/**
+ * Get the read ahead buffer for a socket, creating it if need be
+ * @param socket the socket
+ * @return the buffer, or NULL if there is no memory for it
+ */
+read_buffer* SocketBuffer_getRead(int socket)
+{
+	FUNC_ENTRY;
+	if (socket >= nreads)
+	{
+		int newcount = (socket + 1 > 2 * nreads) ? socket + 1 : 2 * nreads;
+		read_buffer** newreads = malloc(newcount * sizeof(read_buffer*));
+
+		if (newreads == NULL)
+			goto exit;
+		memset(newreads, '\0', newcount * sizeof(read_buffer*));
+		if (reads)
+		{
+			memcpy(newreads, reads, nreads * sizeof(read_buffer*));
+			free(reads);
+		}
+		reads = newreads;
+		nreads = newcount;
+	}
+	if (reads[socket] == NULL && (reads[socket] = malloc(sizeof(read_buffer))) != NULL)
+		reads[socket]->index = reads[socket]->datalen = 0;
+exit:
+	FUNC_EXIT;
+	return (socket < nreads) ? reads[socket] : NULL;
+}
+
+
+/**
+ * Find how many bytes have been read from a socket but not yet parsed
+ * @param socket the socket
+ * @return the number of bytes
+ */
+int SocketBuffer_readPending(int socket)
+{
+	if (socket < 0 || socket >= nreads || reads[socket] == NULL)
+		return 0;
+	return reads[socket]->datalen - reads[socket]->index;
+}
+
+
 /**
  * A socket operation had now completed so we can get rid of the queue
  * @param socket the socket for which the operation is now complete
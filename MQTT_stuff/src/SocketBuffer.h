@@ -44,6 +44,17 @@ typedef struct
 	char* buf;
 } socket_queue;
 
+#if !defined(SOCKETBUFFER_READ_SIZE)
+#define SOCKETBUFFER_READ_SIZE 16384 /**< bytes read from a socket at once, ahead of the packet being parsed */
+#endif
+
+typedef struct
+{
+	int index, 				/**< offset of the first byte not yet parsed */
+		datalen; 			/**< offset of the end of the data read */
+	char buf[SOCKETBUFFER_READ_SIZE];
+} read_buffer;
+
 typedef struct
 {
 	int socket, total, count;
@@ -68,6 +79,8 @@ int SocketBuffer_getQueuedChar(int socket, char* c);
 void SocketBuffer_interrupted(int socket, int actual_len);
 char* SocketBuffer_complete(int socket);
 void SocketBuffer_queueChar(int socket, char c);
+read_buffer* SocketBuffer_getRead(int socket);
+int SocketBuffer_readPending(int socket);
 
 #if defined(OPENSSL)
 void SocketBuffer_pendingWrite(int socket, SSL* ssl, int count, iobuf* iovecs, int total, int bytes);
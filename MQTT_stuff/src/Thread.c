@@ -39,6 +39,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <sys/stat.h>
@@ -373,6 +374,7 @@ cond_type Thread_create_cond()
 	condvar = malloc(sizeof(cond_type_struct));
 	rc = pthread_cond_init(&condvar->cond, NULL);
 	rc = pthread_mutex_init(&condvar->mutex, NULL);
+	condvar->signalled = 0;
 
 	FUNC_EXIT_RC(rc);
 	return condvar;
@@ -387,6 +389,7 @@ int Thread_signal_cond(cond_type condvar)
 	int rc = 0;
 
 	pthread_mutex_lock(&condvar->mutex);
+	condvar->signalled = 1;
 	rc = pthread_cond_signal(&condvar->cond);
 	pthread_mutex_unlock(&condvar->mutex);
 
@@ -417,6 +420,48 @@ int Thread_wait_cond(cond_type condvar, int timeout)
 	return rc;
 }
 
+/**
+ * Wait with a timeout (milliseconds) for a condition variable to be signalled.  Unlike
+ * Thread_wait_cond, a signal sent while nobody was waiting is not lost: the next wait
+ * returns straight away.
+ * @param condvar the condition variable
+ * @param timeout the maximum time to wait, in milliseconds, or -1 to wait for ever
+ * @return 0 if signalled, ETIMEDOUT otherwise
+ */
+int Thread_wait_cond_ms(cond_type condvar, long timeout)
+{
+	int rc = 0;
+	struct timespec cond_timeout;
+
+	FUNC_ENTRY;
+	if (timeout >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &cond_timeout);
+		cond_timeout.tv_sec += timeout / 1000;
+		cond_timeout.tv_nsec += (timeout % 1000) * 1000000L;
+		if (cond_timeout.tv_nsec >= 1000000000L)
+		{
+			++cond_timeout.tv_sec;
+			cond_timeout.tv_nsec -= 1000000000L;
+		}
+	}
+
+	pthread_mutex_lock(&condvar->mutex);
+	while (!condvar->signalled && rc != ETIMEDOUT)
+	{
+		if (timeout < 0)
+			rc = pthread_cond_wait(&condvar->cond, &condvar->mutex);
+		else
+			rc = pthread_cond_timedwait(&condvar->cond, &condvar->mutex, &cond_timeout);
+	}
+	rc = condvar->signalled ? 0 : ETIMEDOUT;
+	condvar->signalled = 0;
+	pthread_mutex_unlock(&condvar->mutex);
+
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
 /**
  * Destroy a condition variable
  * @return completion code
@@ -36,13 +36,14 @@
 	#define thread_return_type void*
 	typedef thread_return_type (*thread_fn)(void*);
 	#define mutex_type pthread_mutex_t*
-	typedef struct { pthread_cond_t cond; pthread_mutex_t mutex; } cond_type_struct;
+	typedef struct { pthread_cond_t cond; pthread_mutex_t mutex; int signalled; } cond_type_struct;
 	typedef cond_type_struct *cond_type;
 	typedef sem_t *sem_type;
 
 	cond_type Thread_create_cond();
 	int Thread_signal_cond(cond_type);
 	int Thread_wait_cond(cond_type condvar, int timeout);
+	int Thread_wait_cond_ms(cond_type condvar, long timeout);
 	int Thread_destroy_cond(cond_type);
 #endif
 
@@ -32,6 +32,8 @@
 
 #include "Heap.h"
 
+#undef free /* not Heap_free: the heap tracking tree is freed with heap_mutex held */
+
 
 void TreeInitializeNoMalloc(Tree* aTree, int(*compare)(void*, void*, int))
 {
@@ -0,0 +1,537 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Throughput and per sample latency of the sample path: calibration,
+// fusion, the quaternion/Euler conversions, wire encoding and DMP FIFO
+// packet parsing. Runs on a synthetic data set or a recorded one (-r, any
+// file imu -o or -B wrote). FIFO parsing runs against the simulator on its
+// virtual clock, so no sensor is needed.
+//
+// Every benchmark is run several times over the whole data set and the
+// median is reported with the spread between runs. Latency percentiles
+// come from a separate pass timing each call, less the cost of reading
+// the clock.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include "mpu9150.h"
+#include "inv_mpu.h"
+#include "inv_mpu_dmp_motion_driver.h"
+#include "linux_glue.h"
+#include "mpu_sim.h"
+#include "replay.h"
+#include "recorder.h"
+#include "metrics.h"
+
+#define DEFAULT_SAMPLES		10000
+#define DEFAULT_RUNS		15
+#define MAX_RUNS		101
+
+// the rate we need to sustain
+#define TARGET_RATE_HZ		200
+
+#define MPU_MSG_LENGTH		26
+
+typedef struct {
+	const char *name;
+	int (*setup)();
+	void (*run)(int start, int count);
+	// part of the per sample pipeline for the budget line
+	int pipeline;
+} bench_t;
+
+typedef struct {
+	double ns_per_sample;
+	double spread;
+	double p50;
+	double p99;
+	double max;
+} result_t;
+
+static int setup_none();
+static int setup_fusion();
+static int setup_dmp();
+static void run_calibrate(int start, int count);
+static void run_fusion(int start, int count);
+static void run_quat_to_euler(int start, int count);
+static void run_euler_to_quat(int start, int count);
+static void run_encode_mqtt(int start, int count);
+static void run_encode_record(int start, int count);
+static void run_dmp_parse(int start, int count);
+
+static const bench_t benches[] = {
+	{ "calibrate", setup_none, run_calibrate, 1 },
+	{ "fusion", setup_fusion, run_fusion, 1 },
+	{ "quat_to_euler", setup_none, run_quat_to_euler, 0 },
+	{ "euler_to_quat", setup_none, run_euler_to_quat, 0 },
+	{ "encode_mqtt", setup_none, run_encode_mqtt, 1 },
+	{ "encode_record", setup_none, run_encode_record, 0 },
+	{ "dmp_parse", setup_dmp, run_dmp_parse, 1 }
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static mpudata_t *samples;
+static int num_samples;
+
+// state carried from sample to sample like in the read loop
+static float last_dmp_yaw;
+static float last_yaw;
+
+static char mpu_msg[MPU_MSG_LENGTH];
+static recsample_t rec;
+static int dmp_ready;
+
+// keeps the compiler from dropping the work
+volatile float sink_value;
+
+void usage(char *argv_0);
+int make_synthetic(int count);
+int load_recording(const char *path, int max);
+void run_bench(const bench_t *b, int runs, result_t *res);
+double timer_overhead();
+int cmp_double(const void *a, const void *b);
+
+int main(int argc, char **argv)
+{
+	int opt, i, runs = DEFAULT_RUNS, count = DEFAULT_SAMPLES;
+	char *path = NULL;
+	char *only = NULL;
+	result_t res;
+	double pipeline_ns;
+	caldata_t cal;
+
+	while ((opt = getopt(argc, argv, "n:R:r:b:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+
+			if (count < 100)
+				usage(argv[0]);
+
+			break;
+
+		case 'R':
+			runs = strtoul(optarg, NULL, 0);
+
+			if (runs < 3 || runs > MAX_RUNS)
+				usage(argv[0]);
+
+			break;
+
+		case 'r':
+			path = optarg;
+			break;
+
+		case 'b':
+			only = optarg;
+			break;
+
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	if (path) {
+		if (load_recording(path, count))
+			exit(1);
+	}
+	else if (make_synthetic(count)) {
+		exit(1);
+	}
+
+	// exercise the scaling path, not the pass through
+	for (i = 0; i < 3; i++) {
+		cal.offset[i] = 12;
+		cal.range[i] = 250;
+	}
+
+	mpu9150_set_mag_cal(&cal);
+
+	for (i = 0; i < 3; i++) {
+		cal.offset[i] = 0;
+		cal.range[i] = 16500;
+	}
+
+	mpu9150_set_accel_cal(&cal);
+
+	printf("%s data set, %d samples, %d runs, clock read %.0f ns\n\n",
+		path ? path : "Synthetic", num_samples, runs, timer_overhead());
+
+	printf("%-14s %10s %7s %12s %9s %9s %9s\n",
+		"benchmark", "ns/sample", "spread", "samples/s", "p50 ns", "p99 ns", "max ns");
+
+	pipeline_ns = 0.0;
+
+	for (i = 0; i < NUM_BENCHES; i++) {
+		if (only && strcmp(only, benches[i].name))
+			continue;
+
+		if (benches[i].setup()) {
+			printf("%-14s setup failed\n", benches[i].name);
+			continue;
+		}
+
+		run_bench(&benches[i], runs, &res);
+
+		printf("%-14s %10.1f %6.1f%% %12.0f %9.0f %9.0f %9.0f\n",
+			benches[i].name, res.ns_per_sample, res.spread,
+			1e9 / res.ns_per_sample, res.p50, res.p99, res.max);
+
+		if (benches[i].pipeline)
+			pipeline_ns += res.ns_per_sample;
+	}
+
+	if (!only) {
+		printf("\nPipeline %.0f ns per sample, %.3f%% of one core at %d Hz\n",
+			pipeline_ns, 100.0 * pipeline_ns * TARGET_RATE_HZ / 1e9, TARGET_RATE_HZ);
+	}
+
+	free(samples);
+
+	return 0;
+}
+
+void usage(char *argv_0)
+{
+	int i;
+
+	printf("\nUsage: %s [options]\n", argv_0);
+	printf("  -n <samples>          Synthetic data set size, or the most to load with -r.\n");
+	printf("                           The default is %d.\n", DEFAULT_SAMPLES);
+	printf("  -R <runs>             Runs per benchmark, 3-%d. The default is %d.\n", MAX_RUNS, DEFAULT_RUNS);
+	printf("  -r <file>             Use a recording from imu -o or -B instead of synthetic data\n");
+	printf("  -b <benchmark>        Only run this one:");
+
+	for (i = 0; i < NUM_BENCHES; i++)
+		printf(" %s", benches[i].name);
+
+	printf("\n  -h                    Show this help\n");
+
+	exit(1);
+}
+
+// Slow yaw with some pitch and roll wobble, noisy sensors. Deterministic
+// so runs are comparable.
+int make_synthetic(int count)
+{
+	quaternion_t q;
+	vector3d_t e;
+	unsigned int seed = 12345;
+	int i, j;
+
+	samples = (mpudata_t *)calloc(count, sizeof(mpudata_t));
+
+	if (!samples) {
+		perror("calloc");
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		mpudata_t *mpu = &samples[i];
+
+		e[VEC3_X] = 0.2f * sinf(i * 0.01f);
+		e[VEC3_Y] = 0.1f * cosf(i * 0.013f);
+		e[VEC3_Z] = fmodf(i * 0.005f, 2.0f * (float)M_PI) - (float)M_PI;
+		eulerToQuaternion(e, q);
+
+		// DMP quaternions are Q30
+		for (j = 0; j < 4; j++)
+			mpu->rawQuat[j] = (long)(q[j] * 1073741824.0f);
+
+		for (j = 0; j < 3; j++) {
+			seed = seed * 1103515245 + 12345;
+			mpu->rawGyro[j] = (short)((seed >> 16) % 41) - 20;
+			mpu->rawAccel[j] = (short)((seed >> 8) % 201) - 100;
+		}
+
+		mpu->rawAccel[VEC3_Z] += 16384;
+
+		mpu->rawMag[VEC3_X] = (short)(120 * cosf(e[VEC3_Z]));
+		mpu->rawMag[VEC3_Y] = (short)(120 * sinf(e[VEC3_Z]));
+		mpu->rawMag[VEC3_Z] = -200;
+
+		mpu->dmpTimestamp = i * (1000 / TARGET_RATE_HZ);
+		mpu->magTimestamp = mpu->dmpTimestamp;
+		mpu->Temp[0] = -1500;
+	}
+
+	num_samples = count;
+
+	return 0;
+}
+
+int load_recording(const char *path, int max)
+{
+	samples = (mpudata_t *)calloc(max, sizeof(mpudata_t));
+
+	if (!samples) {
+		perror("calloc");
+		return -1;
+	}
+
+	if (replay_open(path, 0))
+		return -1;
+
+	num_samples = 0;
+
+	while (num_samples < max && replay_read(&samples[num_samples]) == 0)
+		num_samples++;
+
+	replay_close();
+
+	if (num_samples < 100) {
+		printf("Only %d samples in %s, need at least 100\n", num_samples, path);
+		return -1;
+	}
+
+	return 0;
+}
+
+void run_bench(const bench_t *b, int runs, result_t *res)
+{
+	double per_run[MAX_RUNS];
+	double *lat;
+	double overhead;
+	uint64_t start;
+	int r, i;
+
+	// warm up caches and branch predictors
+	b->run(0, num_samples);
+
+	for (r = 0; r < runs; r++) {
+		start = metrics_now_ns();
+		b->run(0, num_samples);
+		per_run[r] = (double)(metrics_now_ns() - start) / num_samples;
+	}
+
+	qsort(per_run, runs, sizeof(double), cmp_double);
+
+	res->ns_per_sample = per_run[runs / 2];
+
+	// interquartile range relative to the median
+	res->spread = 100.0 * (per_run[(3 * runs) / 4] - per_run[runs / 4]) / res->ns_per_sample;
+
+	lat = (double *)malloc(num_samples * sizeof(double));
+
+	if (!lat) {
+		res->p50 = res->p99 = res->max = 0.0;
+		return;
+	}
+
+	overhead = timer_overhead();
+
+	for (i = 0; i < num_samples; i++) {
+		start = metrics_now_ns();
+		b->run(i, 1);
+		lat[i] = (double)(metrics_now_ns() - start) - overhead;
+
+		if (lat[i] < 0.0)
+			lat[i] = 0.0;
+	}
+
+	qsort(lat, num_samples, sizeof(double), cmp_double);
+
+	res->p50 = lat[num_samples / 2];
+	res->p99 = lat[(num_samples * 99) / 100];
+	res->max = lat[num_samples - 1];
+
+	free(lat);
+}
+
+// median cost of reading the clock twice back to back
+double timer_overhead()
+{
+	double t[101];
+	uint64_t start;
+	int i;
+
+	for (i = 0; i < 101; i++) {
+		start = metrics_now_ns();
+		t[i] = (double)(metrics_now_ns() - start);
+	}
+
+	qsort(t, 101, sizeof(double), cmp_double);
+
+	return t[50];
+}
+
+int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int setup_none()
+{
+	return 0;
+}
+
+static int setup_fusion()
+{
+	int i;
+
+	for (i = 0; i < num_samples; i++)
+		mpu9150_calibrate(&samples[i]);
+
+	last_dmp_yaw = 0.0f;
+	last_yaw = 0.0f;
+
+	return 0;
+}
+
+// Bring up the DMP on the simulator, once
+static int setup_dmp()
+{
+	mpusim_config_t sim_config;
+
+	if (dmp_ready)
+		return 0;
+
+	memset(&sim_config, 0, sizeof(sim_config));
+	sim_config.virtual_clock = 1;
+	sim_config.fifo_rate = TARGET_RATE_HZ;
+	sim_config.yaw_rate = 10.0f;
+
+	mpu_sim_init(&sim_config);
+	linux_set_i2c_sim(1);
+
+	if (mpu9150_init(1, 100, 4))
+		return -1;
+
+	dmp_ready = 1;
+
+	return 0;
+}
+
+static void run_calibrate(int start, int count)
+{
+	int i;
+
+	for (i = start; i < start + count; i++)
+		mpu9150_calibrate(&samples[i]);
+
+	sink_value = samples[start].calibratedMag[0];
+}
+
+static void run_fusion(int start, int count)
+{
+	mpudata_t *mpu;
+	int i;
+
+	for (i = start; i < start + count; i++) {
+		mpu = &samples[i];
+
+		mpu->lastDMPYaw = last_dmp_yaw;
+		mpu->lastYaw = last_yaw;
+
+		mpu9150_fuse(mpu);
+
+		last_dmp_yaw = mpu->lastDMPYaw;
+		last_yaw = mpu->lastYaw;
+	}
+}
+
+static void run_quat_to_euler(int start, int count)
+{
+	vector3d_t e;
+	int i;
+
+	for (i = start; i < start + count; i++)
+		quaternionToEuler(samples[i].fusedQuat, e);
+
+	sink_value = e[0];
+}
+
+static void run_euler_to_quat(int start, int count)
+{
+	quaternion_t q;
+	int i;
+
+	for (i = start; i < start + count; i++)
+		eulerToQuaternion(samples[i].fusedEuler, q);
+
+	sink_value = q[0];
+}
+
+// same layout as mpu_add_msg() in imu.c
+static void run_encode_mqtt(int start, int count)
+{
+	struct timeval tv;
+	mpudata_t *mpu;
+	int i;
+
+	for (i = start; i < start + count; i++) {
+		mpu = &samples[i];
+
+		gettimeofday(&tv, NULL);
+		memcpy(&mpu_msg[0], &tv, 8);
+		memcpy(&mpu_msg[8], &mpu->fusedQuat[QUAT_W], 4);
+		memcpy(&mpu_msg[12], &mpu->fusedQuat[QUAT_X], 4);
+		memcpy(&mpu_msg[16], &mpu->fusedQuat[QUAT_Y], 4);
+		memcpy(&mpu_msg[20], &mpu->fusedQuat[QUAT_Z], 4);
+		memcpy(&mpu_msg[24], &mpu->Temp[0], 2);
+	}
+
+	sink_value = mpu_msg[8];
+}
+
+// the record the binary recorder and the UDP sink send
+static void run_encode_record(int start, int count)
+{
+	int i;
+
+	for (i = start; i < start + count; i++)
+		recsample_from_mpudata(&samples[i], &rec);
+
+	sink_value = rec.fused_quat[0];
+}
+
+// One packet per simulated 5 ms. The time is dmp_read_fifo() with the
+// FIFO count and burst reads it does through the simulated bus, plus
+// stepping the simulator clock.
+static void run_dmp_parse(int start, int count)
+{
+	mpudata_t mpu;
+	unsigned char more;
+	short sensors;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		mpu_sim_advance_ms(1000 / TARGET_RATE_HZ);
+
+		dmp_read_fifo(mpu.rawGyro, mpu.rawAccel, mpu.rawQuat, &mpu.dmpTimestamp, &sensors, &more);
+	}
+
+	sink_value = mpu.rawQuat[0];
+}
@@ -0,0 +1,788 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// End to end publish benchmark for the MQTTAsync client in MQTT_stuff.
+// Starts a minimal broker stand-in on a loopback port in a thread of its
+// own, then for each QoS and payload size connects a fresh client, keeps
+// a window of publishes outstanding and measures the publish rate, the
+// time from MQTTAsync_sendMessage() to the onSuccess callback and how
+// much the process grew.
+//
+// The stand-in only speaks as much of MQTT 3.1/3.1.1 as a publisher needs:
+// CONNACK, PUBACK, PUBREC/PUBCOMP and PINGRESP. Publishes are counted and
+// dropped. For QoS 0 the library calls onSuccess once the packet has been
+// written, so that latency is to the socket, not to the broker.
+//
+// With -z the payloads are sent with MQTTAsync_sendBuffer() from a window
+// of registered buffers instead of being copied by MQTTAsync_sendMessage().
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "MQTTAsync.h"
+#include "metrics.h"
+
+#define DEFAULT_MESSAGES	10000
+#define DEFAULT_WINDOW		64
+#define MAX_WINDOW		60000
+
+#define BENCH_TOPIC		"bench/imu"
+#define BENCH_CLIENT_ID		"mqttbench"
+
+// give up on a case if nothing is acked for this long
+#define STALL_TIMEOUT_S		10
+
+#define BROKER_BUFF_SIZE	(128 * 1024)
+
+// MQTT control packet types
+#define PKT_CONNECT		1
+#define PKT_CONNACK		2
+#define PKT_PUBLISH		3
+#define PKT_PUBACK		4
+#define PKT_PUBREC		5
+#define PKT_PUBREL		6
+#define PKT_PUBCOMP		7
+#define PKT_PINGREQ		12
+#define PKT_PINGRESP		13
+#define PKT_DISCONNECT		14
+
+static const int payload_sizes[] = { 16, 256, 4096, 65536 };
+
+#define NUM_SIZES (sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+typedef struct {
+	double msgs_per_sec;
+	double mb_per_sec;
+	double p50;
+	double p99;
+	double max;
+	long rss_growth_kb;
+	int failed;
+	int lost;
+} result_t;
+
+// broker side, written by the broker thread
+static int listen_fd = -1;
+static int broker_port;
+static volatile int broker_publishes;
+static volatile int broker_disconnects;
+
+// client side, shared with the MQTTAsync callbacks
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int connected;
+static int disconnected;
+static int connect_failed;
+static int outstanding;
+static int acked;
+static int failed;
+static uint64_t *sent_ns;
+static uint64_t *lat_ns;
+
+// -z, one payload buffer per window slot lent to the library
+static int zero_copy;
+static char *lent;
+static int lent_size;
+static int *free_bufs;
+static int num_free;
+
+void usage(char *argv_0);
+int start_broker();
+void *broker_thread(void *arg);
+void serve_client(int fd);
+int run_case(int qos, int size, int count, int window, result_t *res);
+int wait_for(int *flag, int timeout_s);
+long rss_kb();
+int cmp_u64(const void *a, const void *b);
+
+static void on_connect(void *context, MQTTAsync_successData *response);
+static void on_connect_failure(void *context, MQTTAsync_failureData *response);
+static void on_disconnect(void *context, MQTTAsync_successData *response);
+static void on_publish(void *context, MQTTAsync_successData *response);
+static void on_publish_failure(void *context, MQTTAsync_failureData *response);
+static void on_buffer_released(void *context, void *buffer);
+
+int main(int argc, char **argv)
+{
+	int opt, qos, i, num_sizes;
+	int only_qos = -1, only_size = 0;
+	const int *sizes;
+	int count = DEFAULT_MESSAGES;
+	int window = DEFAULT_WINDOW;
+	long rss_start;
+	result_t res;
+
+	while ((opt = getopt(argc, argv, "n:w:q:s:zh")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+
+			if (count < 100)
+				usage(argv[0]);
+
+			break;
+
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+
+			if (window < 1 || window > MAX_WINDOW)
+				usage(argv[0]);
+
+			break;
+
+		case 'q':
+			only_qos = strtoul(optarg, NULL, 0);
+
+			if (only_qos < 0 || only_qos > 2)
+				usage(argv[0]);
+
+			break;
+
+		case 's':
+			only_size = strtoul(optarg, NULL, 0);
+
+			if (only_size < 1)
+				usage(argv[0]);
+
+			break;
+
+		case 'z':
+			zero_copy = 1;
+			break;
+
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	sent_ns = (uint64_t *)calloc(count, sizeof(uint64_t));
+	lat_ns = (uint64_t *)calloc(count, sizeof(uint64_t));
+
+	if (!sent_ns || !lat_ns) {
+		printf("Out of memory for %d messages\n", count);
+		exit(1);
+	}
+
+	if (start_broker())
+		exit(1);
+
+	rss_start = rss_kb();
+
+	printf("Loopback broker on port %d, %d messages per case, window %d%s, RSS %ld kB\n\n",
+		broker_port, count, window, zero_copy ? ", zero copy" : "", rss_start);
+
+	printf("%3s %7s %10s %9s %9s %9s %9s %8s %6s %5s\n",
+		"qos", "payload", "msgs/s", "MB/s", "p50 us", "p99 us", "max us",
+		"rss kB", "failed", "lost");
+
+	if (only_size) {
+		sizes = &only_size;
+		num_sizes = 1;
+	}
+	else {
+		sizes = payload_sizes;
+		num_sizes = NUM_SIZES;
+	}
+
+	for (qos = 0; qos <= 2; qos++) {
+		if (only_qos >= 0 && qos != only_qos)
+			continue;
+
+		for (i = 0; i < num_sizes; i++) {
+			if (run_case(qos, sizes[i], count, window, &res)) {
+				printf("%3d %7d case failed\n", qos, sizes[i]);
+				continue;
+			}
+
+			printf("%3d %7d %10.0f %9.2f %9.1f %9.1f %9.1f %+8ld %6d %5d\n",
+				qos, sizes[i], res.msgs_per_sec, res.mb_per_sec,
+				res.p50, res.p99, res.max, res.rss_growth_kb,
+				res.failed, res.lost);
+		}
+	}
+
+	printf("\nRSS grew %ld kB over the whole run\n", rss_kb() - rss_start);
+
+	close(listen_fd);
+	free(sent_ns);
+	free(lat_ns);
+
+	return 0;
+}
+
+void usage(char *argv_0)
+{
+	unsigned int i;
+
+	printf("\nUsage: %s [options]\n", argv_0);
+	printf("  -n <messages>         Messages per case, the default is %d\n", DEFAULT_MESSAGES);
+	printf("  -w <window>           Publishes outstanding at once, 1-%d. The default is %d.\n",
+		MAX_WINDOW, DEFAULT_WINDOW);
+	printf("  -q <qos>              Only run this QoS, 0-2\n");
+	printf("  -s <bytes>            Only run this payload size. The default set is");
+
+	for (i = 0; i < NUM_SIZES; i++)
+		printf(" %d", payload_sizes[i]);
+
+	printf("\n  -z                    Publish from registered buffers without copying\n");
+	printf("  -h                    Show this help\n");
+
+	exit(1);
+}
+
+// Listen on an ephemeral loopback port and serve clients one after the
+// other from a detached thread.
+int start_broker()
+{
+	struct sockaddr_in addr;
+	socklen_t len;
+	pthread_t thread;
+	int on = 1;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (listen_fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		goto fail;
+	}
+
+	if (listen(listen_fd, 4) < 0) {
+		perror("listen");
+		goto fail;
+	}
+
+	len = sizeof(addr);
+
+	if (getsockname(listen_fd, (struct sockaddr *)&addr, &len) < 0) {
+		perror("getsockname");
+		goto fail;
+	}
+
+	broker_port = ntohs(addr.sin_port);
+
+	if (pthread_create(&thread, NULL, broker_thread, NULL)) {
+		printf("Failed to start broker thread\n");
+		goto fail;
+	}
+
+	pthread_detach(thread);
+
+	return 0;
+
+fail:
+	close(listen_fd);
+	listen_fd = -1;
+	return -1;
+}
+
+void *broker_thread(void *arg)
+{
+	int fd, on = 1;
+
+	while (1) {
+		fd = accept(listen_fd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		serve_client(fd);
+
+		close(fd);
+
+		__sync_fetch_and_add(&broker_disconnects, 1);
+	}
+
+	return NULL;
+}
+
+// Read whole packets out of a buffer, queue the acks they need and send
+// the acks for one read with a single write.
+void serve_client(int fd)
+{
+	unsigned char *in, out[4096];
+	int have, used, n, outlen;
+	int type, qos, remaining, mult, hdrlen, topiclen;
+	unsigned char *p;
+
+	in = (unsigned char *)malloc(BROKER_BUFF_SIZE);
+
+	if (!in)
+		return;
+
+	have = 0;
+
+	while (1) {
+		n = read(fd, in + have, BROKER_BUFF_SIZE - have);
+
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		have += n;
+		used = 0;
+		outlen = 0;
+
+		while (used < have) {
+			p = in + used;
+
+			// remaining length is 1 to 4 bytes, 7 bits each
+			remaining = 0;
+			mult = 1;
+			hdrlen = 1;
+
+			do {
+				if (used + hdrlen >= have)
+					goto need_more;
+
+				remaining += (p[hdrlen] & 0x7f) * mult;
+				mult *= 128;
+			} while (p[hdrlen++] & 0x80);
+
+			if (hdrlen + remaining > BROKER_BUFF_SIZE) {
+				printf("broker: %d byte packet does not fit\n", hdrlen + remaining);
+				goto done;
+			}
+
+			if (used + hdrlen + remaining > have)
+				goto need_more;
+
+			if (outlen > sizeof(out) - 4) {
+				if (write(fd, out, outlen) != outlen)
+					goto done;
+
+				outlen = 0;
+			}
+
+			type = p[0] >> 4;
+
+			switch (type) {
+			case PKT_CONNECT:
+				out[outlen++] = PKT_CONNACK << 4;
+				out[outlen++] = 2;
+				out[outlen++] = 0;
+				out[outlen++] = 0;
+				break;
+
+			case PKT_PUBLISH:
+				__sync_fetch_and_add(&broker_publishes, 1);
+
+				qos = (p[0] >> 1) & 0x03;
+
+				if (qos > 0) {
+					topiclen = (p[hdrlen] << 8) | p[hdrlen + 1];
+					out[outlen++] = (qos == 1 ? PKT_PUBACK : PKT_PUBREC) << 4;
+					out[outlen++] = 2;
+					out[outlen++] = p[hdrlen + 2 + topiclen];
+					out[outlen++] = p[hdrlen + 3 + topiclen];
+				}
+
+				break;
+
+			case PKT_PUBREL:
+				out[outlen++] = PKT_PUBCOMP << 4;
+				out[outlen++] = 2;
+				out[outlen++] = p[hdrlen];
+				out[outlen++] = p[hdrlen + 1];
+				break;
+
+			case PKT_PINGREQ:
+				out[outlen++] = PKT_PINGRESP << 4;
+				out[outlen++] = 0;
+				break;
+
+			case PKT_DISCONNECT:
+				goto done;
+
+			default:
+				break;
+			}
+
+			used += hdrlen + remaining;
+		}
+
+need_more:
+		if (outlen > 0 && write(fd, out, outlen) != outlen)
+			break;
+
+		if (used > 0) {
+			memmove(in, in + used, have - used);
+			have -= used;
+		}
+	}
+
+done:
+	free(in);
+}
+
+int run_case(int qos, int size, int count, int window, result_t *res)
+{
+	MQTTAsync client;
+	MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
+	MQTTAsync_disconnectOptions disc_opts = MQTTAsync_disconnectOptions_initializer;
+	MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+	MQTTAsync_message msg = MQTTAsync_message_initializer;
+	struct timespec ts;
+	char uri[64];
+	char *payload;
+	uint64_t start, elapsed;
+	long rss_before;
+	int i, b, rc, publishes_before, disconnects_before;
+	int result = -1;
+
+	payload = (char *)malloc(size);
+
+	if (!payload)
+		return -1;
+
+	for (i = 0; i < size; i++)
+		payload[i] = 'a' + (i % 26);
+
+	if (zero_copy) {
+		lent = (char *)malloc((size_t)window * size);
+		free_bufs = (int *)malloc(window * sizeof(int));
+
+		if (!lent || !free_bufs) {
+			printf("Out of memory for %d buffers of %d bytes\n", window, size);
+			free(lent);
+			free(free_bufs);
+			free(payload);
+			return -1;
+		}
+
+		for (b = 0; b < window; b++) {
+			memcpy(lent + (size_t)b * size, payload, size);
+			free_bufs[b] = b;
+		}
+
+		lent_size = size;
+		num_free = window;
+
+		if (MQTTAsync_registerBuffers(lent, size, window, on_buffer_released, NULL)
+				!= MQTTASYNC_SUCCESS) {
+			printf("MQTTAsync_registerBuffers failed\n");
+			free(lent);
+			free(free_bufs);
+			free(payload);
+			return -1;
+		}
+	}
+
+	memset(lat_ns, 0, count * sizeof(uint64_t));
+
+	connected = 0;
+	disconnected = 0;
+	connect_failed = 0;
+	outstanding = 0;
+	acked = 0;
+	failed = 0;
+
+	publishes_before = broker_publishes;
+	disconnects_before = broker_disconnects;
+	rss_before = rss_kb();
+
+	sprintf(uri, "tcp://127.0.0.1:%d", broker_port);
+
+	if (MQTTAsync_create(&client, uri, BENCH_CLIENT_ID, MQTTCLIENT_PERSISTENCE_NONE, NULL)
+			!= MQTTASYNC_SUCCESS) {
+		printf("MQTTAsync_create failed\n");
+		free(payload);
+		return -1;
+	}
+
+	conn_opts.keepAliveInterval = 20;
+	conn_opts.cleansession = 1;
+	conn_opts.maxInflight = window;
+	conn_opts.onSuccess = on_connect;
+	conn_opts.onFailure = on_connect_failure;
+
+	if ((rc = MQTTAsync_connect(client, &conn_opts)) != MQTTASYNC_SUCCESS) {
+		printf("MQTTAsync_connect failed, return code %d\n", rc);
+		goto done;
+	}
+
+	if (wait_for(&connected, STALL_TIMEOUT_S) || connect_failed) {
+		printf("No CONNACK from the broker stand-in\n");
+		goto done;
+	}
+
+	opts.onSuccess = on_publish;
+	opts.onFailure = on_publish_failure;
+
+	msg.payload = payload;
+	msg.payloadlen = size;
+	msg.qos = qos;
+	msg.retained = 0;
+
+	start = metrics_now_ns();
+
+	for (i = 0; i < count; i++) {
+		pthread_mutex_lock(&lock);
+
+		// the library may release a buffer a little after onSuccess
+		while (outstanding >= window || (zero_copy && num_free == 0)) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += STALL_TIMEOUT_S;
+
+			if (pthread_cond_timedwait(&cond, &lock, &ts) == ETIMEDOUT) {
+				pthread_mutex_unlock(&lock);
+				printf("Stalled with %d publishes outstanding\n", outstanding);
+				goto done;
+			}
+		}
+
+		outstanding++;
+		b = zero_copy ? free_bufs[--num_free] : 0;
+		sent_ns[i] = metrics_now_ns();
+
+		pthread_mutex_unlock(&lock);
+
+		opts.context = (void *)(intptr_t)i;
+
+		if (zero_copy)
+			rc = MQTTAsync_sendBuffer(client, BENCH_TOPIC, size, lent + (size_t)b * size,
+					qos, 0, &opts);
+		else
+			rc = MQTTAsync_sendMessage(client, BENCH_TOPIC, &msg, &opts);
+
+		if (rc != MQTTASYNC_SUCCESS) {
+			pthread_mutex_lock(&lock);
+			outstanding--;
+			failed++;
+
+			if (zero_copy)
+				free_bufs[num_free++] = b;
+
+			pthread_mutex_unlock(&lock);
+		}
+	}
+
+	// drain
+	pthread_mutex_lock(&lock);
+
+	while (outstanding > 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += STALL_TIMEOUT_S;
+
+		if (pthread_cond_timedwait(&cond, &lock, &ts) == ETIMEDOUT) {
+			pthread_mutex_unlock(&lock);
+			printf("Stalled with %d publishes outstanding\n", outstanding);
+			goto done;
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	elapsed = metrics_now_ns() - start;
+
+	disc_opts.timeout = 1000;
+	disc_opts.onSuccess = on_disconnect;
+
+	if (MQTTAsync_disconnect(client, &disc_opts) == MQTTASYNC_SUCCESS)
+		wait_for(&disconnected, STALL_TIMEOUT_S);
+
+	// let the broker finish reading what was written before DISCONNECT
+	for (i = 0; i < 1000 && broker_disconnects == disconnects_before; i++)
+		usleep(1000);
+
+	res->msgs_per_sec = (1e9 * acked) / elapsed;
+	res->mb_per_sec = (1e3 * acked * size) / elapsed;
+	res->failed = failed;
+	res->lost = acked - (broker_publishes - publishes_before);
+
+	if (res->lost < 0)
+		res->lost = 0;
+
+	// only acked messages have a latency, the rest sort to the front
+	qsort(lat_ns, count, sizeof(uint64_t), cmp_u64);
+
+	if (acked > 0) {
+		res->p50 = lat_ns[count - acked + acked / 2] / 1000.0;
+		res->p99 = lat_ns[count - acked + (acked * 99) / 100] / 1000.0;
+		res->max = lat_ns[count - 1] / 1000.0;
+	}
+	else {
+		res->p50 = res->p99 = res->max = 0.0;
+	}
+
+	result = 0;
+
+done:
+	MQTTAsync_destroy(&client);
+	free(payload);
+
+	if (zero_copy) {
+		// leave them be if the library somehow still holds one
+		if (MQTTAsync_unregisterBuffers(lent) == MQTTASYNC_SUCCESS)
+			free(lent);
+		else
+			printf("%d of %d buffers never released\n", window - num_free, window);
+
+		pthread_mutex_lock(&lock);
+		free(free_bufs);
+		lent = NULL;
+		free_bufs = NULL;
+		pthread_mutex_unlock(&lock);
+	}
+
+	res->rss_growth_kb = rss_kb() - rss_before;
+
+	return result;
+}
+
+// wait for a flag set by a callback, 0 if it was set
+int wait_for(int *flag, int timeout_s)
+{
+	struct timespec ts;
+	int rc = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_s;
+
+	pthread_mutex_lock(&lock);
+
+	while (!*flag && rc != ETIMEDOUT)
+		rc = pthread_cond_timedwait(&cond, &lock, &ts);
+
+	pthread_mutex_unlock(&lock);
+
+	return *flag ? 0 : -1;
+}
+
+// resident set from /proc/self/statm
+long rss_kb()
+{
+	FILE *fh;
+	long size, resident;
+
+	fh = fopen("/proc/self/statm", "r");
+
+	if (!fh)
+		return 0;
+
+	if (fscanf(fh, "%ld %ld", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(fh);
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void on_connect(void *context, MQTTAsync_successData *response)
+{
+	pthread_mutex_lock(&lock);
+	connected = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_connect_failure(void *context, MQTTAsync_failureData *response)
+{
+	pthread_mutex_lock(&lock);
+	connect_failed = 1;
+	connected = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_disconnect(void *context, MQTTAsync_successData *response)
+{
+	pthread_mutex_lock(&lock);
+	disconnected = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_publish(void *context, MQTTAsync_successData *response)
+{
+	int i = (int)(intptr_t)context;
+	uint64_t now = metrics_now_ns();
+
+	pthread_mutex_lock(&lock);
+	lat_ns[i] = now - sent_ns[i];
+	acked++;
+	outstanding--;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_publish_failure(void *context, MQTTAsync_failureData *response)
+{
+	pthread_mutex_lock(&lock);
+	failed++;
+	outstanding--;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_buffer_released(void *context, void *buffer)
+{
+	pthread_mutex_lock(&lock);
+
+	if (free_bufs) {
+		free_bufs[num_free++] = ((char *)buffer - lent) / lent_size;
+		pthread_cond_signal(&cond);
+	}
+
+	pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,119 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "i2c_trace.h"
+
+// catch layout changes at compile time, the files outlive the code
+typedef char i2ctrace_rec_size_check[(sizeof(i2ctrace_rec_t) == 24) ? 1 : -1];
+typedef char i2ctrace_hdr_size_check[(sizeof(i2ctrace_hdr_t) == 32) ? 1 : -1];
+
+static i2ctrace_rec_t ring[I2C_TRACE_RECORDS];
+static uint64_t ring_total;
+static int trace_on;
+
+// Turning it on starts a fresh trace
+void i2c_trace_set(int on)
+{
+	if (on && !trace_on)
+		ring_total = 0;
+
+	trace_on = on;
+}
+
+int i2c_trace_enabled()
+{
+	return trace_on;
+}
+
+// Called from the I2C glue, same thread as everything else on the bus
+void i2c_trace_record(uint64_t t_ns, uint32_t dur_ns, unsigned char slave, unsigned char reg,
+	unsigned char len, const unsigned char *data, int flags)
+{
+	i2ctrace_rec_t *rec;
+
+	if (!trace_on)
+		return;
+
+	rec = &ring[ring_total & (I2C_TRACE_RECORDS - 1)];
+	ring_total++;
+
+	rec->t_ns = t_ns;
+	rec->dur_ns = dur_ns;
+	rec->slave = slave;
+	rec->reg = reg;
+	rec->len = len;
+	rec->flags = flags;
+
+	memset(rec->data, 0, I2C_TRACE_DATA);
+
+	if (data && !(flags & I2C_TRACE_ERROR))
+		memcpy(rec->data, data, len < I2C_TRACE_DATA ? len : I2C_TRACE_DATA);
+}
+
+int i2c_trace_dump(const char *path)
+{
+	i2ctrace_hdr_t hdr;
+	uint64_t first;
+	uint32_t i;
+	FILE *f;
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, I2C_TRACE_MAGIC);
+	hdr.version = I2C_TRACE_VERSION;
+	hdr.record_size = sizeof(i2ctrace_rec_t);
+	hdr.total = ring_total;
+	hdr.count = ring_total < I2C_TRACE_RECORDS ? ring_total : I2C_TRACE_RECORDS;
+
+	f = fopen(path, "w");
+
+	if (!f) {
+		perror("open(<trace-file>)");
+		return -1;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		goto write_error;
+
+	first = ring_total - hdr.count;
+
+	for (i = 0; i < hdr.count; i++) {
+		if (fwrite(&ring[(first + i) & (I2C_TRACE_RECORDS - 1)], sizeof(i2ctrace_rec_t), 1, f) != 1)
+			goto write_error;
+	}
+
+	if (fclose(f)) {
+		perror("close(<trace-file>)");
+		return -1;
+	}
+
+	return 0;
+
+write_error:
+	perror("write(<trace-file>)");
+	fclose(f);
+	return -1;
+}
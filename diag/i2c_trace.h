@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef I2C_TRACE_H
+#define I2C_TRACE_H
+
+#include <stdint.h>
+
+// Every I2C transaction can be logged into a fixed size ring in memory,
+// cheap enough to leave on in production. Dump it to a file when something
+// looks wrong and decode it with i2ctrace. The file is the header followed
+// by the records oldest first, host byte order.
+
+#define I2C_TRACE_MAGIC		"I2CTRC1"
+#define I2C_TRACE_VERSION	1
+
+// power of two, 96 KB
+#define I2C_TRACE_RECORDS	4096
+
+// bytes of payload kept per transaction
+#define I2C_TRACE_DATA		8
+
+#define I2C_TRACE_READ		0x01
+#define I2C_TRACE_ERROR		0x02
+#define I2C_TRACE_SIM		0x04
+
+typedef struct {
+	uint64_t t_ns;			// CLOCK_MONOTONIC at the start
+	uint32_t dur_ns;
+	uint8_t slave;
+	uint8_t reg;
+	uint8_t len;
+	uint8_t flags;
+	uint8_t data[I2C_TRACE_DATA];
+} i2ctrace_rec_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t total;			// transactions seen, count of them kept
+} i2ctrace_hdr_t;
+
+void i2c_trace_set(int on);
+int i2c_trace_enabled();
+void i2c_trace_record(uint64_t t_ns, uint32_t dur_ns, unsigned char slave, unsigned char reg,
+	unsigned char len, const unsigned char *data, int flags);
+int i2c_trace_dump(const char *path);
+
+#endif /* I2C_TRACE_H */
@@ -0,0 +1,261 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+#define HIST_SUB_BITS	3
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+
+// values are clamped to 2^36 ns, about 68 seconds
+#define HIST_MAX_BITS	36
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define HIST_MAX_VALUE	((1ULL << HIST_MAX_BITS) - 1)
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint32_t buckets[HIST_BUCKETS];
+} histogram_t;
+
+static const char *stage_names[MET_NUM_STAGES] = {
+	"i2c_read",
+	"i2c_write",
+	"dmp_fifo",
+	"fusion",
+	"mqtt_send"
+};
+
+static const char *counter_names[MET_NUM_COUNTERS] = {
+	"samples",
+	"dropped_samples",
+	"nan_yaw",
+	"i2c_errors",
+	"mqtt_errors",
+	"fifo_overflows",
+	"fifo_resets",
+	"fifo_resyncs",
+	"fifo_corrupt_packets",
+	"fifo_stalls"
+};
+
+static histogram_t stages[MET_NUM_STAGES];
+static unsigned long counters[MET_NUM_COUNTERS];
+static uint64_t start_ns;
+
+static int bucket_index(uint64_t v);
+static uint64_t bucket_value(int index);
+
+uint64_t metrics_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+void metrics_record(int stage, uint64_t ns)
+{
+	histogram_t *h = &stages[stage];
+
+	if (!start_ns)
+		start_ns = metrics_now_ns() - ns;
+
+	if (ns > HIST_MAX_VALUE)
+		ns = HIST_MAX_VALUE;
+
+	h->buckets[bucket_index(ns)]++;
+	h->count++;
+	h->sum += ns;
+
+	if (ns > h->max)
+		h->max = ns;
+}
+
+void metrics_count(int counter, unsigned long n)
+{
+	counters[counter] += n;
+}
+
+// for counters kept elsewhere, like the DMP FIFO stats
+void metrics_set(int counter, unsigned long value)
+{
+	counters[counter] = value;
+}
+
+// Smallest value that pct percent of the samples are at or below, rounded
+// up to the top of its bucket. 0 if nothing was recorded.
+uint64_t metrics_percentile(int stage, double pct)
+{
+	histogram_t *h = &stages[stage];
+	uint64_t target, seen;
+	int i;
+
+	if (!h->count)
+		return 0;
+
+	target = (uint64_t)((pct / 100.0) * h->count + 0.5);
+
+	if (target < 1)
+		target = 1;
+
+	seen = 0;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+
+		if (seen >= target)
+			return bucket_value(i) < h->max ? bucket_value(i) : h->max;
+	}
+
+	return h->max;
+}
+
+void metrics_dump(FILE *f)
+{
+	histogram_t *h;
+	int i;
+
+	fprintf(f, "\n%-12s %10s %10s %10s %10s %10s\n", "stage (us)", "count", "mean", "p50", "p99", "max");
+
+	for (i = 0; i < MET_NUM_STAGES; i++) {
+		h = &stages[i];
+
+		fprintf(f, "%-12s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+			stage_names[i],
+			(unsigned long long)h->count,
+			h->count ? (h->sum / h->count) / 1000.0 : 0.0,
+			metrics_percentile(i, 50.0) / 1000.0,
+			metrics_percentile(i, 99.0) / 1000.0,
+			h->max / 1000.0);
+	}
+
+	fprintf(f, "\n");
+
+	for (i = 0; i < MET_NUM_COUNTERS; i++)
+		fprintf(f, "%-22s %lu\n", counter_names[i], counters[i]);
+
+	fprintf(f, "\n");
+	fflush(f);
+}
+
+// Prometheus text format so a node_exporter textfile collector can pick it
+// up. Written to a temp file and renamed, readers never see half a file.
+int metrics_write_file(const char *path)
+{
+	char tmp[256];
+	histogram_t *h;
+	FILE *f;
+	int i;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+		printf("Metrics file path too long\n");
+		return -1;
+	}
+
+	f = fopen(tmp, "w");
+
+	if (!f) {
+		perror("open(<metrics-file>)");
+		return -1;
+	}
+
+	fprintf(f, "# TYPE imu_uptime_seconds gauge\n");
+	fprintf(f, "imu_uptime_seconds %.0f\n", start_ns ? (metrics_now_ns() - start_ns) / 1e9 : 0.0);
+
+	fprintf(f, "# TYPE imu_stage_latency_seconds summary\n");
+
+	for (i = 0; i < MET_NUM_STAGES; i++) {
+		h = &stages[i];
+
+		fprintf(f, "imu_stage_latency_seconds{stage=\"%s\",quantile=\"0.5\"} %.9f\n",
+			stage_names[i], metrics_percentile(i, 50.0) / 1e9);
+		fprintf(f, "imu_stage_latency_seconds{stage=\"%s\",quantile=\"0.99\"} %.9f\n",
+			stage_names[i], metrics_percentile(i, 99.0) / 1e9);
+		fprintf(f, "imu_stage_latency_seconds{stage=\"%s\",quantile=\"1\"} %.9f\n",
+			stage_names[i], h->max / 1e9);
+		fprintf(f, "imu_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+			stage_names[i], h->sum / 1e9);
+		fprintf(f, "imu_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+			stage_names[i], (unsigned long long)h->count);
+	}
+
+	for (i = 0; i < MET_NUM_COUNTERS; i++) {
+		fprintf(f, "# TYPE imu_%s_total counter\n", counter_names[i]);
+		fprintf(f, "imu_%s_total %lu\n", counter_names[i], counters[i]);
+	}
+
+	if (fclose(f)) {
+		perror("close(<metrics-file>)");
+		return -1;
+	}
+
+	if (rename(tmp, path) < 0) {
+		perror("rename(<metrics-file>)");
+		return -1;
+	}
+
+	return 0;
+}
+
+void metrics_reset()
+{
+	memset(stages, 0, sizeof(stages));
+	memset(counters, 0, sizeof(counters));
+	start_ns = 0;
+}
+
+// Values below HIST_SUB get their own bucket, above that each power of two
+// is split into HIST_SUB equal parts.
+static int bucket_index(uint64_t v)
+{
+	int msb, shift;
+
+	if (v < HIST_SUB)
+		return (int)v;
+
+	msb = 63 - __builtin_clzll(v);
+	shift = msb - HIST_SUB_BITS;
+
+	return ((shift + 1) * HIST_SUB) + (int)((v >> shift) & (HIST_SUB - 1));
+}
+
+// largest value that lands in the bucket
+static uint64_t bucket_value(int index)
+{
+	int shift, sub;
+
+	if (index < HIST_SUB)
+		return index;
+
+	shift = (index / HIST_SUB) - 1;
+	sub = index % HIST_SUB;
+
+	return (((uint64_t)(HIST_SUB + sub + 1)) << shift) - 1;
+}
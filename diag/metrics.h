@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Latency histograms for the stages of the sample path and a few event
+// counters. Histograms are log bucketed, 8 linear sub-buckets per power of
+// two, so any reported value is within 12.5% of the real one. Recording is
+// a few instructions and meant to stay compiled in. Not thread safe, all
+// stages run on the read loop thread.
+
+enum {
+	MET_I2C_READ = 0,
+	MET_I2C_WRITE,
+	MET_DMP_FIFO,
+	MET_FUSION,
+	MET_MQTT_SEND,
+	MET_NUM_STAGES
+};
+
+enum {
+	MET_SAMPLES = 0,
+	MET_DROPPED_SAMPLES,
+	MET_NAN_YAW,
+	MET_I2C_ERRORS,
+	MET_MQTT_ERRORS,
+	MET_FIFO_OVERFLOWS,
+	MET_FIFO_RESETS,
+	MET_FIFO_RESYNCS,
+	MET_FIFO_CORRUPT,
+	MET_FIFO_STALLS,
+	MET_NUM_COUNTERS
+};
+
+uint64_t metrics_now_ns();
+void metrics_record(int stage, uint64_t ns);
+void metrics_count(int counter, unsigned long n);
+void metrics_set(int counter, unsigned long value);
+uint64_t metrics_percentile(int stage, double pct);
+void metrics_dump(FILE *f);
+int metrics_write_file(const char *path);
+void metrics_reset();
+
+// time a statement, e.g. METRICS_TIME(MET_FUSION, rc = data_fusion(mpu));
+#define METRICS_TIME(stage, stmt) do { \
+		uint64_t _met_start = metrics_now_ns(); \
+		stmt; \
+		metrics_record(stage, metrics_now_ns() - _met_start); \
+	} while (0)
+
+#endif /* METRICS_H */
@@ -293,12 +293,33 @@ struct test_s {
     float max_accel_var;
 };
 
+/* Largest register file of the supported devices (MPU6500). */
+#define MAX_NUM_REG         (128)
+
+/* Write-through shadow of the configuration registers.
+ * Only registers that the hardware never changes on its own are marked as
+ * cacheable. Data, status, FIFO and memory access registers always go out
+ * over the bus.
+ */
+struct reg_shadow_s {
+    unsigned char value[MAX_NUM_REG];
+    unsigned char valid[MAX_NUM_REG >> 3];
+    unsigned char cacheable[MAX_NUM_REG >> 3];
+    unsigned long skipped_writes;
+    unsigned long cached_reads;
+};
+
 /* Gyro driver state variables. */
 struct gyro_state_s {
     const struct gyro_reg_s *reg;
     const struct hw_s *hw;
     struct chip_cfg_s chip_cfg;
     const struct test_s *test;
+    struct reg_shadow_s shadow;
+    /* Number of times mpu_reset_fifo has run. Lets upper layers notice that
+     * anything they buffered from the FIFO is stale.
+     */
+    unsigned long fifo_resets;
 };
 
 /* Filter configurations. */
@@ -379,6 +400,7 @@ enum lp_accel_rate_e {
 #define BIT_FIFO_SIZE_2048  (0x80)
 #define BIT_FIFO_SIZE_4096  (0xC0)
 #define BIT_RESET           (0x80)
+#define BITS_USER_CTRL_RST  (0x0F)
 #define BIT_SLEEP           (0x40)
 #define BIT_S0_DELAY_EN     (0x01)
 #define BIT_S2_DELAY_EN     (0x04)
@@ -602,11 +624,205 @@ static struct gyro_state_s st = {
 
 #define MAX_PACKET_LENGTH (12)
 
+/* Skip redundant register writes and serve configuration register reads from
+ * the shadow copy in st.shadow. Comment out to send every access to the bus.
+ */
+#define MPU_REG_SHADOW
+
 #ifdef AK89xx_SECONDARY
 static int setup_compass(void);
 #define MAX_COMPASS_SAMPLE_RATE (100)
 #endif
 
+#define REG_BIT_IS_SET(map, reg)    ((map)[(reg) >> 3] & (1 << ((reg) & 7)))
+#define REG_BIT_SET(map, reg)       ((map)[(reg) >> 3] |= (1 << ((reg) & 7)))
+#define REG_BIT_CLR(map, reg)       ((map)[(reg) >> 3] &= ~(1 << ((reg) & 7)))
+
+static int reg_is_cached(unsigned short reg)
+{
+    if (reg >= MAX_NUM_REG)
+        return 0;
+    return REG_BIT_IS_SET(st.shadow.cacheable, reg) &&
+        REG_BIT_IS_SET(st.shadow.valid, reg);
+}
+
+static void reg_shadow_mark(unsigned char reg, unsigned char length)
+{
+    unsigned short ii;
+    for (ii = reg; ii < reg + length && ii < MAX_NUM_REG; ii++)
+        REG_BIT_SET(st.shadow.cacheable, ii);
+}
+
+/**
+ *  @brief      Forget the shadowed values of a register range.
+ *  The next access to these registers will go out over the bus.
+ *  @param[in]  reg     First register.
+ *  @param[in]  length  Number of registers.
+ */
+static void reg_shadow_invalidate(unsigned char reg, unsigned char length)
+{
+    unsigned short ii;
+    for (ii = reg; ii < reg + length && ii < MAX_NUM_REG; ii++)
+        REG_BIT_CLR(st.shadow.valid, ii);
+}
+
+/**
+ *  @brief      Reset the register shadow.
+ *  Called whenever the device has been reset. Only configuration registers
+ *  that the hardware never modifies on its own are marked as cacheable.
+ */
+static void reg_shadow_init(void)
+{
+    memset(st.shadow.valid, 0, sizeof(st.shadow.valid));
+    memset(st.shadow.cacheable, 0, sizeof(st.shadow.cacheable));
+
+    reg_shadow_mark(st.reg->rate_div, 1);
+    reg_shadow_mark(st.reg->lpf, 1);
+    reg_shadow_mark(st.reg->gyro_cfg, 1);
+    reg_shadow_mark(st.reg->accel_cfg, 1);
+    reg_shadow_mark(st.reg->motion_thr, 1);
+    reg_shadow_mark(st.reg->motion_dur, 1);
+    reg_shadow_mark(st.reg->fifo_en, 1);
+    reg_shadow_mark(st.reg->i2c_mst, 1);
+    reg_shadow_mark(st.reg->int_pin_cfg, 1);
+    reg_shadow_mark(st.reg->int_enable, 1);
+    reg_shadow_mark(st.reg->user_ctrl, 1);
+    reg_shadow_mark(st.reg->pwr_mgmt_1, 1);
+    reg_shadow_mark(st.reg->pwr_mgmt_2, 1);
+    reg_shadow_mark(st.reg->accel_offs, 6);
+    reg_shadow_mark(st.reg->prgm_start_h, 2);
+#if defined MPU6500
+    reg_shadow_mark(st.reg->accel_cfg2, 1);
+    reg_shadow_mark(st.reg->lp_accel_odr, 1);
+    reg_shadow_mark(st.reg->accel_intel, 1);
+#endif
+#ifdef AK89xx_SECONDARY
+    reg_shadow_mark(st.reg->s0_addr, 6);
+    reg_shadow_mark(st.reg->s4_ctrl, 1);
+    reg_shadow_mark(st.reg->s0_do, 2);
+    reg_shadow_mark(st.reg->i2c_delay_ctrl, 1);
+#ifdef MPU9150
+    reg_shadow_mark(st.reg->yg_offs_tc, 1);
+#endif
+#endif
+}
+
+/**
+ *  @brief      Write to device registers through the register shadow.
+ *  The bus write is skipped if every register in the range is cacheable and
+ *  already holds the requested value. Writes that set self-clearing reset
+ *  bits are always sent.
+ *  @param[in]  reg     First register.
+ *  @param[in]  length  Number of registers.
+ *  @param[in]  data    Register values.
+ *  @return     0 if successful.
+ */
+static int reg_write(unsigned char reg, unsigned char length,
+    unsigned char const *data)
+{
+#ifdef MPU_REG_SHADOW
+    unsigned short ii, r;
+    unsigned char reset = 0, skip = (length != 0);
+
+    for (ii = 0; ii < length; ii++) {
+        r = reg + ii;
+        if (r == st.reg->user_ctrl && (data[ii] & BITS_USER_CTRL_RST))
+            reset = 1;
+        else if (r == st.reg->pwr_mgmt_1 && (data[ii] & BIT_RESET))
+            reset = 1;
+        if (reset || !reg_is_cached(r) || st.shadow.value[r] != data[ii])
+            skip = 0;
+    }
+
+    if (skip) {
+        st.shadow.skipped_writes++;
+        return 0;
+    }
+#endif
+
+    if (i2c_write(st.hw->addr, reg, length, data)) {
+#ifdef MPU_REG_SHADOW
+        reg_shadow_invalidate(reg, length);
+#endif
+        return -1;
+    }
+
+#ifdef MPU_REG_SHADOW
+    for (ii = 0; ii < length; ii++) {
+        r = reg + ii;
+        if (r >= MAX_NUM_REG || !REG_BIT_IS_SET(st.shadow.cacheable, r))
+            continue;
+        if (r == st.reg->pwr_mgmt_1 && (data[ii] & BIT_RESET)) {
+            /* Every register is back to its power-on value. */
+            memset(st.shadow.valid, 0, sizeof(st.shadow.valid));
+            break;
+        }
+        st.shadow.value[r] = data[ii];
+        if (r == st.reg->user_ctrl)
+            st.shadow.value[r] &= ~BITS_USER_CTRL_RST;
+        REG_BIT_SET(st.shadow.valid, r);
+    }
+#endif
+    return 0;
+}
+
+/**
+ *  @brief      Read device registers through the register shadow.
+ *  If every register in the range has a valid shadow value, no bus access
+ *  is made.
+ *  @param[in]  reg     First register.
+ *  @param[in]  length  Number of registers.
+ *  @param[out] data    Register values.
+ *  @return     0 if successful.
+ */
+static int reg_read(unsigned char reg, unsigned char length,
+    unsigned char *data)
+{
+#ifdef MPU_REG_SHADOW
+    unsigned short ii, r;
+
+    for (ii = 0; ii < length; ii++) {
+        if (!reg_is_cached(reg + ii))
+            break;
+    }
+    if (length && ii == length) {
+        memcpy(data, &st.shadow.value[reg], length);
+        st.shadow.cached_reads++;
+        return 0;
+    }
+#endif
+
+    if (i2c_read(st.hw->addr, reg, length, data))
+        return -1;
+
+#ifdef MPU_REG_SHADOW
+    for (ii = 0; ii < length; ii++) {
+        r = reg + ii;
+        if (r >= MAX_NUM_REG || !REG_BIT_IS_SET(st.shadow.cacheable, r))
+            continue;
+        st.shadow.value[r] = data[ii];
+        REG_BIT_SET(st.shadow.valid, r);
+    }
+#endif
+    return 0;
+}
+
+/**
+ *  @brief      Get register shadow statistics.
+ *  @param[out] skipped_writes  Register writes that did not reach the bus.
+ *  @param[out] cached_reads    Register reads served from the shadow.
+ *  @return     0 if successful.
+ */
+int mpu_get_reg_shadow_stats(unsigned long *skipped_writes,
+    unsigned long *cached_reads)
+{
+    if (skipped_writes)
+        skipped_writes[0] = st.shadow.skipped_writes;
+    if (cached_reads)
+        cached_reads[0] = st.shadow.cached_reads;
+    return 0;
+}
+
 /**
  *  @brief      Enable/disable data ready interrupt.
  *  If the DMP is on, the DMP interrupt is enabled. Otherwise, the data ready
@@ -623,7 +839,7 @@ static int set_int_enable(unsigned char enable)
             tmp = BIT_DMP_INT_EN;
         else
             tmp = 0x00;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &tmp))
+        if (reg_write(st.reg->int_enable, 1, &tmp))
             return -1;
         st.chip_cfg.int_enable = tmp;
     } else {
@@ -635,7 +851,7 @@ static int set_int_enable(unsigned char enable)
             tmp = BIT_DATA_RDY_EN;
         else
             tmp = 0x00;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &tmp))
+        if (reg_write(st.reg->int_enable, 1, &tmp))
             return -1;
         st.chip_cfg.int_enable = tmp;
     }
@@ -674,7 +890,7 @@ int mpu_read_reg(unsigned char reg, unsigned char *data)
         return -1;
     if (reg >= st.hw->num_reg)
         return -1;
-    return i2c_read(st.hw->addr, reg, 1, data);
+    return reg_read(reg, 1, data);
 }
 
 /**
@@ -694,20 +910,22 @@ int mpu_init(struct int_param_s *int_param)
 {
     unsigned char data[6], rev;
 
+    reg_shadow_init();
+
     /* Reset device. */
     data[0] = BIT_RESET;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (reg_write(st.reg->pwr_mgmt_1, 1, data))
         return -1;
     delay_ms(100);
 
     /* Wake up chip. */
     data[0] = 0x00;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (reg_write(st.reg->pwr_mgmt_1, 1, data))
         return -1;
 
 #if defined MPU6050
     /* Check product revision. */
-    if (i2c_read(st.hw->addr, st.reg->accel_offs, 6, data))
+    if (reg_read(st.reg->accel_offs, 6, data))
         return -1;
     rev = ((data[5] & 0x01) << 2) | ((data[3] & 0x01) << 1) |
         (data[1] & 0x01);
@@ -723,7 +941,7 @@ int mpu_init(struct int_param_s *int_param)
             return -1;
         }
     } else {
-        if (i2c_read(st.hw->addr, st.reg->prod_id, 1, data))
+        if (reg_read(st.reg->prod_id, 1, data))
             return -1;
         rev = data[0] & 0x0F;
         if (!rev) {
@@ -751,7 +969,7 @@ int mpu_init(struct int_param_s *int_param)
      * first 3kB are needed by the DMP, we'll use the last 1kB for the FIFO.
      */
     data[0] = BIT_FIFO_SIZE_1024 | 0x8;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg2, 1, data))
+    if (reg_write(st.reg->accel_cfg2, 1, data))
         return -1;
 #endif
 
@@ -832,7 +1050,7 @@ int mpu_lp_accel_mode(unsigned char rate)
         mpu_set_int_latched(0);
         tmp[0] = 0;
         tmp[1] = BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, tmp))
+        if (reg_write(st.reg->pwr_mgmt_1, 2, tmp))
             return -1;
         st.chip_cfg.lp_accel_mode = 0;
         return 0;
@@ -861,7 +1079,7 @@ int mpu_lp_accel_mode(unsigned char rate)
         mpu_set_lpf(20);
     }
     tmp[1] = (tmp[1] << 6) | BIT_STBY_XYZG;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, tmp))
+    if (reg_write(st.reg->pwr_mgmt_1, 2, tmp))
         return -1;
 #elif defined MPU6500
     /* Set wake frequency. */
@@ -885,10 +1103,10 @@ int mpu_lp_accel_mode(unsigned char rate)
         tmp[0] = INV_LPA_320HZ;
     else
         tmp[0] = INV_LPA_640HZ;
-    if (i2c_write(st.hw->addr, st.reg->lp_accel_odr, 1, tmp))
+    if (reg_write(st.reg->lp_accel_odr, 1, tmp))
         return -1;
     tmp[0] = BIT_LPA_CYCLE;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, tmp))
+    if (reg_write(st.reg->pwr_mgmt_1, 1, tmp))
         return -1;
 #endif
     st.chip_cfg.sensors = INV_XYZ_ACCEL;
@@ -912,7 +1130,7 @@ int mpu_get_gyro_reg(short *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors & INV_XYZ_GYRO))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->raw_gyro, 6, tmp))
+    if (reg_read(st.reg->raw_gyro, 6, tmp))
         return -1;
     data[0] = (tmp[0] << 8) | tmp[1];
     data[1] = (tmp[2] << 8) | tmp[3];
@@ -935,7 +1153,7 @@ int mpu_get_accel_reg(short *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors & INV_XYZ_ACCEL))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->raw_accel, 6, tmp))
+    if (reg_read(st.reg->raw_accel, 6, tmp))
         return -1;
     data[0] = (tmp[0] << 8) | tmp[1];
     data[1] = (tmp[2] << 8) | tmp[3];
@@ -959,7 +1177,7 @@ int mpu_get_temperature(short *data, unsigned long *timestamp)
     if (!(st.chip_cfg.sensors))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->temp, 2, tmp))
+    if (reg_read(st.reg->temp, 2, tmp))
         return -1;
     raw = (tmp[0] << 8) | tmp[1];
     if (timestamp)
@@ -988,7 +1206,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     if (!accel_bias[0] && !accel_bias[1] && !accel_bias[2])
         return 0;
 
-    if (i2c_read(st.hw->addr, 3, 3, data))
+    if (reg_read(3, 3, data))
         return -1;
     fg[0] = ((data[0] >> 4) + 8) & 0xf;
     fg[1] = ((data[1] >> 4) + 8) & 0xf;
@@ -998,7 +1216,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     accel_hw[1] = (short)(accel_bias[1] * 2 / (64 + fg[1]));
     accel_hw[2] = (short)(accel_bias[2] * 2 / (64 + fg[2]));
 
-    if (i2c_read(st.hw->addr, 0x06, 6, data))
+    if (reg_read(0x06, 6, data))
         return -1;
 
     got_accel[0] = ((short)data[0] << 8) | data[1];
@@ -1016,7 +1234,7 @@ int mpu_set_accel_bias(const long *accel_bias)
     data[4] = (accel_hw[2] >> 8) & 0xff;
     data[5] = (accel_hw[2]) & 0xff;
 
-    if (i2c_write(st.hw->addr, 0x06, 6, data))
+    if (reg_write(0x06, 6, data))
         return -1;
     return 0;
 }
@@ -1032,51 +1250,53 @@ int mpu_reset_fifo(void)
     if (!(st.chip_cfg.sensors))
         return -1;
 
+    st.fifo_resets++;
+
     data = 0;
-    if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+    if (reg_write(st.reg->int_enable, 1, &data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &data))
+    if (reg_write(st.reg->fifo_en, 1, &data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+    if (reg_write(st.reg->user_ctrl, 1, &data))
         return -1;
 
     if (st.chip_cfg.dmp_on) {
         data = BIT_FIFO_RST | BIT_DMP_RST;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (reg_write(st.reg->user_ctrl, 1, &data))
             return -1;
         delay_ms(50);
         data = BIT_DMP_EN | BIT_FIFO_EN;
         if (st.chip_cfg.sensors & INV_XYZ_COMPASS)
             data |= BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (reg_write(st.reg->user_ctrl, 1, &data))
             return -1;
         if (st.chip_cfg.int_enable)
             data = BIT_DMP_INT_EN;
         else
             data = 0;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+        if (reg_write(st.reg->int_enable, 1, &data))
             return -1;
         data = 0;
-        if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &data))
+        if (reg_write(st.reg->fifo_en, 1, &data))
             return -1;
     } else {
         data = BIT_FIFO_RST;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (reg_write(st.reg->user_ctrl, 1, &data))
             return -1;
         if (st.chip_cfg.bypass_mode || !(st.chip_cfg.sensors & INV_XYZ_COMPASS))
             data = BIT_FIFO_EN;
         else
             data = BIT_FIFO_EN | BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &data))
+        if (reg_write(st.reg->user_ctrl, 1, &data))
             return -1;
         delay_ms(50);
         if (st.chip_cfg.int_enable)
             data = BIT_DATA_RDY_EN;
         else
             data = 0;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, &data))
+        if (reg_write(st.reg->int_enable, 1, &data))
             return -1;
-        if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, &st.chip_cfg.fifo_enable))
+        if (reg_write(st.reg->fifo_en, 1, &st.chip_cfg.fifo_enable))
             return -1;
     }
     return 0;
@@ -1140,7 +1360,7 @@ int mpu_set_gyro_fsr(unsigned short fsr)
 
     if (st.chip_cfg.gyro_fsr == (data >> 3))
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->gyro_cfg, 1, &data))
+    if (reg_write(st.reg->gyro_cfg, 1, &data))
         return -1;
     st.chip_cfg.gyro_fsr = data >> 3;
     return 0;
@@ -1205,7 +1425,7 @@ int mpu_set_accel_fsr(unsigned char fsr)
 
     if (st.chip_cfg.accel_fsr == (data >> 3))
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, &data))
+    if (reg_write(st.reg->accel_cfg, 1, &data))
         return -1;
     st.chip_cfg.accel_fsr = data >> 3;
     return 0;
@@ -1274,7 +1494,7 @@ int mpu_set_lpf(unsigned short lpf)
 
     if (st.chip_cfg.lpf == data)
         return 0;
-    if (i2c_write(st.hw->addr, st.reg->lpf, 1, &data))
+    if (reg_write(st.reg->lpf, 1, &data))
         return -1;
     st.chip_cfg.lpf = data;
     return 0;
@@ -1327,7 +1547,7 @@ int mpu_set_sample_rate(unsigned short rate)
             rate = 1000;
 
         data = 1000 / rate - 1;
-        if (i2c_write(st.hw->addr, st.reg->rate_div, 1, &data))
+        if (reg_write(st.reg->rate_div, 1, &data))
             return -1;
 
         st.chip_cfg.sample_rate = 1000 / (1 + data);
@@ -1377,7 +1597,7 @@ int mpu_set_compass_sample_rate(unsigned short rate)
         return -1;
 
     div = st.chip_cfg.sample_rate / rate - 1;
-    if (i2c_write(st.hw->addr, st.reg->s4_ctrl, 1, &div))
+    if (reg_write(st.reg->s4_ctrl, 1, &div))
         return -1;
     st.chip_cfg.compass_sample_rate = st.chip_cfg.sample_rate / (div + 1);
     return 0;
@@ -1538,7 +1758,7 @@ int mpu_set_sensors(unsigned char sensors)
         data = 0;
     else
         data = BIT_SLEEP;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, &data)) {
+    if (reg_write(st.reg->pwr_mgmt_1, 1, &data)) {
         st.chip_cfg.sensors = 0;
         return -1;
     }
@@ -1553,7 +1773,7 @@ int mpu_set_sensors(unsigned char sensors)
         data |= BIT_STBY_ZG;
     if (!(sensors & INV_XYZ_ACCEL))
         data |= BIT_STBY_XYZA;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_2, 1, &data)) {
+    if (reg_write(st.reg->pwr_mgmt_2, 1, &data)) {
         st.chip_cfg.sensors = 0;
         return -1;
     }
@@ -1569,7 +1789,7 @@ int mpu_set_sensors(unsigned char sensors)
     else
         mpu_set_bypass(0);
 #else
-    if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &user_ctrl))
+    if (reg_read(st.reg->user_ctrl, 1, &user_ctrl))
         return -1;
     /* Handle AKM power management. */
     if (sensors & INV_XYZ_COMPASS) {
@@ -1583,10 +1803,10 @@ int mpu_set_sensors(unsigned char sensors)
         user_ctrl |= BIT_DMP_EN;
     else
         user_ctrl &= ~BIT_DMP_EN;
-    if (i2c_write(st.hw->addr, st.reg->s1_do, 1, &data))
+    if (reg_write(st.reg->s1_do, 1, &data))
         return -1;
     /* Enable/disable I2C master mode. */
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &user_ctrl))
+    if (reg_write(st.reg->user_ctrl, 1, &user_ctrl))
         return -1;
 #endif
 #endif
@@ -1607,7 +1827,7 @@ int mpu_get_int_status(short *status)
     unsigned char tmp[2];
     if (!st.chip_cfg.sensors)
         return -1;
-    if (i2c_read(st.hw->addr, st.reg->dmp_int_status, 2, tmp))
+    if (reg_read(st.reg->dmp_int_status, 2, tmp))
         return -1;
     status[0] = (tmp[0] << 8) | tmp[1];
     return 0;
@@ -1657,7 +1877,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     if (st.chip_cfg.fifo_enable & INV_XYZ_ACCEL)
         packet_size += 6;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, data))
+    if (reg_read(st.reg->fifo_count_h, 2, data))
         return -1;
     fifo_count = (data[0] << 8) | data[1];
     if (fifo_count < packet_size)
@@ -1665,7 +1885,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
 //    log_i("FIFO count: %hd\n", fifo_count);
     if (fifo_count > (st.hw->max_fifo >> 1)) {
         /* FIFO is 50% full, better check overflow bit. */
-        if (i2c_read(st.hw->addr, st.reg->int_status, 1, data))
+        if (reg_read(st.reg->int_status, 1, data))
             return -1;
         if (data[0] & BIT_FIFO_OVERFLOW) {
             mpu_reset_fifo();
@@ -1674,7 +1894,7 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
     }
     get_ms((unsigned long*)timestamp);
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_r_w, packet_size, data))
+    if (reg_read(st.reg->fifo_r_w, packet_size, data))
         return -1;
     more[0] = fifo_count / packet_size - 1;
     sensors[0] = 0;
@@ -1715,33 +1935,94 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
 int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
     unsigned char *more)
 {
-    unsigned char tmp[2];
     unsigned short fifo_count;
+    unsigned char overflow;
     if (!st.chip_cfg.dmp_on)
         return -1;
-    if (!st.chip_cfg.sensors)
-        return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, tmp))
+    if (mpu_get_fifo_count(&fifo_count, &overflow))
         return -1;
-    fifo_count = (tmp[0] << 8) | tmp[1];
     if (fifo_count < length) {
         more[0] = 0;
         return -1;
     }
-    if (fifo_count > (st.hw->max_fifo >> 1)) {
+    if (overflow) {
+        mpu_reset_fifo();
+        return -2;
+    }
+
+    if (mpu_read_fifo_raw(length, data))
+        return -1;
+    more[0] = fifo_count / length - 1;
+    return 0;
+}
+
+/**
+ *  @brief      Get the number of bytes waiting in the FIFO.
+ *  If the FIFO is more than half full, the overflow bit is checked as well.
+ *  Unlike @e mpu_read_fifo_stream, the FIFO is not reset on overflow.
+ *  @param[out] count       Number of bytes in the FIFO.
+ *  @param[out] overflow    1 if the FIFO has overflowed. Null if not needed.
+ *  @return     0 if successful.
+ */
+int mpu_get_fifo_count(unsigned short *count, unsigned char *overflow)
+{
+    unsigned char tmp[2];
+
+    if (!st.chip_cfg.sensors)
+        return -1;
+
+    if (reg_read(st.reg->fifo_count_h, 2, tmp))
+        return -1;
+    count[0] = (tmp[0] << 8) | tmp[1];
+
+    if (!overflow)
+        return 0;
+    overflow[0] = 0;
+    if (count[0] > (st.hw->max_fifo >> 1)) {
         /* FIFO is 50% full, better check overflow bit. */
-        if (i2c_read(st.hw->addr, st.reg->int_status, 1, tmp))
+        if (reg_read(st.reg->int_status, 1, tmp))
             return -1;
-        if (tmp[0] & BIT_FIFO_OVERFLOW) {
-            mpu_reset_fifo();
-            return -2;
-        }
+        if (tmp[0] & BIT_FIFO_OVERFLOW)
+            overflow[0] = 1;
     }
+    return 0;
+}
+
+/**
+ *  @brief      Read raw bytes from the FIFO.
+ *  No packet framing is applied. Long reads are split into multiple bus
+ *  transactions.
+ *  @param[in]  length  Number of bytes to read.
+ *  @param[out] data    FIFO bytes.
+ *  @return     0 if successful.
+ */
+int mpu_read_fifo_raw(unsigned short length, unsigned char *data)
+{
+    unsigned short this_read;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_r_w, length, data))
+    if (!st.chip_cfg.sensors)
         return -1;
-    more[0] = fifo_count / length - 1;
+
+    while (length) {
+        this_read = min(length, 255);
+        if (reg_read(st.reg->fifo_r_w, this_read, data))
+            return -1;
+        data += this_read;
+        length -= this_read;
+    }
+    return 0;
+}
+
+/**
+ *  @brief      Get the number of FIFO resets since power-up.
+ *  Any data buffered from the FIFO before the count changed is stale.
+ *  @param[out] count   Number of calls to @e mpu_reset_fifo.
+ *  @return     0 if successful.
+ */
+int mpu_get_fifo_reset_count(unsigned long *count)
+{
+    count[0] = st.fifo_resets;
     return 0;
 }
 
@@ -1758,10 +2039,10 @@ int mpu_set_bypass(unsigned char bypass_on)
         return 0;
 
     if (bypass_on) {
-        if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (reg_read(st.reg->user_ctrl, 1, &tmp))
             return -1;
         tmp &= ~BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (reg_write(st.reg->user_ctrl, 1, &tmp))
             return -1;
         delay_ms(3);
         tmp = BIT_BYPASS_EN;
@@ -1769,17 +2050,17 @@ int mpu_set_bypass(unsigned char bypass_on)
             tmp |= BIT_ACTL;
         if (st.chip_cfg.latched_int)
             tmp |= BIT_LATCH_EN | BIT_ANY_RD_CLR;
-        if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+        if (reg_write(st.reg->int_pin_cfg, 1, &tmp))
             return -1;
     } else {
         /* Enable I2C master mode if compass is being used. */
-        if (i2c_read(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (reg_read(st.reg->user_ctrl, 1, &tmp))
             return -1;
         if (st.chip_cfg.sensors & INV_XYZ_COMPASS)
             tmp |= BIT_AUX_IF_EN;
         else
             tmp &= ~BIT_AUX_IF_EN;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, &tmp))
+        if (reg_write(st.reg->user_ctrl, 1, &tmp))
             return -1;
         delay_ms(3);
         if (st.chip_cfg.active_low_int)
@@ -1788,7 +2069,7 @@ int mpu_set_bypass(unsigned char bypass_on)
             tmp = 0;
         if (st.chip_cfg.latched_int)
             tmp |= BIT_LATCH_EN | BIT_ANY_RD_CLR;
-        if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+        if (reg_write(st.reg->int_pin_cfg, 1, &tmp))
             return -1;
     }
     st.chip_cfg.bypass_mode = bypass_on;
@@ -1826,7 +2107,7 @@ int mpu_set_int_latched(unsigned char enable)
         tmp |= BIT_BYPASS_EN;
     if (st.chip_cfg.active_low_int)
         tmp |= BIT_ACTL;
-    if (i2c_write(st.hw->addr, st.reg->int_pin_cfg, 1, &tmp))
+    if (reg_write(st.reg->int_pin_cfg, 1, &tmp))
         return -1;
     st.chip_cfg.latched_int = enable;
     return 0;
@@ -1837,7 +2118,7 @@ static int get_accel_prod_shift(float *st_shift)
 {
     unsigned char tmp[4], shift_code[3], ii;
 
-    if (i2c_read(st.hw->addr, 0x0D, 4, tmp))
+    if (reg_read(0x0D, 4, tmp))
         return 0x07;
 
     shift_code[0] = ((tmp[0] & 0xE0) >> 3) | ((tmp[3] & 0x30) >> 4);
@@ -1884,7 +2165,7 @@ static int gyro_self_test(long *bias_regular, long *bias_st)
     unsigned char tmp[3];
     float st_shift, st_shift_cust, st_shift_var;
 
-    if (i2c_read(st.hw->addr, 0x0D, 3, tmp))
+    if (reg_read(0x0D, 3, tmp))
         return 0x07;
 
     tmp[0] &= 0x1F;
@@ -1970,60 +2251,60 @@ static int get_st_biases(long *gyro, long *accel, unsigned char hw_test)
 
     data[0] = 0x01;
     data[1] = 0;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, data))
+    if (reg_write(st.reg->pwr_mgmt_1, 2, data))
         return -1;
     delay_ms(200);
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+    if (reg_write(st.reg->int_enable, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (reg_write(st.reg->fifo_en, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+    if (reg_write(st.reg->pwr_mgmt_1, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->i2c_mst, 1, data))
+    if (reg_write(st.reg->i2c_mst, 1, data))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (reg_write(st.reg->user_ctrl, 1, data))
         return -1;
     data[0] = BIT_FIFO_RST | BIT_DMP_RST;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (reg_write(st.reg->user_ctrl, 1, data))
         return -1;
     delay_ms(15);
     data[0] = st.test->reg_lpf;
-    if (i2c_write(st.hw->addr, st.reg->lpf, 1, data))
+    if (reg_write(st.reg->lpf, 1, data))
         return -1;
     data[0] = st.test->reg_rate_div;
-    if (i2c_write(st.hw->addr, st.reg->rate_div, 1, data))
+    if (reg_write(st.reg->rate_div, 1, data))
         return -1;
     if (hw_test)
         data[0] = st.test->reg_gyro_fsr | 0xE0;
     else
         data[0] = st.test->reg_gyro_fsr;
-    if (i2c_write(st.hw->addr, st.reg->gyro_cfg, 1, data))
+    if (reg_write(st.reg->gyro_cfg, 1, data))
         return -1;
 
     if (hw_test)
         data[0] = st.test->reg_accel_fsr | 0xE0;
     else
         data[0] = test.reg_accel_fsr;
-    if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, data))
+    if (reg_write(st.reg->accel_cfg, 1, data))
         return -1;
     if (hw_test)
         delay_ms(200);
 
     /* Fill FIFO for test.wait_ms milliseconds. */
     data[0] = BIT_FIFO_EN;
-    if (i2c_write(st.hw->addr, st.reg->user_ctrl, 1, data))
+    if (reg_write(st.reg->user_ctrl, 1, data))
         return -1;
 
     data[0] = INV_XYZ_GYRO | INV_XYZ_ACCEL;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (reg_write(st.reg->fifo_en, 1, data))
         return -1;
     delay_ms(test.wait_ms);
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->fifo_en, 1, data))
+    if (reg_write(st.reg->fifo_en, 1, data))
         return -1;
 
-    if (i2c_read(st.hw->addr, st.reg->fifo_count_h, 2, data))
+    if (reg_read(st.reg->fifo_count_h, 2, data))
         return -1;
 
     fifo_count = (data[0] << 8) | data[1];
@@ -2033,7 +2314,7 @@ static int get_st_biases(long *gyro, long *accel, unsigned char hw_test)
 
     for (ii = 0; ii < packet_count; ii++) {
         short accel_cur[3], gyro_cur[3];
-        if (i2c_read(st.hw->addr, st.reg->fifo_r_w, MAX_PACKET_LENGTH, data))
+        if (reg_read(st.reg->fifo_r_w, MAX_PACKET_LENGTH, data))
             return -1;
         accel_cur[0] = ((short)data[0] << 8) | data[1];
         accel_cur[1] = ((short)data[2] << 8) | data[3];
@@ -2221,9 +2502,9 @@ int mpu_write_mem(unsigned short mem_addr, unsigned short length,
     if (tmp[1] + length > st.hw->bank_size)
         return -1;
 
-    if (i2c_write(st.hw->addr, st.reg->bank_sel, 2, tmp))
+    if (reg_write(st.reg->bank_sel, 2, tmp))
         return -1;
-    if (i2c_write(st.hw->addr, st.reg->mem_r_w, length, data))
+    if (reg_write(st.reg->mem_r_w, length, data))
         return -1;
     return 0;
 }
@@ -2254,9 +2535,9 @@ int mpu_read_mem(unsigned short mem_addr, unsigned short length,
     if (tmp[1] + length > st.hw->bank_size)
         return -1;
 
-    if (i2c_write(st.hw->addr, st.reg->bank_sel, 2, tmp))
+    if (reg_write(st.reg->bank_sel, 2, tmp))
         return -1;
-    if (i2c_read(st.hw->addr, st.reg->mem_r_w, length, data))
+    if (reg_read(st.reg->mem_r_w, length, data))
         return -1;
     return 0;
 }
@@ -2297,7 +2578,7 @@ int mpu_load_firmware(unsigned short length, const unsigned char *firmware,
     /* Set program start address. */
     tmp[0] = start_addr >> 8;
     tmp[1] = start_addr & 0xFF;
-    if (i2c_write(st.hw->addr, st.reg->prgm_start_h, 2, tmp))
+    if (reg_write(st.reg->prgm_start_h, 2, tmp))
         return -1;
 
     st.chip_cfg.dmp_loaded = 1;
@@ -2327,7 +2608,7 @@ int mpu_set_dmp_state(unsigned char enable)
         mpu_set_sample_rate(st.chip_cfg.dmp_sample_rate);
         /* Remove FIFO elements. */
         tmp = 0;
-        i2c_write(st.hw->addr, 0x23, 1, &tmp);
+        reg_write(0x23, 1, &tmp);
         st.chip_cfg.dmp_on = 1;
         /* Enable DMP interrupt. */
         set_int_enable(1);
@@ -2337,7 +2618,7 @@ int mpu_set_dmp_state(unsigned char enable)
         set_int_enable(0);
         /* Restore FIFO settings. */
         tmp = st.chip_cfg.fifo_enable;
-        i2c_write(st.hw->addr, 0x23, 1, &tmp);
+        reg_write(0x23, 1, &tmp);
         st.chip_cfg.dmp_on = 0;
         mpu_reset_fifo();
     }
@@ -2406,53 +2687,53 @@ static int setup_compass(void)
 
     /* Set up master mode, master clock, and ES bit. */
     data[0] = 0x40;
-    if (i2c_write(st.hw->addr, st.reg->i2c_mst, 1, data))
+    if (reg_write(st.reg->i2c_mst, 1, data))
         return -1;
 
     /* Slave 0 reads from AKM data registers. */
     data[0] = BIT_I2C_READ | st.chip_cfg.compass_addr;
-    if (i2c_write(st.hw->addr, st.reg->s0_addr, 1, data))
+    if (reg_write(st.reg->s0_addr, 1, data))
         return -1;
 
     /* Compass reads start at this register. */
     data[0] = AKM_REG_ST1;
-    if (i2c_write(st.hw->addr, st.reg->s0_reg, 1, data))
+    if (reg_write(st.reg->s0_reg, 1, data))
         return -1;
 
     /* Enable slave 0, 8-byte reads. */
     data[0] = BIT_SLAVE_EN | 8;
-    if (i2c_write(st.hw->addr, st.reg->s0_ctrl, 1, data))
+    if (reg_write(st.reg->s0_ctrl, 1, data))
         return -1;
 
     /* Slave 1 changes AKM measurement mode. */
     data[0] = st.chip_cfg.compass_addr;
-    if (i2c_write(st.hw->addr, st.reg->s1_addr, 1, data))
+    if (reg_write(st.reg->s1_addr, 1, data))
         return -1;
 
     /* AKM measurement mode register. */
     data[0] = AKM_REG_CNTL;
-    if (i2c_write(st.hw->addr, st.reg->s1_reg, 1, data))
+    if (reg_write(st.reg->s1_reg, 1, data))
         return -1;
 
     /* Enable slave 1, 1-byte writes. */
     data[0] = BIT_SLAVE_EN | 1;
-    if (i2c_write(st.hw->addr, st.reg->s1_ctrl, 1, data))
+    if (reg_write(st.reg->s1_ctrl, 1, data))
         return -1;
 
     /* Set slave 1 data. */
     data[0] = AKM_SINGLE_MEASUREMENT;
-    if (i2c_write(st.hw->addr, st.reg->s1_do, 1, data))
+    if (reg_write(st.reg->s1_do, 1, data))
         return -1;
 
     /* Trigger slave 0 and slave 1 actions at each sample. */
     data[0] = 0x03;
-    if (i2c_write(st.hw->addr, st.reg->i2c_delay_ctrl, 1, data))
+    if (reg_write(st.reg->i2c_delay_ctrl, 1, data))
         return -1;
 
 #ifdef MPU9150
     /* For the MPU9150, the auxiliary I2C bus needs to be set to VDD. */
     data[0] = BIT_I2C_MST_VDDIO;
-    if (i2c_write(st.hw->addr, st.reg->yg_offs_tc, 1, data))
+    if (reg_write(st.reg->yg_offs_tc, 1, data))
         return -1;
 #endif
 
@@ -2483,7 +2764,7 @@ int mpu_get_compass_reg(short *data, unsigned long *timestamp)
     if (i2c_write(st.chip_cfg.compass_addr, AKM_REG_CNTL, 1, tmp+8))
         return -1;
 #else
-    if (i2c_read(st.hw->addr, st.reg->raw_compass, 8, tmp))
+    if (reg_read(st.reg->raw_compass, 8, tmp))
         return -1;
 #endif
 
@@ -2642,7 +2923,7 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
          * reading.
          */
         data[0] = INV_FILTER_256HZ_NOLPF2;
-        if (i2c_write(st.hw->addr, st.reg->lpf, 1, data))
+        if (reg_write(st.reg->lpf, 1, data))
             return -1;
 
         /* NOTE: Digital high pass filter should be configured here. Since this
@@ -2653,19 +2934,20 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         /* Configure the device to send motion interrupts. */
         /* Enable motion interrupt. */
         data[0] = BIT_MOT_INT_EN;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+        if (reg_write(st.reg->int_enable, 1, data))
             goto lp_int_restore;
 
         /* Set motion interrupt parameters. */
         data[0] = thresh_hw;
         data[1] = time;
-        if (i2c_write(st.hw->addr, st.reg->motion_thr, 2, data))
+        if (reg_write(st.reg->motion_thr, 2, data))
             goto lp_int_restore;
 
         /* Force hardware to "lock" current accel sample. */
         delay_ms(5);
+        reg_shadow_invalidate(st.reg->accel_cfg, 1);
         data[0] = (st.chip_cfg.accel_fsr << 3) | BITS_HPF;
-        if (i2c_write(st.hw->addr, st.reg->accel_cfg, 1, data))
+        if (reg_write(st.reg->accel_cfg, 1, data))
             goto lp_int_restore;
 
         /* Set up LP accel mode. */
@@ -2679,7 +2961,7 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         else
             data[1] = INV_LPA_40HZ;
         data[1] = (data[1] << 6) | BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 2, data))
+        if (reg_write(st.reg->pwr_mgmt_1, 2, data))
             goto lp_int_restore;
 
         st.chip_cfg.int_motion_only = 1;
@@ -2692,12 +2974,12 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
         data[0] = 0;
         data[1] = 0;
         data[2] = BIT_STBY_XYZG;
-        if (i2c_write(st.hw->addr, st.reg->user_ctrl, 3, data))
+        if (reg_write(st.reg->user_ctrl, 3, data))
             goto lp_int_restore;
 
         /* Set motion threshold. */
         data[0] = thresh_hw;
-        if (i2c_write(st.hw->addr, st.reg->motion_thr, 1, data))
+        if (reg_write(st.reg->motion_thr, 1, data))
             goto lp_int_restore;
 
         /* Set wake frequency. */
@@ -2721,22 +3003,22 @@ int mpu_lp_motion_interrupt(unsigned short thresh, unsigned char time,
             data[0] = INV_LPA_320HZ;
         else
             data[0] = INV_LPA_640HZ;
-        if (i2c_write(st.hw->addr, st.reg->lp_accel_odr, 1, data))
+        if (reg_write(st.reg->lp_accel_odr, 1, data))
             goto lp_int_restore;
 
         /* Enable motion interrupt (MPU6500 version). */
         data[0] = BITS_WOM_EN;
-        if (i2c_write(st.hw->addr, st.reg->accel_intel, 1, data))
+        if (reg_write(st.reg->accel_intel, 1, data))
             goto lp_int_restore;
 
         /* Enable cycle mode. */
         data[0] = BIT_LPA_CYCLE;
-        if (i2c_write(st.hw->addr, st.reg->pwr_mgmt_1, 1, data))
+        if (reg_write(st.reg->pwr_mgmt_1, 1, data))
             goto lp_int_restore;
 
         /* Enable interrupt. */
         data[0] = BIT_MOT_INT_EN;
-        if (i2c_write(st.hw->addr, st.reg->int_enable, 1, data))
+        if (reg_write(st.reg->int_enable, 1, data))
             goto lp_int_restore;
 
         st.chip_cfg.int_motion_only = 1;
@@ -2775,7 +3057,7 @@ lp_int_restore:
 #ifdef MPU6500
     /* Disable motion interrupt (MPU6500 version). */
     data[0] = 0;
-    if (i2c_write(st.hw->addr, st.reg->accel_intel, 1, data))
+    if (reg_write(st.reg->accel_intel, 1, data))
         goto lp_int_restore;
 #endif
 
@@ -112,6 +112,9 @@ int mpu_read_fifo(short *gyro, short *accel, unsigned long *timestamp,
 int mpu_read_fifo_stream(unsigned short length, unsigned char *data,
     unsigned char *more);
 int mpu_reset_fifo(void);
+int mpu_get_fifo_count(unsigned short *count, unsigned char *overflow);
+int mpu_read_fifo_raw(unsigned short length, unsigned char *data);
+int mpu_get_fifo_reset_count(unsigned long *count);
 
 int mpu_write_mem(unsigned short mem_addr, unsigned short length,
     unsigned char *data);
@@ -122,6 +125,8 @@ int mpu_load_firmware(unsigned short length, const unsigned char *firmware,
 
 int mpu_reg_dump(void);
 int mpu_read_reg(unsigned char reg, unsigned char *data);
+int mpu_get_reg_shadow_stats(unsigned long *skipped_writes,
+    unsigned long *cached_reads);
 int mpu_run_self_test(long *gyro, long *accel);
 int mpu_register_tap_cb(void (*func)(unsigned char, unsigned char));
 
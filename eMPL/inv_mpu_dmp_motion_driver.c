@@ -478,6 +478,22 @@ static const unsigned short sStartAddress = 0x0400;
 #define QUAT_MAG_SQ_MAX         (QUAT_MAG_SQ_NORMALIZED + QUAT_ERROR_THRESH)
 #endif
 
+/* Host-side copy of FIFO data used when resynchronization is enabled. Bytes
+ * are pulled from the hardware FIFO in bulk and handed out one packet at a
+ * time.
+ */
+#define FIFO_BUF_LENGTH     (16 * MAX_PACKET_LENGTH)
+
+struct dmp_fifo_s {
+    unsigned char data[FIFO_BUF_LENGTH];
+    /* Bytes in data. */
+    unsigned short length;
+    /* Bytes left in the hardware FIFO after the last bulk read. */
+    unsigned short hw_count;
+    /* Value of mpu_get_fifo_reset_count when data was filled. */
+    unsigned long resets_seen;
+};
+
 struct dmp_s {
     void (*tap_cb)(unsigned char count, unsigned char direction);
     void (*android_orient_cb)(unsigned char orientation);
@@ -485,6 +501,9 @@ struct dmp_s {
     unsigned short feature_mask;
     unsigned short fifo_rate;
     unsigned char packet_length;
+    unsigned char resync;
+    struct dmp_fifo_s fifo;
+    struct dmp_fifo_stats_s stats;
 };
 
 static struct dmp_s dmp = {
@@ -493,7 +512,8 @@ static struct dmp_s dmp = {
     .orient = 0,
     .feature_mask = 0,
     .fifo_rate = 0,
-    .packet_length = 0
+    .packet_length = 0,
+    .resync = 0
 };
 
 /**
@@ -1236,6 +1256,246 @@ int dmp_set_interrupt_mode(unsigned char mode)
     }
 }
 
+#ifdef FIFO_CORRUPTION_CHECK
+/**
+ *  @brief      Check the quaternion at the start of a DMP packet.
+ *  The DMP always outputs a normalized quaternion. If the magnitude is off,
+ *  the packet is not aligned with the FIFO data.
+ *  @param[in]  data    Start of a DMP packet.
+ *  @return     1 if the quaternion is normalized.
+ */
+static int quat_is_valid(const unsigned char *data)
+{
+    long quat_q14[4], quat_mag_sq;
+    unsigned char ii;
+
+    /* Let's start by scaling down the quaternion data to avoid long long
+     * math.
+     */
+    for (ii = 0; ii < 4; ii++)
+        quat_q14[ii] = (long)(short)((data[ii * 4] << 8) | data[ii * 4 + 1]);
+
+    quat_mag_sq = quat_q14[0] * quat_q14[0] + quat_q14[1] * quat_q14[1] +
+        quat_q14[2] * quat_q14[2] + quat_q14[3] * quat_q14[3];
+    return (quat_mag_sq >= QUAT_MAG_SQ_MIN) && (quat_mag_sq <= QUAT_MAG_SQ_MAX);
+}
+#endif
+
+/**
+ *  @brief      Discard bytes from the front of the host FIFO buffer.
+ *  @param[in]  length  Number of bytes to drop.
+ */
+static void fifo_buf_drop(unsigned short length)
+{
+    if (length >= dmp.fifo.length) {
+        dmp.fifo.length = 0;
+        return;
+    }
+    dmp.fifo.length -= length;
+    memmove(dmp.fifo.data, dmp.fifo.data + length, dmp.fifo.length);
+}
+
+/**
+ *  @brief      Top up the host FIFO buffer from the hardware FIFO.
+ *  Reads all whole packets waiting in the hardware FIFO (plus whatever is
+ *  needed to complete a partial packet already in the buffer) in a single
+ *  burst, up to the size of the buffer.
+ *  @param[out] overflow    1 if the hardware FIFO had overflowed.
+ *  @return     0 if successful.
+ */
+static int fifo_buf_fill(unsigned char *overflow)
+{
+    unsigned short fifo_count, length, room;
+    unsigned long resets;
+
+    overflow[0] = 0;
+
+    /* Anything buffered before a FIFO reset is stale. */
+    mpu_get_fifo_reset_count(&resets);
+    if (resets != dmp.fifo.resets_seen) {
+        dmp.fifo.length = 0;
+        dmp.fifo.resets_seen = resets;
+    }
+
+    if (mpu_get_fifo_count(&fifo_count, overflow))
+        return -1;
+    if (overflow[0])
+        dmp.stats.overflows++;
+
+    length = dmp.fifo.length + fifo_count;
+    length -= length % dmp.packet_length;
+    room = FIFO_BUF_LENGTH - (FIFO_BUF_LENGTH % dmp.packet_length);
+    if (length > room)
+        length = room;
+    if (length <= dmp.fifo.length) {
+        dmp.fifo.hw_count = fifo_count;
+        return 0;
+    }
+    length -= dmp.fifo.length;
+
+    if (mpu_read_fifo_raw(length, dmp.fifo.data + dmp.fifo.length))
+        return -1;
+    dmp.fifo.length += length;
+    dmp.fifo.hw_count = fifo_count - length;
+    return 0;
+}
+
+/**
+ *  @brief      Realign the host FIFO buffer on a packet boundary.
+ *  The packet at the front of the buffer failed the quaternion check. Search
+ *  the following bytes for the first offset where consecutive packets carry
+ *  normalized quaternions and drop everything before it. If no such offset
+ *  exists, fall back to resetting the FIFO.
+ *  @return     0 if the buffer was realigned.
+ */
+static int fifo_resync(void)
+{
+#ifdef FIFO_CORRUPTION_CHECK
+    unsigned short offset;
+    unsigned char overflow;
+    unsigned char len = dmp.packet_length;
+
+    if (!(dmp.feature_mask & (DMP_FEATURE_LP_QUAT | DMP_FEATURE_6X_LP_QUAT)))
+        goto resync_failed;
+
+    /* Pull in everything that is available to have more candidates. */
+    if (fifo_buf_fill(&overflow))
+        goto resync_failed;
+
+    for (offset = 1; offset + len <= dmp.fifo.length; offset++) {
+        if (!quat_is_valid(dmp.fifo.data + offset))
+            continue;
+        /* Confirm with the next packet if it has arrived. */
+        if ((offset + 2 * len <= dmp.fifo.length) &&
+            !quat_is_valid(dmp.fifo.data + offset + len))
+            continue;
+        fifo_buf_drop(offset);
+        dmp.stats.resyncs++;
+        dmp.stats.bytes_dropped += offset;
+        return 0;
+    }
+
+resync_failed:
+#endif
+    dmp.stats.resets++;
+    dmp.stats.bytes_dropped += dmp.fifo.length;
+    dmp.fifo.length = 0;
+    mpu_reset_fifo();
+    return -1;
+}
+
+/**
+ *  @brief      Get one packet through the host FIFO buffer.
+ *  Used instead of @e mpu_read_fifo_stream when resynchronization is
+ *  enabled.
+ *  @param[out] data    FIFO packet.
+ *  @param[out] more    Number of remaining packets.
+ *  @return     0 if successful.
+ */
+static int fifo_buf_read(unsigned char *data, unsigned char *more)
+{
+    unsigned char overflow;
+    unsigned short remaining;
+    unsigned char len = dmp.packet_length;
+
+    if (!len)
+        return -1;
+
+    if (dmp.fifo.length < len) {
+        if (fifo_buf_fill(&overflow))
+            return -1;
+#ifndef FIFO_CORRUPTION_CHECK
+        /* Without the quaternion check there is no way to find the packet
+         * boundary again after an overflow.
+         */
+        if (overflow) {
+            fifo_resync();
+            return -2;
+        }
+#endif
+        if (dmp.fifo.length < len) {
+            more[0] = 0;
+            return -1;
+        }
+    }
+
+#ifdef FIFO_CORRUPTION_CHECK
+    if ((dmp.feature_mask & (DMP_FEATURE_LP_QUAT | DMP_FEATURE_6X_LP_QUAT)) &&
+        !quat_is_valid(dmp.fifo.data)) {
+        dmp.stats.corrupt_packets++;
+        if (fifo_resync())
+            return -1;
+    }
+#endif
+
+    memcpy(data, dmp.fifo.data, len);
+    fifo_buf_drop(len);
+
+    remaining = (dmp.fifo.length + dmp.fifo.hw_count) / len;
+    more[0] = (remaining > 255) ? 255 : remaining;
+    return 0;
+}
+
+/**
+ *  @brief      Enable/disable FIFO resynchronization.
+ *  By default, a corrupted packet or a FIFO overflow resets the FIFO and all
+ *  queued data is lost. With resynchronization enabled, FIFO data is read in
+ *  bulk into a host buffer and a misaligned stream is realigned on the next
+ *  packet boundary using the quaternion magnitude. The FIFO is only reset if
+ *  no boundary can be found.
+ *  \n Requires DMP_FEATURE_LP_QUAT or DMP_FEATURE_6X_LP_QUAT.
+ *  @param[in]  enable  1 to enable resynchronization.
+ *  @return     0 if successful.
+ */
+int dmp_set_fifo_resync(unsigned char enable)
+{
+    dmp.resync = enable;
+    dmp.fifo.length = 0;
+    mpu_get_fifo_reset_count(&dmp.fifo.resets_seen);
+    return 0;
+}
+
+/**
+ *  @brief      Get the number of complete packets waiting to be read.
+ *  Counts packets in the hardware FIFO plus any already buffered on the host.
+ *  Costs a single FIFO_COUNT read.
+ *  @param[out] count   Number of packets.
+ *  @return     0 if successful.
+ */
+int dmp_get_fifo_packet_count(unsigned short *count)
+{
+    unsigned short fifo_count;
+    unsigned long resets;
+
+    if (!dmp.packet_length)
+        return -1;
+    /* Leave INT_STATUS alone, reading it clears the overflow bit before
+     * dmp_read_fifo gets to see it.
+     */
+    if (mpu_get_fifo_count(&fifo_count, NULL))
+        return -1;
+    if (dmp.resync) {
+        mpu_get_fifo_reset_count(&resets);
+        if (resets == dmp.fifo.resets_seen)
+            fifo_count += dmp.fifo.length;
+    }
+    count[0] = fifo_count / dmp.packet_length;
+    return 0;
+}
+
+/**
+ *  @brief      Get FIFO error and recovery counters.
+ *  @param[out] stats   Counters since startup.
+ *  @return     0 if successful.
+ */
+int dmp_get_fifo_stats(struct dmp_fifo_stats_s *stats)
+{
+    if (!stats)
+        return -1;
+    memcpy(stats, &dmp.stats, sizeof(struct dmp_fifo_stats_s));
+    return 0;
+}
+
 /**
  *  @brief      Get one packet from the FIFO.
  *  If @e sensors does not contain a particular sensor, disregard the data
@@ -1261,6 +1521,7 @@ int dmp_read_fifo(short *gyro, short *accel, long *quat,
 {
     unsigned char fifo_data[MAX_PACKET_LENGTH];
     unsigned char ii = 0;
+    int result;
 
     /* TODO: sensors[0] only changes when dmp_enable_feature is called. We can
      * cache this value and save some cycles.
@@ -1268,14 +1529,20 @@ int dmp_read_fifo(short *gyro, short *accel, long *quat,
     sensors[0] = 0;
 
     /* Get a packet. */
-    if (mpu_read_fifo_stream(dmp.packet_length, fifo_data, more))
+    if (dmp.resync)
+        result = fifo_buf_read(fifo_data, more);
+    else {
+        result = mpu_read_fifo_stream(dmp.packet_length, fifo_data, more);
+        if (result == -2) {
+            dmp.stats.overflows++;
+            dmp.stats.resets++;
+        }
+    }
+    if (result)
         return -1;
 
     /* Parse DMP packet. */
     if (dmp.feature_mask & (DMP_FEATURE_LP_QUAT | DMP_FEATURE_6X_LP_QUAT)) {
-#ifdef FIFO_CORRUPTION_CHECK
-        long quat_q14[4], quat_mag_sq;
-#endif
         quat[0] = ((long)fifo_data[0] << 24) | ((long)fifo_data[1] << 16) |
             ((long)fifo_data[2] << 8) | fifo_data[3];
         quat[1] = ((long)fifo_data[4] << 24) | ((long)fifo_data[5] << 16) |
@@ -1289,20 +1556,13 @@ int dmp_read_fifo(short *gyro, short *accel, long *quat,
         /* We can detect a corrupted FIFO by monitoring the quaternion data and
          * ensuring that the magnitude is always normalized to one. This
          * shouldn't happen in normal operation, but if an I2C error occurs,
-         * the FIFO reads might become misaligned.
-         *
-         * Let's start by scaling down the quaternion data to avoid long long
-         * math.
+         * the FIFO reads might become misaligned. In resync mode the packet
+         * has already been checked.
          */
-        quat_q14[0] = quat[0] >> 16;
-        quat_q14[1] = quat[1] >> 16;
-        quat_q14[2] = quat[2] >> 16;
-        quat_q14[3] = quat[3] >> 16;
-        quat_mag_sq = quat_q14[0] * quat_q14[0] + quat_q14[1] * quat_q14[1] +
-            quat_q14[2] * quat_q14[2] + quat_q14[3] * quat_q14[3];
-        if ((quat_mag_sq < QUAT_MAG_SQ_MIN) ||
-            (quat_mag_sq > QUAT_MAG_SQ_MAX)) {
+        if (!dmp.resync && !quat_is_valid(fifo_data)) {
             /* Quaternion is outside of the acceptable threshold. */
+            dmp.stats.corrupt_packets++;
+            dmp.stats.resets++;
             mpu_reset_fifo();
             sensors[0] = 0;
             return -1;
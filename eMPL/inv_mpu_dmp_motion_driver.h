@@ -49,6 +49,20 @@
 
 #define INV_WXYZ_QUAT       (0x100)
 
+/* FIFO error and recovery counters. */
+struct dmp_fifo_stats_s {
+    /* Packets that failed the quaternion magnitude check. */
+    unsigned long corrupt_packets;
+    /* Hardware FIFO overflows. */
+    unsigned long overflows;
+    /* Recoveries by realigning on a packet boundary. */
+    unsigned long resyncs;
+    /* Recoveries by resetting the FIFO. */
+    unsigned long resets;
+    /* Bytes thrown away while recovering. */
+    unsigned long bytes_dropped;
+};
+
 /* Set up functions. */
 int dmp_load_motion_driver_firmware(void);
 int dmp_set_fifo_rate(unsigned short rate);
@@ -93,5 +107,10 @@ int dmp_enable_gyro_cal(unsigned char enable);
 int dmp_read_fifo(short *gyro, short *accel, long *quat,
     unsigned long *timestamp, short *sensors, unsigned char *more);
 
+/* FIFO recovery functions. */
+int dmp_set_fifo_resync(unsigned char enable);
+int dmp_get_fifo_stats(struct dmp_fifo_stats_s *stats);
+int dmp_get_fifo_packet_count(unsigned short *count);
+
 #endif  /* #ifndef _INV_MPU_DMP_MOTION_DRIVER_H_ */
 
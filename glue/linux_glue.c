@@ -32,6 +32,9 @@
 #include <fcntl.h>
 #include <linux/i2c-dev.h>
 #include "linux_glue.h"
+#include "mpu_sim.h"
+#include "metrics.h"
+#include "i2c_trace.h"
 
 #define MAX_WRITE_LEN 511
 
@@ -42,6 +45,16 @@ int i2c_fd;
 int current_slave;
 unsigned char txBuff[MAX_WRITE_LEN + 1];
 
+// route all bus traffic to the simulator
+int i2c_sim;
+
+
+static int i2c_do_write(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char const *data);
+static int i2c_do_read(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char *data);
+static int trace_flags(int result, int read);
+
 
 void __no_operation(void) { }
 
@@ -107,8 +120,74 @@ void linux_set_i2c_bus(int bus)
 	i2c_bus = bus;
 }
 
+void linux_set_i2c_sim(int on)
+{
+	if (i2c_fd)
+		i2c_close();
+
+	i2c_sim = on;
+}
+
+// The public entry points only time and trace the transfer, see metrics.h
+// and i2c_trace.h
 int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char const *data)
+{
+	uint64_t start, dur;
+	int result;
+
+	start = metrics_now_ns();
+	result = i2c_do_write(slave_addr, reg_addr, length, data);
+	dur = metrics_now_ns() - start;
+
+	metrics_record(MET_I2C_WRITE, dur);
+
+	if (result)
+		metrics_count(MET_I2C_ERRORS, 1);
+
+	i2c_trace_record(start, dur, slave_addr, reg_addr, length, data, trace_flags(result, 0));
+
+	return result;
+}
+
+int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char *data)
+{
+	uint64_t start, dur;
+	int result;
+
+	start = metrics_now_ns();
+	result = i2c_do_read(slave_addr, reg_addr, length, data);
+	dur = metrics_now_ns() - start;
+
+	metrics_record(MET_I2C_READ, dur);
+
+	if (result)
+		metrics_count(MET_I2C_ERRORS, 1);
+
+	i2c_trace_record(start, dur, slave_addr, reg_addr, length, data, trace_flags(result, 1));
+
+	return result;
+}
+
+static int trace_flags(int result, int read)
+{
+	int flags = 0;
+
+	if (read)
+		flags |= I2C_TRACE_READ;
+
+	if (result)
+		flags |= I2C_TRACE_ERROR;
+
+	if (i2c_sim)
+		flags |= I2C_TRACE_SIM;
+
+	return flags;
+}
+
+static int i2c_do_write(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char const *data)
 {
 	int result, i;
 
@@ -117,6 +196,9 @@ int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
 		return -1;
 	}
 
+	if (i2c_sim)
+		return mpu_sim_i2c_write(slave_addr, reg_addr, length, data);
+
 #ifdef I2C_DEBUG
 	printf("\tlinux_i2c_write(%02X, %02X, %u, [", slave_addr, reg_addr, length);
 
@@ -167,7 +249,7 @@ int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
 	return 0;
 }
 
-int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+static int i2c_do_read(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char *data)
 {
 	int tries, result, total;
@@ -178,7 +260,11 @@ int linux_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
 	printf("\tlinux_i2c_read(%02X, %02X, %u, ...)\n", slave_addr, reg_addr, length);
 #endif
 
-	if (linux_i2c_write(slave_addr, reg_addr, 0, NULL))
+	if (i2c_sim)
+		return mpu_sim_i2c_read(slave_addr, reg_addr, length, data);
+
+	// register pointer write, part of this read's time
+	if (i2c_do_write(slave_addr, reg_addr, 0, NULL))
 		return -1;
 
 	total = 0;
@@ -220,6 +306,11 @@ int linux_delay_ms(unsigned long num_ms)
 {
 	struct timespec ts;
 
+	if (i2c_sim && mpu_sim_virtual_clock()) {
+		mpu_sim_advance_ms(num_ms);
+		return 0;
+	}
+
 	ts.tv_sec = num_ms / 1000;
 	ts.tv_nsec = (num_ms % 1000) * 1000000;
 
@@ -233,6 +324,11 @@ int linux_get_ms(unsigned long *count)
 	if (!count)
 		return -1;
 
+	if (i2c_sim && mpu_sim_virtual_clock()) {
+		*count = mpu_sim_get_ms();
+		return 0;
+	}
+
 	if (gettimeofday(&t, NULL) < 0) {
 		perror("gettimeofday");
 		return -1;
@@ -48,6 +48,7 @@ static inline int reg_int_cb(struct int_param_s *int_param)
 void __no_operation(void);
 
 void linux_set_i2c_bus(int bus);
+void linux_set_i2c_sim(int on);
 
 int linux_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
        unsigned char length, unsigned char const *data);
@@ -0,0 +1,790 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "mpu_sim.h"
+
+#define MPU_ADDR		0x68
+#define AKM_ADDR		0x0C
+
+#define NUM_REG			128
+#define MEM_SIZE		4096
+#define FIFO_SIZE		1024
+
+// MPU-6050 registers
+#define REG_ACCEL_OFFS		0x06
+#define REG_RATE_DIV		0x19
+#define REG_CONFIG		0x1A
+#define REG_GYRO_CFG		0x1B
+#define REG_ACCEL_CFG		0x1C
+#define REG_FIFO_EN		0x23
+#define REG_S0_ADDR		0x25
+#define REG_S0_REG		0x26
+#define REG_S0_CTRL		0x27
+#define REG_INT_PIN_CFG		0x37
+#define REG_INT_ENABLE		0x38
+#define REG_DMP_INT_STATUS	0x39
+#define REG_INT_STATUS		0x3A
+#define REG_ACCEL_OUT		0x3B
+#define REG_TEMP_OUT		0x41
+#define REG_GYRO_OUT		0x43
+#define REG_EXT_SENS_DATA	0x49
+#define REG_USER_CTRL		0x6A
+#define REG_PWR_MGMT_1		0x6B
+#define REG_BANK_SEL		0x6D
+#define REG_MEM_START_ADDR	0x6E
+#define REG_MEM_R_W		0x6F
+#define REG_FIFO_COUNT_H	0x72
+#define REG_FIFO_COUNT_L	0x73
+#define REG_FIFO_R_W		0x74
+#define REG_WHO_AM_I		0x75
+
+#define EXT_SENS_DATA_LEN	24
+
+#define BIT_I2C_BYPASS_EN	0x02
+#define BIT_SLAVE_EN		0x80
+#define BIT_I2C_READ		0x80
+
+#define BIT_DMP_EN		0x80
+#define BIT_FIFO_EN		0x40
+#define BIT_I2C_MST_EN		0x20
+#define BIT_FIFO_RST		0x04
+#define BITS_USER_CTRL_RST	0x0F
+
+#define BIT_DEVICE_RESET	0x80
+#define BIT_SLEEP		0x40
+#define BIT_CYCLE		0x20
+
+#define BIT_FIFO_TEMP		0x80
+#define BIT_FIFO_GYRO_X		0x40
+#define BIT_FIFO_GYRO_Y		0x20
+#define BIT_FIFO_GYRO_Z		0x10
+#define BIT_FIFO_ACCEL		0x08
+
+#define INT_DATA_RDY		0x01
+#define INT_DMP			0x02
+#define INT_FIFO_OFLOW		0x10
+#define INT_MOT			0x40
+#define DMP_INT_0		0x01
+
+// DMP memory locations written by inv_mpu_dmp_motion_driver.c that tell
+// which fields the DMP puts in a FIFO packet and at what rate
+#define D_0_22			(22 + 512)
+#define CFG_LP_QUAT		2712
+#define CFG_8			2718
+#define CFG_15			2727
+#define CFG_27			2742
+
+// AK8975 registers
+#define AKM_NUM_REG		0x13
+#define AKM_REG_WIA		0x00
+#define AKM_REG_ST1		0x02
+#define AKM_REG_HXL		0x03
+#define AKM_REG_ST2		0x09
+#define AKM_REG_CNTL		0x0A
+#define AKM_REG_ASAX		0x10
+
+#define AKM_MODE_MASK		0x0F
+#define AKM_SINGLE		0x01
+#define AKM_FUSE_ROM		0x0F
+
+// earth field in AK8975 units (0.3 uT/LSB)
+#define SIM_MAG_HORIZ		100.0f
+#define SIM_MAG_VERT		(-140.0f)
+
+static mpusim_config_t cfg;
+static mpusim_stats_t stats;
+
+static unsigned char regs[NUM_REG];
+static unsigned char mem[MEM_SIZE];
+static unsigned short mem_ptr;
+
+static unsigned char fifo[FIFO_SIZE];
+static unsigned short fifo_head;
+static unsigned short fifo_count;
+
+static unsigned char akm[AKM_NUM_REG];
+
+static unsigned long clock_ms;
+static unsigned long last_update_ms;
+static double pending_packets;
+static double model_time;
+
+static void reset_regs();
+static void update();
+static float model_yaw();
+static float sample_rate();
+static float fifo_rate();
+static int packet_length();
+static void push_packet();
+static void fifo_push(unsigned char c);
+static unsigned char fifo_pop();
+static void model_quat(long *q);
+static void model_accel(short *a);
+static void model_gyro(short *g);
+static void model_mag(short *m);
+static void refresh_sensor_regs();
+static void refresh_ext_sens_data();
+static void akm_measure();
+static void put_be16(unsigned char *p, short v);
+static void put_be32(unsigned char *p, long v);
+static int mpu_write_reg(unsigned char reg, unsigned char val);
+static unsigned char mpu_read_reg(unsigned char reg);
+
+void mpu_sim_init(mpusim_config_t *config)
+{
+	memset(&cfg, 0, sizeof(cfg));
+
+	if (config)
+		memcpy(&cfg, config, sizeof(cfg));
+
+	memset(mem, 0, sizeof(mem));
+	mem_ptr = 0;
+
+	reset_regs();
+
+	memset(akm, 0, sizeof(akm));
+	akm[AKM_REG_WIA] = 0x48;
+	akm[AKM_REG_ASAX] = 128;
+	akm[AKM_REG_ASAX + 1] = 128;
+	akm[AKM_REG_ASAX + 2] = 128;
+
+	clock_ms = 0;
+	last_update_ms = mpu_sim_get_ms();
+	model_time = 0.0;
+
+	mpu_sim_clear_stats();
+}
+
+int mpu_sim_virtual_clock()
+{
+	return cfg.virtual_clock;
+}
+
+void mpu_sim_advance_ms(unsigned long num_ms)
+{
+	clock_ms += num_ms;
+}
+
+unsigned long mpu_sim_get_ms()
+{
+	struct timeval t;
+
+	if (cfg.virtual_clock)
+		return clock_ms;
+
+	gettimeofday(&t, NULL);
+
+	return (t.tv_sec * 1000) + (t.tv_usec / 1000);
+}
+
+void mpu_sim_trigger_motion()
+{
+	regs[REG_INT_STATUS] |= INT_MOT;
+}
+
+void mpu_sim_get_stats(mpusim_stats_t *s)
+{
+	memcpy(s, &stats, sizeof(stats));
+}
+
+void mpu_sim_clear_stats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void mpu_sim_print_stats()
+{
+	printf("\nI2C simulator\n");
+	printf("  transactions   %lu (%lu reads, %lu writes, %lu NAK)\n",
+		stats.transactions, stats.reads, stats.writes, stats.naks);
+	printf("  bytes          %lu read, %lu written\n", stats.bytes_read, stats.bytes_written);
+	printf("  FIFO           %lu bytes read, %lu overflows\n", stats.fifo_bytes_read, stats.fifo_overflows);
+	printf("  DMP memory     %lu bytes\n", stats.mem_bytes);
+	printf("  compass        %lu transactions\n", stats.compass_transactions);
+}
+
+int mpu_sim_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char const *data)
+{
+	unsigned char reg;
+	int i;
+
+	stats.transactions++;
+
+	if (slave_addr == AKM_ADDR) {
+		// only reachable from the host in bypass mode
+		if (!(regs[REG_INT_PIN_CFG] & BIT_I2C_BYPASS_EN) || (regs[REG_USER_CTRL] & BIT_I2C_MST_EN)) {
+			stats.naks++;
+			return -1;
+		}
+
+		stats.writes++;
+		stats.compass_transactions++;
+		stats.bytes_written += length;
+
+		for (i = 0; i < length && reg_addr + i < AKM_NUM_REG; i++) {
+			if (reg_addr + i == AKM_REG_CNTL) {
+				akm[AKM_REG_CNTL] = data[i];
+
+				if ((data[i] & AKM_MODE_MASK) == AKM_SINGLE)
+					akm_measure();
+			}
+		}
+
+		return 0;
+	}
+
+	if (slave_addr != MPU_ADDR) {
+		stats.naks++;
+		return -1;
+	}
+
+	stats.writes++;
+	stats.bytes_written += length;
+
+	update();
+
+	reg = reg_addr;
+
+	for (i = 0; i < length; i++) {
+		if (reg >= NUM_REG)
+			return -1;
+
+		if (mpu_write_reg(reg, data[i]))
+			return -1;
+
+		// the memory and FIFO ports don't auto-increment
+		if (reg != REG_MEM_R_W && reg != REG_FIFO_R_W)
+			reg++;
+	}
+
+	return 0;
+}
+
+int mpu_sim_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char *data)
+{
+	unsigned char reg;
+	int i;
+
+	stats.transactions++;
+
+	if (slave_addr == AKM_ADDR) {
+		if (!(regs[REG_INT_PIN_CFG] & BIT_I2C_BYPASS_EN) || (regs[REG_USER_CTRL] & BIT_I2C_MST_EN)) {
+			stats.naks++;
+			return -1;
+		}
+
+		stats.reads++;
+		stats.compass_transactions++;
+		stats.bytes_read += length;
+
+		for (i = 0; i < length; i++) {
+			reg = reg_addr + i;
+
+			if (reg >= AKM_NUM_REG) {
+				data[i] = 0;
+			}
+			else if (reg >= AKM_REG_ASAX && (akm[AKM_REG_CNTL] & AKM_MODE_MASK) != AKM_FUSE_ROM) {
+				data[i] = 0;
+			}
+			else {
+				data[i] = akm[reg];
+
+				// reading ST2 ends the measurement
+				if (reg == AKM_REG_ST2)
+					akm[AKM_REG_ST1] = 0;
+			}
+		}
+
+		return 0;
+	}
+
+	if (slave_addr != MPU_ADDR) {
+		stats.naks++;
+		return -1;
+	}
+
+	stats.reads++;
+	stats.bytes_read += length;
+
+	update();
+
+	if (reg_addr <= REG_GYRO_OUT + 5 && reg_addr + length > REG_ACCEL_OUT)
+		refresh_sensor_regs();
+
+	if (reg_addr < REG_EXT_SENS_DATA + EXT_SENS_DATA_LEN && reg_addr + length > REG_EXT_SENS_DATA)
+		refresh_ext_sens_data();
+
+	reg = reg_addr;
+
+	for (i = 0; i < length; i++) {
+		if (reg >= NUM_REG)
+			return -1;
+
+		data[i] = mpu_read_reg(reg);
+
+		if (reg != REG_MEM_R_W && reg != REG_FIFO_R_W)
+			reg++;
+	}
+
+	// status registers clear on read
+	if (reg_addr <= REG_INT_STATUS && reg_addr + length > REG_INT_STATUS)
+		regs[REG_INT_STATUS] = 0;
+
+	if (reg_addr <= REG_DMP_INT_STATUS && reg_addr + length > REG_DMP_INT_STATUS)
+		regs[REG_DMP_INT_STATUS] = 0;
+
+	return 0;
+}
+
+static int mpu_write_reg(unsigned char reg, unsigned char val)
+{
+	switch (reg) {
+	case REG_PWR_MGMT_1:
+		if (val & BIT_DEVICE_RESET) {
+			reset_regs();
+			return 0;
+		}
+
+		regs[reg] = val;
+		break;
+
+	case REG_USER_CTRL:
+		if (val & BIT_FIFO_RST) {
+			fifo_head = 0;
+			fifo_count = 0;
+			pending_packets = 0.0;
+		}
+
+		regs[reg] = val & ~BITS_USER_CTRL_RST;
+		break;
+
+	case REG_BANK_SEL:
+		regs[reg] = val;
+		mem_ptr = (val << 8) | (mem_ptr & 0xFF);
+		break;
+
+	case REG_MEM_START_ADDR:
+		regs[reg] = val;
+		mem_ptr = (mem_ptr & 0xFF00) | val;
+		break;
+
+	case REG_MEM_R_W:
+		if (mem_ptr >= MEM_SIZE)
+			return -1;
+
+		mem[mem_ptr++] = val;
+		stats.mem_bytes++;
+		break;
+
+	case REG_FIFO_R_W:
+		fifo_push(val);
+		break;
+
+	case REG_INT_STATUS:
+	case REG_DMP_INT_STATUS:
+	case REG_FIFO_COUNT_H:
+	case REG_FIFO_COUNT_L:
+	case REG_WHO_AM_I:
+		// read only
+		break;
+
+	default:
+		regs[reg] = val;
+		break;
+	}
+
+	return 0;
+}
+
+static unsigned char mpu_read_reg(unsigned char reg)
+{
+	unsigned char val;
+
+	switch (reg) {
+	case REG_MEM_R_W:
+		if (mem_ptr >= MEM_SIZE)
+			return 0xFF;
+
+		stats.mem_bytes++;
+		return mem[mem_ptr++];
+
+	case REG_FIFO_R_W:
+		stats.fifo_bytes_read++;
+		return fifo_pop();
+
+	case REG_FIFO_COUNT_H:
+		return fifo_count >> 8;
+
+	case REG_FIFO_COUNT_L:
+		return fifo_count & 0xFF;
+
+	default:
+		val = regs[reg];
+		break;
+	}
+
+	return val;
+}
+
+static void reset_regs()
+{
+	memset(regs, 0, sizeof(regs));
+
+	regs[REG_PWR_MGMT_1] = BIT_SLEEP;
+	regs[REG_WHO_AM_I] = MPU_ADDR;
+
+	// product revision bits read by mpu_init(), this makes rev 2
+	regs[REG_ACCEL_OFFS + 3] = 0x01;
+
+	fifo_head = 0;
+	fifo_count = 0;
+	pending_packets = 0.0;
+}
+
+// Output rate of the sensor registers, the base for the FIFO and the DMP
+static float sample_rate()
+{
+	unsigned char dlpf = regs[REG_CONFIG] & 0x07;
+	float gyro_rate = (dlpf == 0 || dlpf == 7) ? 8000.0f : 1000.0f;
+
+	return gyro_rate / (1 + regs[REG_RATE_DIV]);
+}
+
+static float fifo_rate()
+{
+	unsigned short dmp_div;
+
+	if (!(regs[REG_USER_CTRL] & BIT_FIFO_EN))
+		return 0.0f;
+
+	if (regs[REG_PWR_MGMT_1] & (BIT_SLEEP | BIT_CYCLE))
+		return 0.0f;
+
+	if (!packet_length())
+		return 0.0f;
+
+	if (cfg.fifo_rate)
+		return cfg.fifo_rate;
+
+	if (regs[REG_USER_CTRL] & BIT_DMP_EN) {
+		dmp_div = (mem[D_0_22] << 8) | mem[D_0_22 + 1];
+		return sample_rate() / (dmp_div + 1);
+	}
+
+	return sample_rate();
+}
+
+static int packet_length()
+{
+	int len = 0;
+
+	if (regs[REG_USER_CTRL] & BIT_DMP_EN) {
+		if (mem[CFG_LP_QUAT] != 0x8B || mem[CFG_8] != 0xA3)
+			len += 16;
+
+		if (mem[CFG_15 + 1] != 0xA3)
+			len += 6;
+
+		if (mem[CFG_15 + 4] != 0xA3)
+			len += 6;
+
+		if (mem[CFG_27] != 0xD8)
+			len += 4;
+	}
+	else {
+		if (regs[REG_FIFO_EN] & BIT_FIFO_ACCEL)
+			len += 6;
+
+		if (regs[REG_FIFO_EN] & BIT_FIFO_TEMP)
+			len += 2;
+
+		if (regs[REG_FIFO_EN] & BIT_FIFO_GYRO_X)
+			len += 2;
+
+		if (regs[REG_FIFO_EN] & BIT_FIFO_GYRO_Y)
+			len += 2;
+
+		if (regs[REG_FIFO_EN] & BIT_FIFO_GYRO_Z)
+			len += 2;
+	}
+
+	return len;
+}
+
+// Bring the FIFO up to date with the elapsed time
+static void update()
+{
+	unsigned long now = mpu_sim_get_ms();
+	float rate;
+	long n, skip;
+
+	if (now <= last_update_ms)
+		return;
+
+	rate = fifo_rate();
+
+	if (rate <= 0.0f) {
+		model_time += (now - last_update_ms) / 1000.0;
+		last_update_ms = now;
+		return;
+	}
+
+	pending_packets += (now - last_update_ms) * rate / 1000.0;
+	last_update_ms = now;
+
+	n = (long)pending_packets;
+	pending_packets -= n;
+
+	// anything beyond two FIFOs worth would be overwritten anyway
+	skip = n - 2 * (FIFO_SIZE / packet_length() + 1);
+
+	if (skip > 0) {
+		model_time += skip / rate;
+		n -= skip;
+		stats.fifo_overflows++;
+		regs[REG_INT_STATUS] |= INT_FIFO_OFLOW;
+	}
+
+	while (n-- > 0) {
+		model_time += 1.0 / rate;
+		push_packet();
+	}
+}
+
+static void push_packet()
+{
+	unsigned char buff[32];
+	long q[4];
+	short a[3], g[3];
+	int i, len = 0;
+
+	model_accel(a);
+	model_gyro(g);
+
+	if (regs[REG_USER_CTRL] & BIT_DMP_EN) {
+		if (mem[CFG_LP_QUAT] != 0x8B || mem[CFG_8] != 0xA3) {
+			model_quat(q);
+
+			for (i = 0; i < 4; i++, len += 4)
+				put_be32(&buff[len], q[i]);
+		}
+
+		if (mem[CFG_15 + 1] != 0xA3) {
+			for (i = 0; i < 3; i++, len += 2)
+				put_be16(&buff[len], a[i]);
+		}
+
+		if (mem[CFG_15 + 4] != 0xA3) {
+			for (i = 0; i < 3; i++, len += 2)
+				put_be16(&buff[len], g[i]);
+		}
+
+		// no gestures
+		if (mem[CFG_27] != 0xD8) {
+			memset(&buff[len], 0, 4);
+			len += 4;
+		}
+
+		regs[REG_DMP_INT_STATUS] |= DMP_INT_0;
+		regs[REG_INT_STATUS] |= INT_DMP | INT_DATA_RDY;
+	}
+	else {
+		if (regs[REG_FIFO_EN] & BIT_FIFO_ACCEL) {
+			for (i = 0; i < 3; i++, len += 2)
+				put_be16(&buff[len], a[i]);
+		}
+
+		if (regs[REG_FIFO_EN] & BIT_FIFO_TEMP) {
+			put_be16(&buff[len], -3400);
+			len += 2;
+		}
+
+		for (i = 0; i < 3; i++) {
+			if (regs[REG_FIFO_EN] & (BIT_FIFO_GYRO_X >> i)) {
+				put_be16(&buff[len], g[i]);
+				len += 2;
+			}
+		}
+
+		regs[REG_INT_STATUS] |= INT_DATA_RDY;
+	}
+
+	for (i = 0; i < len; i++)
+		fifo_push(buff[i]);
+}
+
+// Like the real part, a full FIFO keeps the newest bytes
+static void fifo_push(unsigned char c)
+{
+	if (fifo_count == FIFO_SIZE) {
+		fifo_head = (fifo_head + 1) % FIFO_SIZE;
+		fifo_count--;
+
+		if (!(regs[REG_INT_STATUS] & INT_FIFO_OFLOW))
+			stats.fifo_overflows++;
+
+		regs[REG_INT_STATUS] |= INT_FIFO_OFLOW;
+	}
+
+	fifo[(fifo_head + fifo_count) % FIFO_SIZE] = c;
+	fifo_count++;
+}
+
+static unsigned char fifo_pop()
+{
+	unsigned char c;
+
+	if (fifo_count == 0)
+		return 0xFF;
+
+	c = fifo[fifo_head];
+	fifo_head = (fifo_head + 1) % FIFO_SIZE;
+	fifo_count--;
+
+	return c;
+}
+
+static float model_yaw()
+{
+	return (float)(model_time * cfg.yaw_rate * M_PI / 180.0);
+}
+
+// q30 quaternion for a rotation of model_yaw() around Z
+static void model_quat(long *q)
+{
+	float half = model_yaw() / 2.0f;
+
+	q[0] = (long)(cosf(half) * 1073741824.0f);
+	q[1] = 0;
+	q[2] = 0;
+	q[3] = (long)(sinf(half) * 1073741824.0f);
+}
+
+// 1g on Z at the configured full scale range
+static void model_accel(short *a)
+{
+	a[0] = 0;
+	a[1] = 0;
+	a[2] = 16384 >> ((regs[REG_ACCEL_CFG] >> 3) & 0x03);
+}
+
+static void model_gyro(short *g)
+{
+	float lsb_per_dps = 131.0f / (1 << ((regs[REG_GYRO_CFG] >> 3) & 0x03));
+
+	g[0] = 0;
+	g[1] = 0;
+	g[2] = (short)(cfg.yaw_rate * lsb_per_dps);
+}
+
+static void model_mag(short *m)
+{
+	float yaw = model_yaw();
+
+	m[0] = (short)(SIM_MAG_HORIZ * cosf(yaw));
+	m[1] = (short)(-SIM_MAG_HORIZ * sinf(yaw));
+	m[2] = (short)SIM_MAG_VERT;
+}
+
+static void refresh_sensor_regs()
+{
+	short a[3], g[3];
+	int i;
+
+	model_accel(a);
+	model_gyro(g);
+
+	for (i = 0; i < 3; i++) {
+		put_be16(&regs[REG_ACCEL_OUT + 2 * i], a[i]);
+		put_be16(&regs[REG_GYRO_OUT + 2 * i], g[i]);
+	}
+
+	put_be16(&regs[REG_TEMP_OUT], -3400);
+}
+
+// The aux I2C master copies the compass registers to EXT_SENS_DATA once
+// per sample. Doing it on demand gives the same result to the host.
+static void refresh_ext_sens_data()
+{
+	unsigned char start, len;
+	int i;
+
+	if (!(regs[REG_USER_CTRL] & BIT_I2C_MST_EN))
+		return;
+
+	if (!(regs[REG_S0_CTRL] & BIT_SLAVE_EN))
+		return;
+
+	if (regs[REG_S0_ADDR] != (BIT_I2C_READ | AKM_ADDR))
+		return;
+
+	start = regs[REG_S0_REG];
+	len = regs[REG_S0_CTRL] & 0x0F;
+
+	// slave 1 kicks off a single measurement every sample
+	akm_measure();
+
+	for (i = 0; i < len && i < EXT_SENS_DATA_LEN; i++)
+		regs[REG_EXT_SENS_DATA + i] = (start + i < AKM_NUM_REG) ? akm[start + i] : 0;
+
+	akm[AKM_REG_ST1] = 0;
+}
+
+static void akm_measure()
+{
+	short m[3];
+	int i;
+
+	model_mag(m);
+
+	// little endian, unlike the MPU
+	for (i = 0; i < 3; i++) {
+		akm[AKM_REG_HXL + 2 * i] = m[i] & 0xFF;
+		akm[AKM_REG_HXL + 2 * i + 1] = (m[i] >> 8) & 0xFF;
+	}
+
+	akm[AKM_REG_ST1] = 0x01;
+	akm[AKM_REG_ST2] = 0;
+	akm[AKM_REG_CNTL] = 0;
+}
+
+static void put_be16(unsigned char *p, short v)
+{
+	p[0] = (v >> 8) & 0xFF;
+	p[1] = v & 0xFF;
+}
+
+static void put_be32(unsigned char *p, long v)
+{
+	p[0] = (v >> 24) & 0xFF;
+	p[1] = (v >> 16) & 0xFF;
+	p[2] = (v >> 8) & 0xFF;
+	p[3] = v & 0xFF;
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef MPU_SIM_H
+#define MPU_SIM_H
+
+// Software model of an MPU-9150 (MPU-6050 + AK8975) that sits behind
+// linux_i2c_read() and linux_i2c_write() when linux_set_i2c_sim(1) is used.
+// It has the register file, DMP memory banks, a time driven FIFO with
+// overflow, INT_STATUS and the compass both in bypass mode and behind the
+// aux I2C master. All bus traffic is counted.
+
+typedef struct {
+	// linux_delay_ms() and linux_get_ms() run on simulated time
+	int virtual_clock;
+	// FIFO packets per second, 0 to follow the device configuration
+	unsigned short fifo_rate;
+	// constant rotation around Z in deg/s
+	float yaw_rate;
+} mpusim_config_t;
+
+typedef struct {
+	unsigned long transactions;
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long bytes_read;
+	unsigned long bytes_written;
+	unsigned long fifo_bytes_read;
+	unsigned long mem_bytes;
+	unsigned long compass_transactions;
+	unsigned long fifo_overflows;
+	unsigned long naks;
+} mpusim_stats_t;
+
+void mpu_sim_init(mpusim_config_t *cfg);
+
+int mpu_sim_i2c_write(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char const *data);
+
+int mpu_sim_i2c_read(unsigned char slave_addr, unsigned char reg_addr,
+       unsigned char length, unsigned char *data);
+
+int mpu_sim_virtual_clock();
+void mpu_sim_advance_ms(unsigned long num_ms);
+unsigned long mpu_sim_get_ms();
+
+void mpu_sim_trigger_motion();
+
+void mpu_sim_get_stats(mpusim_stats_t *stats);
+void mpu_sim_clear_stats();
+void mpu_sim_print_stats();
+
+#endif /* MPU_SIM_H */
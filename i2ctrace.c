@@ -0,0 +1,338 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Decoder for the I2C trace files written by imu -T. Prints one line per
+// transaction with the eMPL register names, or a per register summary.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "i2c_trace.h"
+
+#define MPU_ADDR	0x68
+#define MPU_ADDR_ALT	0x69
+
+// the AK8975 strap options
+#define AKM_ADDR_MIN	0x0C
+#define AKM_ADDR_MAX	0x0F
+
+typedef struct {
+	unsigned char reg;
+	const char *name;
+} regname_t;
+
+// names as in the gyro_reg_s table in eMPL/inv_mpu.c
+static const regname_t mpu_regs[] = {
+	{ 0x01, "yg_offs_tc" },
+	{ 0x06, "accel_offs" },
+	{ 0x0C, "prod_id" },
+	{ 0x19, "rate_div" },
+	{ 0x1A, "lpf" },
+	{ 0x1B, "gyro_cfg" },
+	{ 0x1C, "accel_cfg" },
+	{ 0x1F, "motion_thr" },
+	{ 0x20, "motion_dur" },
+	{ 0x23, "fifo_en" },
+	{ 0x24, "i2c_mst" },
+	{ 0x25, "s0_addr" },
+	{ 0x26, "s0_reg" },
+	{ 0x27, "s0_ctrl" },
+	{ 0x28, "s1_addr" },
+	{ 0x29, "s1_reg" },
+	{ 0x2A, "s1_ctrl" },
+	{ 0x34, "s4_ctrl" },
+	{ 0x37, "int_pin_cfg" },
+	{ 0x38, "int_enable" },
+	{ 0x39, "dmp_int_status" },
+	{ 0x3A, "int_status" },
+	{ 0x3B, "raw_accel" },
+	{ 0x41, "temp" },
+	{ 0x43, "raw_gyro" },
+	{ 0x49, "raw_compass" },
+	{ 0x63, "s0_do" },
+	{ 0x64, "s1_do" },
+	{ 0x67, "i2c_delay_ctrl" },
+	{ 0x6A, "user_ctrl" },
+	{ 0x6B, "pwr_mgmt_1" },
+	{ 0x6C, "pwr_mgmt_2" },
+	{ 0x6D, "bank_sel" },
+	{ 0x6E, "mem_start_addr" },
+	{ 0x6F, "mem_r_w" },
+	{ 0x70, "prgm_start_h" },
+	{ 0x72, "fifo_count_h" },
+	{ 0x74, "fifo_r_w" },
+	{ 0x75, "who_am_i" },
+	{ 0, NULL }
+};
+
+// AKM_REG_* in eMPL/inv_mpu.c
+static const regname_t akm_regs[] = {
+	{ 0x00, "akm_whoami" },
+	{ 0x02, "akm_st1" },
+	{ 0x03, "akm_hxl" },
+	{ 0x09, "akm_st2" },
+	{ 0x0A, "akm_cntl" },
+	{ 0x0C, "akm_astc" },
+	{ 0x10, "akm_asax" },
+	{ 0x11, "akm_asay" },
+	{ 0x12, "akm_asaz" },
+	{ 0, NULL }
+};
+
+#define REG_BANK_SEL	0x6D
+#define REG_MEM_R_W	0x6F
+
+typedef struct {
+	unsigned long count;
+	unsigned long errors;
+	unsigned long bytes;
+	uint64_t total_ns;
+	uint32_t max_ns;
+} regstats_t;
+
+// [slave is akm][read][reg]
+static regstats_t stats[2][2][256];
+
+const char *reg_name(unsigned char slave, unsigned char reg);
+int is_akm(unsigned char slave);
+void print_record(i2ctrace_rec_t *rec, uint64_t t0, unsigned int *dmp_addr);
+void print_summary();
+
+void usage(char *argv_0)
+{
+	printf("\nUsage: %s [options] <trace-file>\n", argv_0);
+	printf("  -m <us>               Only show transactions that took at least this long\n");
+	printf("  -e                    Only show failed transactions\n");
+	printf("  -s                    Per register summary instead of every transaction\n");
+	printf("  -h                    Show this help\n");
+
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, summary = 0, errors_only = 0;
+	unsigned long min_us = 0;
+	unsigned int dmp_addr = 0;
+	i2ctrace_hdr_t hdr;
+	i2ctrace_rec_t rec;
+	regstats_t *st;
+	uint64_t t0;
+	uint32_t i;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "m:esh")) != -1) {
+		switch (opt) {
+		case 'm':
+			min_us = strtoul(optarg, NULL, 0);
+			break;
+
+		case 'e':
+			errors_only = 1;
+			break;
+
+		case 's':
+			summary = 1;
+			break;
+
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage(argv[0]);
+
+	f = fopen(argv[optind], "r");
+
+	if (!f) {
+		perror("open(<trace-file>)");
+		exit(1);
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, I2C_TRACE_MAGIC, 8)) {
+		printf("%s is not an I2C trace file\n", argv[optind]);
+		exit(1);
+	}
+
+	if (hdr.version != I2C_TRACE_VERSION || hdr.record_size != sizeof(i2ctrace_rec_t)) {
+		printf("Unsupported trace version %u, record size %u\n", hdr.version, hdr.record_size);
+		exit(1);
+	}
+
+	printf("%u transactions of %llu%s\n\n", hdr.count, (unsigned long long)hdr.total,
+		hdr.total > hdr.count ? ", the oldest were overwritten" : "");
+
+	if (!summary)
+		printf("%12s %9s  %-2s %-4s %-18s %4s  %s\n", "time_us", "dur_us", "op", "dev", "register", "len", "data");
+
+	t0 = 0;
+
+	for (i = 0; i < hdr.count; i++) {
+		if (fread(&rec, sizeof(rec), 1, f) != 1) {
+			printf("Trace file is truncated at record %u\n", i);
+			break;
+		}
+
+		if (i == 0)
+			t0 = rec.t_ns;
+
+		st = &stats[is_akm(rec.slave)][rec.flags & I2C_TRACE_READ ? 1 : 0][rec.reg];
+		st->count++;
+		st->total_ns += rec.dur_ns;
+
+		if (rec.dur_ns > st->max_ns)
+			st->max_ns = rec.dur_ns;
+
+		if (rec.flags & I2C_TRACE_ERROR)
+			st->errors++;
+		else
+			st->bytes += rec.len;
+
+		// follow the DMP memory pointer even for lines that are not shown
+		if (summary || (errors_only && !(rec.flags & I2C_TRACE_ERROR)) || rec.dur_ns < min_us * 1000) {
+			if (!(rec.flags & I2C_TRACE_READ) && rec.reg == REG_BANK_SEL && rec.len >= 2 && !is_akm(rec.slave))
+				dmp_addr = (rec.data[0] << 8) | rec.data[1];
+
+			continue;
+		}
+
+		print_record(&rec, t0, &dmp_addr);
+	}
+
+	fclose(f);
+
+	if (summary)
+		print_summary();
+
+	return 0;
+}
+
+void print_record(i2ctrace_rec_t *rec, uint64_t t0, unsigned int *dmp_addr)
+{
+	char regbuff[32];
+	const char *name;
+	int i, n;
+
+	name = reg_name(rec->slave, rec->reg);
+
+	if (name)
+		snprintf(regbuff, sizeof(regbuff), "%02X %s", rec->reg, name);
+	else
+		snprintf(regbuff, sizeof(regbuff), "%02X", rec->reg);
+
+	printf("%12.1f %9.1f  %-2s ",
+		(rec->t_ns - t0) / 1000.0,
+		rec->dur_ns / 1000.0,
+		rec->flags & I2C_TRACE_READ ? "R" : "W");
+
+	if (is_akm(rec->slave))
+		printf("%-4s ", "akm");
+	else if (rec->slave == MPU_ADDR || rec->slave == MPU_ADDR_ALT)
+		printf("%-4s ", "mpu");
+	else
+		printf("0x%02X ", rec->slave);
+
+	printf("%-18s %4u ", regbuff, rec->len);
+
+	if (rec->flags & I2C_TRACE_ERROR) {
+		printf(" FAILED");
+	}
+	else {
+		n = rec->len < I2C_TRACE_DATA ? rec->len : I2C_TRACE_DATA;
+
+		for (i = 0; i < n; i++)
+			printf(" %02X", rec->data[i]);
+
+		if (rec->len > I2C_TRACE_DATA)
+			printf(" ...");
+	}
+
+	if (!is_akm(rec->slave)) {
+		// bank_sel and mem_start_addr are written together
+		if (!(rec->flags & I2C_TRACE_READ) && rec->reg == REG_BANK_SEL && rec->len >= 2)
+			*dmp_addr = (rec->data[0] << 8) | rec->data[1];
+		else if (rec->reg == REG_MEM_R_W)
+			printf("   [dmp mem %04X]", *dmp_addr);
+	}
+
+	if (rec->flags & I2C_TRACE_SIM)
+		printf("   (sim)");
+
+	printf("\n");
+}
+
+void print_summary()
+{
+	const char *name;
+	regstats_t *st;
+	int akm, read, reg;
+
+	printf("%-4s %-18s %-2s %8s %8s %10s %10s %10s\n",
+		"dev", "register", "op", "count", "errors", "bytes", "mean_us", "max_us");
+
+	for (akm = 0; akm < 2; akm++) {
+		for (reg = 0; reg < 256; reg++) {
+			for (read = 1; read >= 0; read--) {
+				st = &stats[akm][read][reg];
+
+				if (!st->count)
+					continue;
+
+				name = reg_name(akm ? AKM_ADDR_MIN : MPU_ADDR, reg);
+
+				printf("%-4s %02X %-15s %-2s %8lu %8lu %10lu %10.1f %10.1f\n",
+					akm ? "akm" : "mpu", reg, name ? name : "",
+					read ? "R" : "W",
+					st->count, st->errors, st->bytes,
+					(st->total_ns / st->count) / 1000.0,
+					st->max_ns / 1000.0);
+			}
+		}
+	}
+}
+
+const char *reg_name(unsigned char slave, unsigned char reg)
+{
+	const regname_t *table;
+	int i;
+
+	table = is_akm(slave) ? akm_regs : mpu_regs;
+
+	for (i = 0; table[i].name; i++) {
+		if (table[i].reg == reg)
+			return table[i].name;
+	}
+
+	return NULL;
+}
+
+int is_akm(unsigned char slave)
+{
+	return slave >= AKM_ADDR_MIN && slave <= AKM_ADDR_MAX;
+}
@@ -32,41 +32,102 @@
 
 #include "./MQTT_stuff/src/MQTTAsync.h"
 #include "mpu9150.h"
+#include "inv_mpu_dmp_motion_driver.h"
+#include "replay.h"
+#include "mpu_sim.h"
+#include "recorder.h"
+#include "shmring.h"
+#include "udpsink.h"
 #include "linux_glue.h"
+#include "imu_config.h"
+#include "imu_control.h"
+#include "imu_display.h"
+#include "metrics.h"
+#include "i2c_trace.h"
 #include "local_defaults.h"
 
 
 
-#define ADDRESS     "tcp://m2m.eclipse.org:1883"
-#define CLIENTID    "RPi_71"
-#define TOPIC       "MQTT_MPU"
 #define PAYLOAD     "Hello World!"
-#define QOS         1
 #define TIMEOUT     10000L
 
 #define MPU_MSG_NUM  1
 #define MPU_MSG_LENGTH  26// 8(timestamp) + 16(quaternion) + 2(temperature) 
+#define MPU_EVENT_LENGTH 15// 8(timestamp) + 1(type) + 2(args) + 4(value)
+
+// Stillness thresholds in raw units. Gyro at 2000 dps FSR is 16.4 LSB/dps,
+// accel at 2g FSR is 16384 LSB/g.
+#define STILL_GYRO_LSB   33	// ~2 dps
+#define STILL_ACCEL_LSB  500	// ~30 mg
 
 volatile MQTTAsync_token deliveredtoken;
 
 int set_cal(int mag, char *cal_file);
-void read_loop(unsigned int sample_rate);
+void read_loop();
+int read_single(mpudata_t *mpu);
+int read_batch(mpudata_t *mpu);
+void process_sample(mpudata_t *mpu);
+void set_loop_delay();
+int start_recorder(const char *prefix);
+int start_shm(const char *name);
+int start_udp(const char *dest);
+void stop_sinks();
+int control_cmd(char *cmd, char *reply, int reply_len);
+int check_still(mpudata_t *mpu);
+void publish_events(void);
+void shm_add_sample(mpudata_t *mpu);
+void motion_wait(void);
 void mpu_add_msg(mpudata_t *mpu);
-void print_fused_euler_angles(mpudata_t *mpu);
-void print_fused_quaternion(mpudata_t *mpu);
-void print_calibrated_accel(mpudata_t *mpu);
-void print_calibrated_mag(mpudata_t *mpu);
 void register_sig_handler();
 void sigint_handler(int sig);
+void sigusr1_handler(int sig);
+void sigusr2_handler(int sig);
+int dump_i2c_trace(const char *path);
+void check_metrics();
+void update_fifo_metrics();
 
 int done;
+volatile sig_atomic_t dump_metrics;
+volatile sig_atomic_t dump_trace;
+uint64_t metrics_written_ns;
  
 int finished = 0;
 
 struct timeval tv;
 int msg_cnt=0;
 
-char mpu_msg[MPU_MSG_LENGTH];
+// Payload buffers lent to the MQTT library by MQTTAsync_sendBuffer(), so a
+// message goes out without being copied. mpu_msg is the one being filled, or
+// the spare (sent by copy) while every buffer is still held by the library.
+#define MPU_MSG_BUFFERS 32
+
+char mpu_msgs[MPU_MSG_BUFFERS][MPU_MSG_LENGTH];
+volatile int mpu_msg_lent[MPU_MSG_BUFFERS];
+int mpu_msg_next;
+int mpu_msg_borrow;
+char mpu_msg_spare[MPU_MSG_LENGTH];
+char *mpu_msg = mpu_msg_spare;
+
+imuconfig_t config;
+
+char *replay_path;
+int replay_fast;
+int use_sim;
+FILE *record_file;
+int recording;
+int shm_on;
+int udp_on;
+
+// both can change at runtime from the control socket
+int batch_size = 1;
+unsigned long loop_delay;
+
+unsigned long still_period_ms;
+unsigned long still_since;
+short still_ref_accel[3];
+unsigned long motion_at;
+// set while motion_wait() has the sensor in accel-only low power mode
+int low_power;
 
 	MQTTAsync client;
 	MQTTAsync_connectOptions conn_opts = MQTTAsync_connectOptions_initializer;
@@ -89,8 +150,7 @@ void connlost(void *context, char *cause)
 
 	printf("Reconnecting\n");
 
-	//change this
-	conn_opts.keepAliveInterval = 700;
+	conn_opts.keepAliveInterval = config.keepalive;
 
 	conn_opts.cleansession = 1;
 	if ((rc = MQTTAsync_connect(client, &conn_opts)) != MQTTASYNC_SUCCESS)
@@ -138,7 +198,7 @@ void onSend(void* context, MQTTAsync_successData* response)
 	opts.onSuccess = onSendAgain;//onDisconnect;
 	opts.context = client;
 	
-	if ((rc = MQTTAsync_sendMessage(client, TOPIC, &pubmsg, &opts)) != MQTTASYNC_SUCCESS)
+	if ((rc = MQTTAsync_sendMessage(client, config.topic, &pubmsg, &opts)) != MQTTASYNC_SUCCESS)
 	{
 		printf("Failed to start sendMessage, return code %d\n", rc);
  		exit(-1);	
@@ -173,7 +233,7 @@ void onConnect(void* context, MQTTAsync_successData* response)
 
 	//pubmsg.payload = PAYLOAD;
 	//pubmsg.payloadlen = strlen(PAYLOAD);
-	pubmsg.qos = QOS;
+	pubmsg.qos = config.qos;
 	pubmsg.retained = 0;
 	deliveredtoken = 0;
 
@@ -187,6 +247,9 @@ void onConnect(void* context, MQTTAsync_successData* response)
 void usage(char *argv_0)
 {
 	printf("\nUsage: %s [options]\n", argv_0);
+	printf("  -c <config-file>      Settings file, key = value lines. Default is %s\n", DEFAULT_CONFIG_FILE);
+	printf("                           Command line options override it.\n");
+	printf("  -C <socket-path>      Control socket for imuctl, \"\" to disable. Default is %s\n", DEFAULT_CONTROL_SOCKET);
 	printf("  -b <i2c-bus>          The I2C bus number where the IMU is. The default is 1 to use /dev/i2c-1.\n");
 	printf("  -s <sample-rate>      The IMU sample rate in Hz. Range 2-50, default 10.\n");
 	printf("  -y <yaw-mix-factor>   Effect of mag yaw on fused yaw data.\n");
@@ -196,6 +259,28 @@ void usage(char *argv_0)
 	printf("                           The default is 4.\n");
 	printf("  -a <accelcal file>    Path to accelerometer calibration file. Default is ./accelcal.txt\n");
 	printf("  -m <magcal file>      Path to mag calibration file. Default is ./magcal.txt\n");
+	printf("  -l <latency-ms>       Batch samples in the FIFO for up to this many ms and read\n");
+	printf("                           them in one burst. 0 = one sample per read, the default.\n");
+	printf("  -w <still-seconds>    Switch to low power wake-on-motion mode after this many\n");
+	printf("                           seconds without motion. 0 = never, the default.\n");
+	printf("  -t <threshold-mg>     Wake-on-motion threshold in mg. Default is %d.\n", DEFAULT_WOM_THRESH_MG);
+	printf("  -r <replay-file>      Feed the pipeline from a replay log instead of the IMU\n");
+	printf("  -f                    Replay as fast as possible instead of in real time\n");
+	printf("  -o <record-file>      Log the raw samples in replay format\n");
+	printf("  -B <prefix>           Record raw and fused samples to binary segment files\n");
+	printf("                           <prefix>-NNNNNN.rec, %d samples each\n", DEFAULT_REC_SEGMENT_RECORDS);
+	printf("  -M <name>             Share the latest samples in POSIX shared memory, e.g. %s\n", DEFAULT_SHM_NAME);
+	printf("  -U <address:port>     Stream samples as UDP frames, unicast or multicast\n");
+	printf("  -u <samples>          Samples per UDP frame, 1-%d. Default is %d.\n", UDP_MAX_BATCH, DEFAULT_UDP_BATCH);
+	printf("  -S                    Run against the built-in MPU-9150 simulator instead of I2C\n");
+	printf("  -e                    Run tap, orientation and step detection on the DMP and\n");
+	printf("                           publish them on the event topic, default %s\n", DEFAULT_MQTT_EVENT_TOPIC);
+	printf("  -k <metrics-file>     Write latency histograms and counters to this file in\n");
+	printf("                           Prometheus text format every %d s. kill -USR1 prints them.\n", DEFAULT_METRICS_INTERVAL_S);
+	printf("  -T                    Trace every I2C transaction into a %d entry ring. It is\n", I2C_TRACE_RECORDS);
+	printf("                           written to %s on exit or kill -USR2,\n", DEFAULT_I2C_TRACE_FILE);
+	printf("                           decode it with i2ctrace.\n");
+	printf("  -q                    Quiet, no sample display. For running as a daemon.\n");
 	printf("  -v                    Verbose messages\n");
 	printf("  -h                    Show this help\n");
 
@@ -213,11 +298,11 @@ int publish_main(void)
 	int rc;
 	MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
 
-	MQTTAsync_create(&client, ADDRESS, CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+	MQTTAsync_create(&client, config.broker, config.client_id, MQTTCLIENT_PERSISTENCE_NONE, NULL);
 
 	MQTTAsync_setCallbacks(client, NULL, connlost, NULL, NULL);
 
-	conn_opts.keepAliveInterval = 700;
+	conn_opts.keepAliveInterval = config.keepalive;
 	conn_opts.cleansession = 1;
 	conn_opts.onSuccess = onConnect;
 	conn_opts.onFailure = onConnectFailure;
@@ -230,7 +315,7 @@ int publish_main(void)
 
 	printf("Waiting for publication of %s\n"
          "on topic %s for client with ClientID: %s\n",
-         PAYLOAD, TOPIC, CLIENTID);
+         PAYLOAD, config.topic, config.client_id);
 	/*while (!finished)
 		#if defined(WIN32)
 			Sleep(100);
@@ -246,7 +331,7 @@ int i=0;
 		pubmsg.payloadlen = strlen(msg);//PAYLOAD);
 
 		msg[0]=msg[0]+1;
-		if ((rc = MQTTAsync_sendMessage(client, TOPIC, &pubmsg, &opts)) != MQTTASYNC_SUCCESS)
+		if ((rc = MQTTAsync_sendMessage(client, config.topic, &pubmsg, &opts)) != MQTTASYNC_SUCCESS)
 		{
 			printf("Failed to start sendMessage, return code %d\n", rc);
 	 		exit(-1);	
@@ -258,16 +343,49 @@ int i=0;
  	return rc;
 }
 
+// called on an MQTT library thread once it is done with a lent buffer
+void mpu_msg_released(void *context, void *buffer)
+{
+	__sync_lock_release(&mpu_msg_lent[((char *)buffer - mpu_msgs[0]) / MPU_MSG_LENGTH]);
+}
+
+// move mpu_msg on to the next buffer the library isn't holding
+void mpu_msg_advance(void)
+{
+	int i, n;
+
+	if (!mpu_msg_borrow)
+		return;
+
+	for (i = 0; i < MPU_MSG_BUFFERS; i++) {
+		n = (mpu_msg_next + i) % MPU_MSG_BUFFERS;
+
+		if (!mpu_msg_lent[n]) {
+			mpu_msg_next = (n + 1) % MPU_MSG_BUFFERS;
+			mpu_msg = mpu_msgs[n];
+			return;
+		}
+	}
+
+	mpu_msg = mpu_msg_spare;
+}
+
 void MQTT_init(void)
 {
 
 	int rc=0;;
 
-	MQTTAsync_create(&client, ADDRESS, CLIENTID, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+	MQTTAsync_create(&client, config.broker, config.client_id, MQTTCLIENT_PERSISTENCE_NONE, NULL);
+
+	if (MQTTAsync_registerBuffers(mpu_msgs, MPU_MSG_LENGTH, MPU_MSG_BUFFERS,
+			mpu_msg_released, NULL) == MQTTASYNC_SUCCESS) {
+		mpu_msg_borrow = 1;
+		mpu_msg_advance();
+	}
 
 	MQTTAsync_setCallbacks(client, NULL, connlost, NULL, NULL);
 
-	conn_opts.keepAliveInterval = 700;
+	conn_opts.keepAliveInterval = config.keepalive;
 	conn_opts.cleansession = 1;
 	conn_opts.onSuccess = onConnect;
 	conn_opts.onFailure = onConnectFailure;
@@ -280,7 +398,7 @@ void MQTT_init(void)
 
 	printf("Waiting for publication of %s\n"
          "on topic %s for client with ClientID: %s\n",
-         PAYLOAD, TOPIC, CLIENTID);
+         PAYLOAD, config.topic, config.client_id);
 	/*while (!finished)
 		#if defined(WIN32)
 			Sleep(100);
@@ -289,17 +407,35 @@ void MQTT_init(void)
 		#endif
 	*/
 	sleep(3);
+
+	pubmsg.qos = config.qos;
 }
 
 int publish(void* msg_p)
 {
 	int rc=0;
 
+	if (msg_p != mpu_msg_spare) {
+		int n = ((char *)msg_p - mpu_msgs[0]) / MPU_MSG_LENGTH;
+
+		mpu_msg_lent[n] = 1;
+
+		METRICS_TIME(MET_MQTT_SEND, rc = MQTTAsync_sendBuffer(client, config.topic,
+				MPU_MSG_LENGTH, msg_p, pubmsg.qos, pubmsg.retained, &opts));
+
+		if (rc != MQTTASYNC_SUCCESS)
+			mpu_msg_lent[n] = 0;
+	}
+	else {
 		pubmsg.payload = msg_p;//PAYLOAD;
 		pubmsg.payloadlen = MPU_MSG_LENGTH;//PAYLOAD;
 
-		if ((rc = MQTTAsync_sendMessage(client, TOPIC, &pubmsg, &opts)) != MQTTASYNC_SUCCESS)
+		METRICS_TIME(MET_MQTT_SEND, rc = MQTTAsync_sendMessage(client, config.topic, &pubmsg, &opts));
+	}
+
+		if (rc != MQTTASYNC_SUCCESS)
 		{
+			metrics_count(MET_MQTT_ERRORS, 1);
 			printf("Failed to start sendMessage, return code %d\n", rc);
 	 		exit(-1);	
 		}
@@ -311,79 +447,148 @@ int publish(void* msg_p)
 
 int main(int argc, char **argv)
 {
-	int opt, len;
-	int i2c_bus = DEFAULT_I2C_BUS;
-	int sample_rate = DEFAULT_SAMPLE_RATE_HZ;
-	int yaw_mix_factor = DEFAULT_YAW_MIX_FACTOR;
+	int opt;
+	char *config_file = NULL;
 	int verbose = 0;
-	char *mag_cal_file = NULL;
-	char *accel_cal_file = NULL;
+	char *optstring = "c:C:b:s:y:a:m:l:w:t:er:fo:B:M:U:u:Sk:Tqvh";
 
+	config_init(&config);
 
+	// the config file goes first so the command line can override it
+	while ((opt = getopt(argc, argv, optstring)) != -1) {
+		if (opt == 'c')
+			config_file = optarg;
+		else if (opt == '?' || opt == 'h')
+			usage(argv[0]);
+	}
 
+	if (config_load(&config, config_file ? config_file : DEFAULT_CONFIG_FILE, config_file != NULL))
+		exit(1);
 
-	MQTT_init();
-	
-	
-	while ((opt = getopt(argc, argv, "b:s:y:a:m:vh")) != -1) {
+	optind = 1;
+
+	while ((opt = getopt(argc, argv, optstring)) != -1) {
 		switch (opt) {
-		case 'b':
-			i2c_bus = strtoul(optarg, NULL, 0);
-			
-			if (errno == EINVAL)
+		case 'c':
+			break;
+
+		case 'C':
+			if (config_set(&config, "control_socket", optarg))
 				usage(argv[0]);
-			
-			if (i2c_bus < MIN_I2C_BUS || i2c_bus > MAX_I2C_BUS)
+
+			break;
+
+		case 'b':
+			if (config_set(&config, "i2c_bus", optarg))
 				usage(argv[0]);
 
 			break;
 		
 		case 's':
-			sample_rate = strtoul(optarg, NULL, 0);
-			
-			if (errno == EINVAL)
-				usage(argv[0]);
-			
-			if (sample_rate < MIN_SAMPLE_RATE || sample_rate > MAX_SAMPLE_RATE)
+			if (config_set(&config, "sample_rate", optarg))
 				usage(argv[0]);
 
 			break;
 
 		case 'y':
-			yaw_mix_factor = strtoul(optarg, NULL, 0);
-			
-			if (errno == EINVAL)
-				usage(argv[0]);
-			
-			if (yaw_mix_factor < 0 || yaw_mix_factor > 100)
+			if (config_set(&config, "yaw_mix_factor", optarg))
 				usage(argv[0]);
 
 			break;
 
 		case 'a':
-			len = 1 + strlen(optarg);
+			if (config_set(&config, "accel_cal", optarg))
+				usage(argv[0]);
 
-			accel_cal_file = (char *)malloc(len);
+			break;
 
-			if (!accel_cal_file) {
-				perror("malloc");
-				exit(1);
-			}
+		case 'm':
+			if (config_set(&config, "mag_cal", optarg))
+				usage(argv[0]);
 
-			strcpy(accel_cal_file, optarg);
 			break;
 
-		case 'm':
-			len = 1 + strlen(optarg);
+		case 'l':
+			if (config_set(&config, "batch_latency_ms", optarg))
+				usage(argv[0]);
 
-			mag_cal_file = (char *)malloc(len);
+			break;
+
+		case 'w':
+			if (config_set(&config, "still_period_s", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 't':
+			if (config_set(&config, "wom_thresh_mg", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 'e':
+			config.events = 1;
+			break;
+
+		case 'r':
+			replay_path = optarg;
+			break;
+
+		case 'f':
+			replay_fast = 1;
+			break;
+
+		case 'S':
+			use_sim = 1;
+			break;
+
+		case 'U':
+			if (config_set(&config, "udp", optarg))
+				usage(argv[0]);
+
+			break;
 
-			if (!mag_cal_file) {
-				perror("malloc");
+		case 'u':
+			if (config_set(&config, "udp_batch", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 'M':
+			if (config_set(&config, "shm", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 'B':
+			if (config_set(&config, "record", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 'o':
+			record_file = fopen(optarg, "w");
+
+			if (!record_file) {
+				perror("open(<record-file>)");
 				exit(1);
 			}
 
-			strcpy(mag_cal_file, optarg);
+			replay_write_header(record_file);
+			break;
+
+		case 'k':
+			if (config_set(&config, "metrics_file", optarg))
+				usage(argv[0]);
+
+			break;
+
+		case 'T':
+			config.i2c_trace = 1;
+			break;
+
+		case 'q':
+			config.display_hz = 0;
 			break;
 
 		case 'v':
@@ -397,96 +602,652 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (verbose) {
+		char buff[CONTROL_MAX_REPLY];
+
+		config_print(&config, buff, sizeof(buff));
+		printf("%s\n", buff);
+	}
+
+	MQTT_init();
+
+	if (start_recorder(config.record_prefix) || start_shm(config.shm_name) || start_udp(config.udp_dest))
+		exit(1);
+
+	if (control_open(config.control_socket))
+		exit(1);
+
 	register_sig_handler();
 
+	// before init so the whole bring up is in the trace
+	i2c_trace_set(config.i2c_trace);
+
 	mpu9150_set_debug(verbose);
+	mpu9150_set_events(config.events);
+	mpu9150_set_stop_flag(&done);
+
+	if (use_sim) {
+		mpusim_config_t sim_config;
+
+		memset(&sim_config, 0, sizeof(sim_config));
+		sim_config.yaw_rate = 10.0f;
+
+		mpu_sim_init(&sim_config);
+		linux_set_i2c_sim(1);
+	}
+
+	if (replay_path) {
+		if (mpu9150_init_replay(replay_path, !replay_fast, config.sample_rate, config.yaw_mix_factor))
+			exit(1);
+
+		// no sensor to put to sleep
+		config.still_period = 0;
+	}
+	else if (mpu9150_init(config.i2c_bus, config.sample_rate, config.yaw_mix_factor)) {
+		exit(1);
+	}
+
+	set_cal(0, config.accel_cal[0] ? config.accel_cal : NULL);
+	set_cal(1, config.mag_cal[0] ? config.mag_cal : NULL);
 
-	if (mpu9150_init(i2c_bus, sample_rate, yaw_mix_factor))
+	still_period_ms = 1000 * config.still_period;
+
+	batch_size = mpu9150_set_batch_latency(config.batch_latency);
+	set_loop_delay();
+
+	if (display_start(config.display_hz))
 		exit(1);
 
-	set_cal(0, accel_cal_file);
-	set_cal(1, mag_cal_file);
+	read_loop();
 
-	if (accel_cal_file)
-		free(accel_cal_file);
+	display_stop();
 
-	if (mag_cal_file)
-		free(mag_cal_file);
+	// final numbers
+	if (config.metrics_file[0]) {
+		update_fifo_metrics();
+		metrics_write_file(config.metrics_file);
+	}
 
-	read_loop(sample_rate);
+	if (i2c_trace_enabled())
+		dump_i2c_trace(NULL);
 
 	mpu9150_exit();
 	MQTTAsync_destroy(&client);
 
+	control_close();
+
+	if (use_sim)
+		mpu_sim_print_stats();
+
+	if (record_file)
+		fclose(record_file);
+
+	stop_sinks();
+
 	return 0;
 }
 
-void read_loop(unsigned int sample_rate)
+void read_loop()
 {
-	unsigned long loop_delay;
-	mpudata_t mpu;								/*
-									typedef struct {
-									short rawGyro[3];
-									short rawAccel[3];
-									long rawQuat[4];
-									unsigned long dmpTimestamp;
+	mpudata_t mpu;
 
-									short rawMag[3];
-									unsigned long magTimestamp;
+	memset(&mpu, 0, sizeof(mpudata_t));
 
-									short Temp[3];
-	
-									short calibratedAccel[3];
-									short calibratedMag[3];
+	printf("\nEntering read loop (ctrl-c to exit)\n\n");
+
+	linux_delay_ms(loop_delay);
 
-									quaternion_t fusedQuat;
-									vector3d_t fusedEuler;
+	while (!done) {
+		// the mode can change between passes
+		if (batch_size > 1)
+			read_batch(&mpu);
+		else
+			read_single(&mpu);
 
-									float lastDMPYaw;
-									float lastYaw;
-								} mpudata_t;*/
+		publish_events();
 
-	memset(&mpu, 0, sizeof(mpudata_t));
+		if (udp_on)
+			udpsink_poll();
+
+		control_poll(control_cmd);
+
+		check_metrics();
+
+		if (mpu9150_replay_done())
+			done = 1;
+	}
+
+	printf("\n\n");
+}
+
+// One sample per wakeup, sleeping most of a sample period in between
+int read_single(mpudata_t *mpu)
+{
+	int rc;
+
+	rc = mpu9150_read(mpu);
+
+	if (rc == 0) {
+		process_sample(mpu);
+		check_still(mpu);
+	}
+
+	if (loop_delay)
+		linux_delay_ms(loop_delay);
+
+	return rc;
+}
+
+// Let the FIFO fill for the batch latency and drain it in one burst
+int read_batch(mpudata_t *mpu)
+{
+	mpudata_t samples[MAX_BATCH_SIZE];
+	int i, n;
+
+	n = mpu9150_read_batch(mpu, samples, MAX_BATCH_SIZE);
 
-	if (sample_rate == 0)
+	for (i = 0; i < n && !done; i++) {
+		process_sample(&samples[i]);
+
+		// rest of the batch is stale after a low power stretch
+		if (check_still(&samples[i]))
+			break;
+	}
+
+	return n;
+}
+
+void process_sample(mpudata_t *mpu)
+{
+	mpu_add_msg(mpu);
+
+	if (record_file)
+		replay_write(record_file, mpu);
+
+	if (recording)
+		recorder_write(mpu);
+
+	if (shm_on)
+		shm_add_sample(mpu);
+
+	if (udp_on)
+		udpsink_write(mpu);
+
+	// the display thread prints it, off the acquisition path
+	display_update(mpu);
+
+	if (msg_cnt >= MPU_MSG_NUM) {
+		msg_cnt = 0;
+		publish(mpu_msg);
+		mpu_msg_advance();
+	}
+}
+
+// Dump after a SIGUSR1 and rewrite the metrics file every interval
+void check_metrics()
+{
+	uint64_t now;
+
+	if (dump_metrics) {
+		dump_metrics = 0;
+		update_fifo_metrics();
+		metrics_dump(stdout);
+	}
+
+	if (dump_trace) {
+		dump_trace = 0;
+		dump_i2c_trace(NULL);
+	}
+
+	if (!config.metrics_file[0])
 		return;
 
-	loop_delay = (1000 / sample_rate) - 2;
+	now = metrics_now_ns();
 
-	printf("\nEntering read loop (ctrl-c to exit)\n\n");
+	if (now - metrics_written_ns < config.metrics_interval * 1000000000ULL)
+		return;
 
-	linux_delay_ms(loop_delay);
-	
+	metrics_written_ns = now;
+	update_fifo_metrics();
+	metrics_write_file(config.metrics_file);
+}
 
+// NULL uses the configured trace file
+int dump_i2c_trace(const char *path)
+{
+	if (!path || !*path)
+		path = config.i2c_trace_file;
 
-	while (!done) {
-		while(msg_cnt<MPU_MSG_NUM && !done){
-			if (mpu9150_read(&mpu) == 0) {
-				 mpu_add_msg(&mpu);
-
-				// print_fused_euler_angles(&mpu);
-				 print_fused_quaternions(&mpu);
-				// print_calibrated_accel(&mpu);
-				// print_calibrated_mag(&mpu);
+	if (i2c_trace_dump(path))
+		return -1;
+
+	printf("\nI2C trace written to %s\n", path);
+
+	return 0;
+}
+
+void update_fifo_metrics()
+{
+	struct dmp_fifo_stats_s stats;
+
+	if (replay_path || dmp_get_fifo_stats(&stats))
+		return;
+
+	metrics_set(MET_FIFO_OVERFLOWS, stats.overflows);
+	metrics_set(MET_FIFO_RESETS, stats.resets);
+	metrics_set(MET_FIFO_RESYNCS, stats.resyncs);
+	metrics_set(MET_FIFO_CORRUPT, stats.corrupt_packets);
+}
+
+void set_loop_delay()
+{
+	// replay paces itself from the logged timestamps
+	if (replay_path)
+		loop_delay = 0;
+	else
+		loop_delay = (1000 / config.sample_rate) - 2;
+}
+
+// The sink starters close whatever was running first, an empty name just
+// stops the sink.
+int start_recorder(const char *prefix)
+{
+	if (recording) {
+		recorder_close();
+		recording = 0;
+	}
+
+	if (!*prefix)
+		return 0;
+
+	if (recorder_open(prefix, DEFAULT_REC_SEGMENT_RECORDS, DEFAULT_REC_MAX_SEGMENTS))
+		return -1;
+
+	recording = 1;
+
+	return 0;
+}
+
+int start_shm(const char *name)
+{
+	if (shm_on) {
+		shmring_destroy();
+		shm_on = 0;
+	}
+
+	if (!*name)
+		return 0;
+
+	if (shmring_create(name, DEFAULT_SHM_SLOTS))
+		return -1;
+
+	shm_on = 1;
+
+	return 0;
+}
+
+int start_udp(const char *dest)
+{
+	if (udp_on) {
+		udpsink_close();
+		udp_on = 0;
+	}
+
+	if (!*dest)
+		return 0;
+
+	if (udpsink_open(dest, config.udp_batch, DEFAULT_UDP_LATENCY_MS, DEFAULT_UDP_TTL))
+		return -1;
+
+	udp_on = 1;
+
+	return 0;
+}
+
+void stop_sinks()
+{
+	udpstats_t udp_stats;
+	int had_udp = udp_on;
+
+	start_recorder("");
+	start_shm("");
+	start_udp("");
+
+	if (had_udp) {
+		udpsink_get_stats(&udp_stats);
+
+		printf("UDP: %lu samples in %lu frames, %lu frames dropped\n",
+			udp_stats.samples, udp_stats.frames, udp_stats.dropped_frames);
+	}
+}
+
+// Commands from the control socket. Sample rate and batching are changed
+// without touching the DMP firmware, sinks are stopped and started.
+// Settings are checked with config_set() so "status" shows what is live.
+int control_cmd(char *cmd, char *reply, int reply_len)
+{
+	imuconfig_t next;
+	char *name, *arg;
+	int rc;
+
+	name = strtok(cmd, " \t");
+	arg = strtok(NULL, "");
+
+	if (!name) {
+		snprintf(reply, reply_len, "error: empty command\n");
+		return -1;
+	}
+
+	if (!arg)
+		arg = "";
+	else
+		arg += strspn(arg, " \t");
+
+	if (!strcmp(arg, "off"))
+		arg = "";
+
+	memcpy(&next, &config, sizeof(next));
+	rc = -1;
+
+	if (!strcmp(name, "status")) {
+		config_print(&config, reply, reply_len);
+		return 0;
+	}
+	else if (!strcmp(name, "metrics")) {
+		FILE *f;
+
+		if (!strcmp(arg, "reset")) {
+			metrics_reset();
+			snprintf(reply, reply_len, "ok\n");
+			return 0;
+		}
+
+		f = fmemopen(reply, reply_len, "w");
+
+		if (!f) {
+			snprintf(reply, reply_len, "error: fmemopen failed\n");
+			return -1;
+		}
+
+		update_fifo_metrics();
+		metrics_dump(f);
+		fclose(f);
+
+		return 0;
+	}
+	else if (!strcmp(name, "trace")) {
+		if (!strcmp(arg, "on") || !strcmp(arg, "")) {
+			// "off" was mapped to "" above
+			i2c_trace_set(arg[0] != 0);
+			next.i2c_trace = arg[0] != 0;
+			rc = 0;
+		}
+		else if (!strncmp(arg, "dump", 4) && (!arg[4] || arg[4] == ' ')) {
+			if (!dump_i2c_trace(arg[4] ? arg + 5 : NULL)) {
+				snprintf(reply, reply_len, "ok\n");
+				return 0;
 			}
-			linux_delay_ms(loop_delay);
-			
 		}
-		msg_cnt=0;
-		publish(mpu_msg);
-		//publish(msg);
-		
 	}
+	else if (!strcmp(name, "quit")) {
+		done = 1;
+		rc = 0;
+	}
+	else if (!strcmp(name, "rate")) {
+		// the DMP and compass rates can't be set with the gyro off
+		if (low_power) {
+			snprintf(reply, reply_len, "error: rate can't change in low power mode\n");
+			return -1;
+		}
 
-	printf("\n\n");
+		if (!config_set(&next, "sample_rate", arg)) {
+			rc = mpu9150_set_sample_rate(next.sample_rate);
+
+			if (rc > 0) {
+				batch_size = rc;
+				rc = 0;
+			}
+		}
+	}
+	else if (!strcmp(name, "batch")) {
+		if (!config_set(&next, "batch_latency_ms", arg)) {
+			rc = mpu9150_set_batch_latency(next.batch_latency);
+
+			if (rc > 0) {
+				batch_size = rc;
+				rc = 0;
+			}
+		}
+	}
+	else if (!strcmp(name, "still")) {
+		if (!replay_path && !config_set(&next, "still_period_s", arg)) {
+			still_period_ms = 1000 * next.still_period;
+			still_since = 0;
+			rc = 0;
+		}
+	}
+	else if (!strcmp(name, "record")) {
+		if (!config_set(&next, "record", arg)) {
+			rc = start_recorder(next.record_prefix);
+
+			// the old one is closed either way
+			if (rc)
+				config.record_prefix[0] = 0;
+		}
+	}
+	else if (!strcmp(name, "shm")) {
+		if (!config_set(&next, "shm", arg)) {
+			rc = start_shm(next.shm_name);
+
+			// the old one is closed either way
+			if (rc)
+				config.shm_name[0] = 0;
+		}
+	}
+	else if (!strcmp(name, "udp")) {
+		if (!config_set(&next, "udp", arg)) {
+			rc = start_udp(next.udp_dest);
+
+			// the old one is closed either way
+			if (rc)
+				config.udp_dest[0] = 0;
+		}
+	}
+	else {
+		snprintf(reply, reply_len, "error: unknown command %s\n", name);
+		return -1;
+	}
+
+	if (rc) {
+		snprintf(reply, reply_len, "error: %s %s failed\n", name, arg);
+		return -1;
+	}
+
+	memcpy(&config, &next, sizeof(config));
+	set_loop_delay();
+
+	printf("\nControl: %s %s\n", name, arg);
+	snprintf(reply, reply_len, "ok\n");
+
+	return 0;
+}
+
+void shm_add_sample(mpudata_t *mpu)
+{
+	shmslot_t s;
+	struct timeval now;
+	int i;
+
+	gettimeofday(&now, NULL);
+
+	s.host_us = ((uint64_t)now.tv_sec * 1000000) + now.tv_usec;
+	s.dmp_timestamp = mpu->dmpTimestamp;
+
+	for (i = 0; i < 4; i++) {
+		s.fused_quat[i] = mpu->fusedQuat[i];
+		s.raw_quat[i] = mpu->rawQuat[i];
+	}
+
+	for (i = 0; i < 3; i++) {
+		s.fused_euler[i] = mpu->fusedEuler[i];
+		s.raw_accel[i] = mpu->rawAccel[i];
+		s.raw_gyro[i] = mpu->rawGyro[i];
+		s.raw_mag[i] = mpu->rawMag[i];
+		s.cal_accel[i] = mpu->calibratedAccel[i];
+		s.cal_mag[i] = mpu->calibratedMag[i];
+	}
+
+	s.temp = mpu->Temp[0];
+
+	shmring_write(&s);
 }
 
+// Events are rare, send each one on its own as soon as it shows up
+void publish_events(void)
+{
+	MQTTAsync_message evmsg = MQTTAsync_message_initializer;
+	mpuevent_t ev;
+	char buff[MPU_EVENT_LENGTH];
+	struct timeval now, evtv;
+	unsigned long now_ms;
+	uint64_t us;
+	uint32_t value;
+	int rc;
+
+	if (!config.events)
+		return;
 
-void mpu_add_msg(mpudata_t *mpu)
+	gettimeofday(&now, NULL);
+	linux_get_ms(&now_ms);
+
+	while (mpu9150_get_event(&ev)) {
+		// when the DMP reported it, by its age on the linux_get_ms() clock
+		us = ((uint64_t)now.tv_sec * 1000000) + now.tv_usec;
+		us -= (uint64_t)(now_ms - ev.timestamp) * 1000;
+		evtv.tv_sec = us / 1000000;
+		evtv.tv_usec = us % 1000000;
+		memcpy(&buff[0], &evtv, 8);
+
+		buff[8] = ev.type;
+		buff[9] = ev.arg0;
+		buff[10] = ev.arg1;
+
+		value = ev.value;
+		memcpy(&buff[11], &value, 4);
+
+		evmsg.payload = buff;
+		evmsg.payloadlen = MPU_EVENT_LENGTH;
+		evmsg.qos = config.event_qos;
+
+		METRICS_TIME(MET_MQTT_SEND, rc = MQTTAsync_sendMessage(client, config.event_topic, &evmsg, &opts));
+
+		if (rc != MQTTASYNC_SUCCESS) {
+			metrics_count(MET_MQTT_ERRORS, 1);
+			printf("Failed to send event, return code %d\n", rc);
+		}
+	}
+}
+
+// Track how long the sensor has been still. Returns 1 if it went through
+// a low power wake-on-motion period.
+int check_still(mpudata_t *mpu)
+{
+	unsigned long now;
+	int i, moving;
+
+	if (!still_period_ms)
+		return 0;
+
+	linux_get_ms(&now);
+
+	if (motion_at) {
+		printf("\nFirst sample %lu ms after motion detected\n", now - motion_at);
+		motion_at = 0;
+	}
+
+	moving = 0;
+
+	for (i = 0; i < 3; i++) {
+		if (abs(mpu->rawGyro[i]) > STILL_GYRO_LSB)
+			moving = 1;
+
+		if (abs(mpu->rawAccel[i] - still_ref_accel[i]) > STILL_ACCEL_LSB)
+			moving = 1;
+	}
+
+	if (moving || !still_since) {
+		memcpy(still_ref_accel, mpu->rawAccel, sizeof(still_ref_accel));
+		still_since = now;
+		return 0;
+	}
+
+	if (now - still_since < still_period_ms)
+		return 0;
+
+	motion_wait();
+	still_since = 0;
+
+	return 1;
+}
+
+// Sit in accel-only low power mode polling for the motion interrupt, then
+// bring the gyro, compass and DMP back. Transition times are reported.
+void motion_wait(void)
 {
-	short temperature;
-	float ft;
+	unsigned long start, sleeping, woke, resumed, period;
+	int moved;
+
+	printf("\nNo motion for %lu s, entering low power mode\n", still_period_ms / 1000);
+
+	// nothing more is coming to fill the frame
+	if (udp_on)
+		udpsink_flush();
+
+	linux_get_ms(&start);
+
+	if (mpu9150_motion_wait_start(config.wom_thresh_mg, DEFAULT_WOM_LPA_HZ))
+		return;
+
+	linux_get_ms(&sleeping);
+
+	// keep answering the control socket, a new still period starts over
+	// from full power
+	low_power = 1;
+	period = still_period_ms;
+	moved = 0;
 
+	while (!done && period == still_period_ms) {
+		if (mpu9150_motion_detected()) {
+			moved = 1;
+			break;
+		}
+
+		linux_delay_ms(DEFAULT_WOM_POLL_MS);
+
+		control_poll(control_cmd);
+
+		check_metrics();
+	}
+
+	low_power = 0;
+	linux_get_ms(&woke);
+
+	if (mpu9150_motion_wait_stop()) {
+		done = 1;
+		return;
+	}
+
+	linux_get_ms(&resumed);
+
+	printf("Low power for %lu s, enter %lu ms, resume %lu ms\n",
+		(woke - sleeping) / 1000, sleeping - start, resumed - woke);
+
+	if (moved)
+		motion_at = woke;
+}
+
+void mpu_add_msg(mpudata_t *mpu)
+{
 	//time stamp
 	gettimeofday(&tv, NULL); //get time!!
 	memcpy (&mpu_msg[0], &tv, 8); //4byte for each sec and usec
@@ -505,59 +1266,14 @@ void mpu_add_msg(mpudata_t *mpu)
 	memcpy (&mpu_msg[16], &(mpu->fusedQuat[QUAT_Y]), 4); 
 	memcpy (&mpu_msg[20], &(mpu->fusedQuat[QUAT_Z]), 4); 
 
-	//temperature
-	mpu_get_temperature(&temperature,NULL);
-
-	memcpy (&mpu_msg[24], &temperature, 2); 
-	ft=temperature/340.0f+35.0f;
-	printf("%d\n", temperature);
+	//temperature, read with the mag once per batch
+	memcpy (&mpu_msg[24], &mpu->Temp[0], 2); 
 	msg_cnt++;
 		
 }
 
 
 
-void print_fused_euler_angles(mpudata_t *mpu)
-{
-	printf("\rX: %0.0f Y: %0.0f Z: %0.0f        ",
-			mpu->fusedEuler[VEC3_X] * RAD_TO_DEGREE, 
-			mpu->fusedEuler[VEC3_Y] * RAD_TO_DEGREE, 
-			mpu->fusedEuler[VEC3_Z] * RAD_TO_DEGREE);
-
-	fflush(stdout);
-}
-
-void print_fused_quaternions(mpudata_t *mpu)
-{
-	printf("\rW: %0.2f X: %0.2f Y: %0.2f Z: %0.2f        ",
-			mpu->fusedQuat[QUAT_W],
-			mpu->fusedQuat[QUAT_X],
-			mpu->fusedQuat[QUAT_Y],
-			mpu->fusedQuat[QUAT_Z]);
-	//printf("%d\n",sizeof(mpu->fusedQuat[QUAT_W]) );
-	fflush(stdout);
-}
-
-void print_calibrated_accel(mpudata_t *mpu)
-{
-	printf("\rX: %05d Y: %05d Z: %05d        ",
-			mpu->calibratedAccel[VEC3_X], 
-			mpu->calibratedAccel[VEC3_Y], 
-			mpu->calibratedAccel[VEC3_Z]);
-
-	fflush(stdout);
-}
-
-void print_calibrated_mag(mpudata_t *mpu)
-{
-	printf("\rX: %03d Y: %03d Z: %03d        ",
-			mpu->calibratedMag[VEC3_X], 
-			mpu->calibratedMag[VEC3_Y], 
-			mpu->calibratedMag[VEC3_Z]);
-
-	fflush(stdout);
-}
-
 int set_cal(int mag, char *cal_file)
 {
 	int i;
@@ -641,9 +1357,34 @@ void register_sig_handler()
 		perror("sigaction(SIGINT)");
 		exit(1);
 	} 
+
+	sia.sa_handler = sigusr1_handler;
+
+	if (sigaction(SIGUSR1, &sia, NULL) < 0) {
+		perror("sigaction(SIGUSR1)");
+		exit(1);
+	}
+
+	sia.sa_handler = sigusr2_handler;
+
+	if (sigaction(SIGUSR2, &sia, NULL) < 0) {
+		perror("sigaction(SIGUSR2)");
+		exit(1);
+	}
 }
 
 void sigint_handler(int sig)
 {
 	done = 1;
 }
+
+// the read loop does the printing
+void sigusr1_handler(int sig)
+{
+	dump_metrics = 1;
+}
+
+void sigusr2_handler(int sig)
+{
+	dump_trace = 1;
+}
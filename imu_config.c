@@ -0,0 +1,250 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "imu_config.h"
+#include "mpu9150.h"
+#include "linux_glue.h"
+#include "udpsink.h"
+#include "local_defaults.h"
+
+#define CFG_INT		0
+#define CFG_STR		1
+
+typedef struct {
+	const char *key;
+	int type;
+	size_t offset;
+	int min;
+	int max;	// string buffer size for CFG_STR
+} cfgkey_t;
+
+#define INT_KEY(k, field, lo, hi) { k, CFG_INT, offsetof(imuconfig_t, field), lo, hi }
+#define STR_KEY(k, field) { k, CFG_STR, offsetof(imuconfig_t, field), 0, sizeof(((imuconfig_t *)0)->field) }
+
+static const cfgkey_t keys[] = {
+	STR_KEY("broker", broker),
+	STR_KEY("client_id", client_id),
+	STR_KEY("topic", topic),
+	STR_KEY("event_topic", event_topic),
+	INT_KEY("qos", qos, 0, 2),
+	INT_KEY("event_qos", event_qos, 0, 2),
+	INT_KEY("keepalive", keepalive, 1, 65535),
+
+	INT_KEY("i2c_bus", i2c_bus, MIN_I2C_BUS, MAX_I2C_BUS),
+	INT_KEY("sample_rate", sample_rate, MIN_SAMPLE_RATE, MAX_SAMPLE_RATE),
+	INT_KEY("yaw_mix_factor", yaw_mix_factor, 0, 100),
+	STR_KEY("accel_cal", accel_cal),
+	STR_KEY("mag_cal", mag_cal),
+
+	INT_KEY("batch_latency_ms", batch_latency, 0, 1000),
+	INT_KEY("still_period_s", still_period, 0, 86400),
+	INT_KEY("wom_thresh_mg", wom_thresh_mg, 32, 8160),
+	INT_KEY("events", events, 0, 1),
+	INT_KEY("display_hz", display_hz, 0, 50),
+	STR_KEY("metrics_file", metrics_file),
+	INT_KEY("metrics_interval_s", metrics_interval, 1, 3600),
+	INT_KEY("i2c_trace", i2c_trace, 0, 1),
+	STR_KEY("i2c_trace_file", i2c_trace_file),
+
+	STR_KEY("record", record_prefix),
+	STR_KEY("shm", shm_name),
+	STR_KEY("udp", udp_dest),
+	INT_KEY("udp_batch", udp_batch, 1, UDP_MAX_BATCH),
+
+	STR_KEY("control_socket", control_socket)
+};
+
+#define NUM_KEYS (sizeof(keys) / sizeof(keys[0]))
+
+static char *trim(char *s);
+
+void config_init(imuconfig_t *cfg)
+{
+	memset(cfg, 0, sizeof(imuconfig_t));
+
+	strcpy(cfg->broker, DEFAULT_MQTT_BROKER);
+	strcpy(cfg->client_id, DEFAULT_MQTT_CLIENT_ID);
+	strcpy(cfg->topic, DEFAULT_MQTT_TOPIC);
+	strcpy(cfg->event_topic, DEFAULT_MQTT_EVENT_TOPIC);
+	cfg->qos = DEFAULT_MQTT_QOS;
+	cfg->event_qos = DEFAULT_MQTT_EVENT_QOS;
+	cfg->keepalive = DEFAULT_MQTT_KEEPALIVE_S;
+
+	cfg->i2c_bus = DEFAULT_I2C_BUS;
+	cfg->sample_rate = DEFAULT_SAMPLE_RATE_HZ;
+	cfg->yaw_mix_factor = DEFAULT_YAW_MIX_FACTOR;
+
+	cfg->batch_latency = DEFAULT_BATCH_LATENCY_MS;
+	cfg->still_period = DEFAULT_STILL_PERIOD_S;
+	cfg->wom_thresh_mg = DEFAULT_WOM_THRESH_MG;
+	cfg->display_hz = DEFAULT_DISPLAY_HZ;
+	cfg->metrics_interval = DEFAULT_METRICS_INTERVAL_S;
+	strcpy(cfg->i2c_trace_file, DEFAULT_I2C_TRACE_FILE);
+
+	cfg->udp_batch = DEFAULT_UDP_BATCH;
+
+	strcpy(cfg->control_socket, DEFAULT_CONTROL_SOCKET);
+}
+
+// Returns 0 if the file was read or is missing and must_exist is not set,
+// -1 on a bad line or an unreadable file.
+int config_load(imuconfig_t *cfg, const char *path, int must_exist)
+{
+	FILE *f;
+	char line[512];
+	char *key, *value, *p;
+	int line_num, errors;
+
+	f = fopen(path, "r");
+
+	if (!f) {
+		if (!must_exist)
+			return 0;
+
+		perror("open(<config-file>)");
+		return -1;
+	}
+
+	line_num = 0;
+	errors = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		line_num++;
+
+		p = strchr(line, '#');
+
+		if (p)
+			*p = 0;
+
+		key = trim(line);
+
+		if (!*key)
+			continue;
+
+		p = strchr(key, '=');
+
+		if (!p) {
+			printf("%s:%d: expected key = value\n", path, line_num);
+			errors++;
+			continue;
+		}
+
+		*p = 0;
+		key = trim(key);
+		value = trim(p + 1);
+
+		if (config_set(cfg, key, value)) {
+			printf("%s:%d: bad setting\n", path, line_num);
+			errors++;
+		}
+	}
+
+	fclose(f);
+
+	return errors ? -1 : 0;
+}
+
+int config_set(imuconfig_t *cfg, const char *key, const char *value)
+{
+	const cfgkey_t *k;
+	char *field, *end;
+	long val;
+	int i;
+
+	for (i = 0; i < NUM_KEYS; i++) {
+		if (!strcmp(keys[i].key, key))
+			break;
+	}
+
+	if (i == NUM_KEYS) {
+		printf("Unknown setting %s\n", key);
+		return -1;
+	}
+
+	k = &keys[i];
+	field = (char *)cfg + k->offset;
+
+	if (k->type == CFG_STR) {
+		if (strlen(value) >= k->max) {
+			printf("%s is too long, max %d characters\n", key, k->max - 1);
+			return -1;
+		}
+
+		strcpy(field, value);
+		return 0;
+	}
+
+	val = strtol(value, &end, 0);
+
+	if (end == value || *end || val < k->min || val > k->max) {
+		printf("Invalid %s %s, range %d-%d\n", key, value, k->min, k->max);
+		return -1;
+	}
+
+	*(int *)field = val;
+
+	return 0;
+}
+
+// Dump the settings in config file format. Returns the length written.
+int config_print(imuconfig_t *cfg, char *buff, int len)
+{
+	const char *field;
+	int i, n;
+
+	n = 0;
+
+	for (i = 0; i < NUM_KEYS && n < len; i++) {
+		field = (const char *)cfg + keys[i].offset;
+
+		if (keys[i].type == CFG_STR)
+			n += snprintf(buff + n, len - n, "%s = %s\n", keys[i].key, field);
+		else
+			n += snprintf(buff + n, len - n, "%s = %d\n", keys[i].key, *(int *)field);
+	}
+
+	return n < len ? n : len - 1;
+}
+
+static char *trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char)*s))
+		s++;
+
+	end = s + strlen(s);
+
+	while (end > s && isspace((unsigned char)end[-1]))
+		end--;
+
+	*end = 0;
+
+	return s;
+}
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef IMU_CONFIG_H
+#define IMU_CONFIG_H
+
+// Run time settings for imu. Defaults come from local_defaults.h, then the
+// config file, then the command line. The file is plain key = value lines,
+// '#' starts a comment. config_set() takes the same keys and is used for
+// all three sources so the range checks live in one place.
+
+typedef struct {
+	char broker[128];
+	char client_id[64];
+	char topic[128];
+	char event_topic[128];
+	int qos;
+	int event_qos;
+	int keepalive;
+
+	int i2c_bus;
+	int sample_rate;
+	int yaw_mix_factor;
+	char accel_cal[256];
+	char mag_cal[256];
+
+	int batch_latency;
+	int still_period;
+	int wom_thresh_mg;
+	int events;
+	int display_hz;
+
+	char metrics_file[240];
+	int metrics_interval;
+
+	int i2c_trace;
+	char i2c_trace_file[240];
+
+	char record_prefix[240];
+	char shm_name[64];
+	char udp_dest[64];
+	int udp_batch;
+
+	char control_socket[108];
+} imuconfig_t;
+
+void config_init(imuconfig_t *cfg);
+int config_load(imuconfig_t *cfg, const char *path, int must_exist);
+int config_set(imuconfig_t *cfg, const char *key, const char *value);
+int config_print(imuconfig_t *cfg, char *buff, int len);
+
+#endif /* IMU_CONFIG_H */
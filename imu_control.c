@@ -0,0 +1,142 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "imu_control.h"
+
+static int ctl_fd = -1;
+static char ctl_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+int control_open(const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (!path || !*path)
+		return 0;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Invalid control socket path %s\n", path);
+		return -1;
+	}
+
+	ctl_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+	if (ctl_fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// left behind by a previous run
+	unlink(path);
+
+	if (bind(ctl_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind(<control-socket>)");
+		close(ctl_fd);
+		ctl_fd = -1;
+		return -1;
+	}
+
+	strcpy(ctl_path, path);
+
+	// commands can stop sinks and write files, owner only
+	chmod(path, 0600);
+
+	if (fcntl(ctl_fd, F_SETFL, O_NONBLOCK) < 0) {
+		perror("fcntl");
+		control_close();
+		return -1;
+	}
+
+	return 0;
+}
+
+// Run every queued command. Returns the number handled.
+int control_poll(control_handler_t handler)
+{
+	struct sockaddr_un from;
+	socklen_t from_len;
+	char cmd[CONTROL_MAX_CMD];
+	char reply[CONTROL_MAX_REPLY];
+	int n, count, len;
+
+	if (ctl_fd < 0)
+		return 0;
+
+	count = 0;
+
+	while (1) {
+		from_len = sizeof(from);
+		n = recvfrom(ctl_fd, cmd, sizeof(cmd) - 1, 0, (struct sockaddr *)&from, &from_len);
+
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				perror("recvfrom(<control-socket>)");
+
+			break;
+		}
+
+		cmd[n] = 0;
+
+		// tolerate echo "cmd" | socat style trailing newlines
+		while (n > 0 && (cmd[n - 1] == '\n' || cmd[n - 1] == '\r'))
+			cmd[--n] = 0;
+
+		reply[0] = 0;
+		handler(cmd, reply, sizeof(reply));
+		count++;
+
+		// unbound senders have no address to answer to
+		if (from_len <= sizeof(sa_family_t))
+			continue;
+
+		len = strlen(reply);
+
+		if (sendto(ctl_fd, reply, len, MSG_DONTWAIT, (struct sockaddr *)&from, from_len) < 0)
+			perror("sendto(<control-socket>)");
+	}
+
+	return count;
+}
+
+void control_close()
+{
+	if (ctl_fd < 0)
+		return;
+
+	close(ctl_fd);
+	ctl_fd = -1;
+	unlink(ctl_path);
+}
@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "imu_display.h"
+
+// seqlock, odd while the writer is copying
+typedef struct {
+	uint32_t seq;
+	mpudata_t mpu;
+} latest_t;
+
+static latest_t latest;
+static unsigned long display_period_us;
+static volatile int display_running;
+static pthread_t display_thread;
+
+static void *display_loop(void *arg);
+static int read_latest(mpudata_t *mpu, uint32_t *seq);
+
+// A rate of 0 is quiet mode, no thread is started
+int display_start(int rate_hz)
+{
+	int rc;
+
+	if (rate_hz <= 0)
+		return 0;
+
+	display_period_us = 1000000 / rate_hz;
+	display_running = 1;
+
+	rc = pthread_create(&display_thread, NULL, display_loop, NULL);
+
+	if (rc) {
+		printf("pthread_create(display) failed: %s\n", strerror(rc));
+		display_running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Called for every sample, never blocks
+void display_update(mpudata_t *mpu)
+{
+	uint32_t seq;
+
+	if (!display_running)
+		return;
+
+	seq = latest.seq;
+
+	__atomic_store_n(&latest.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(&latest.mpu, mpu, sizeof(mpudata_t));
+
+	__atomic_store_n(&latest.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void display_stop()
+{
+	if (!display_running)
+		return;
+
+	display_running = 0;
+	pthread_join(display_thread, NULL);
+}
+
+static void *display_loop(void *arg)
+{
+	mpudata_t mpu;
+	uint32_t seq, last_seq;
+	char buff[128];
+	int len;
+
+	last_seq = 0;
+
+	while (display_running) {
+		// plain usleep, linux_delay_ms() drives the simulator clock
+		usleep(display_period_us);
+
+		if (read_latest(&mpu, &seq) || seq == last_seq)
+			continue;
+
+		last_seq = seq;
+
+		len = snprintf(buff, sizeof(buff), "\rW: %0.2f X: %0.2f Y: %0.2f Z: %0.2f  T: %0.1f C        ",
+				mpu.fusedQuat[QUAT_W],
+				mpu.fusedQuat[QUAT_X],
+				mpu.fusedQuat[QUAT_Y],
+				mpu.fusedQuat[QUAT_Z],
+				(mpu.Temp[0] / 340.0f) + 35.0f);
+
+		// straight to the fd, a blocked write must not hold the stdio
+		// lock the read loop's own messages need
+		if (write(STDOUT_FILENO, buff, len) < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+// Returns 0 with a consistent copy, -1 if the writer kept getting in the way
+static int read_latest(mpudata_t *mpu, uint32_t *seq)
+{
+	uint32_t seq1, seq2;
+	int tries;
+
+	for (tries = 0; tries < 10; tries++) {
+		seq1 = __atomic_load_n(&latest.seq, __ATOMIC_ACQUIRE);
+
+		if (seq1 & 1)
+			continue;
+
+		memcpy(mpu, &latest.mpu, sizeof(mpudata_t));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&latest.seq, __ATOMIC_RELAXED);
+
+		if (seq1 == seq2) {
+			*seq = seq1;
+			return 0;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Send one command to a running imu over its control socket and print the
+// reply, e.g.
+//
+//   imuctl rate 50
+//   imuctl batch 100
+//   imuctl udp 239.0.0.1:5500
+//   imuctl status
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "imu_control.h"
+#include "local_defaults.h"
+
+#define REPLY_TIMEOUT_MS	2000
+
+void usage(char *argv_0)
+{
+	printf("\nUsage: %s [options] <command> [args]\n", argv_0);
+	printf("  -s <path>             Control socket. The default is %s\n", DEFAULT_CONTROL_SOCKET);
+	printf("  -h                    Show this help\n");
+	printf("\nCommands:\n");
+	printf("  rate <hz>             Change the sample rate\n");
+	printf("  batch <latency-ms>    Change batching, 0 reads one sample at a time\n");
+	printf("  still <seconds>       Change the wake-on-motion still period, 0 = off\n");
+	printf("  record <prefix>|off   Start or stop the binary recorder\n");
+	printf("  shm <name>|off        Start or stop the shared memory ring\n");
+	printf("  udp <addr:port>|off   Start or stop the UDP sink\n");
+	printf("  status                Show the current settings\n");
+	printf("  trace on|off          Start or stop I2C transaction tracing\n");
+	printf("  trace dump [file]     Write the I2C trace ring, decode it with i2ctrace\n");
+	printf("  metrics [reset]       Show or clear the latency histograms and counters\n");
+	printf("  quit                  Stop imu\n");
+
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, fd, i, n, len;
+	char *path = DEFAULT_CONTROL_SOCKET;
+	char cmd[CONTROL_MAX_CMD];
+	char reply[CONTROL_MAX_REPLY];
+	struct sockaddr_un addr, local;
+	struct timeval tv;
+
+	while ((opt = getopt(argc, argv, "s:h")) != -1) {
+		switch (opt) {
+		case 's':
+			path = optarg;
+			break;
+
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage(argv[0]);
+
+	len = 0;
+	cmd[0] = 0;
+
+	for (i = optind; i < argc; i++) {
+		n = snprintf(cmd + len, sizeof(cmd) - len, "%s%s", i > optind ? " " : "", argv[i]);
+
+		if (n >= sizeof(cmd) - len) {
+			printf("Command too long\n");
+			exit(1);
+		}
+
+		len += n;
+	}
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Invalid control socket path %s\n", path);
+		exit(1);
+	}
+
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	// bind somewhere so imu can answer
+	memset(&local, 0, sizeof(local));
+	local.sun_family = AF_UNIX;
+	snprintf(local.sun_path, sizeof(local.sun_path), "/tmp/imuctl.%d", getpid());
+	unlink(local.sun_path);
+
+	if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		perror("bind");
+		exit(1);
+	}
+
+	tv.tv_sec = REPLY_TIMEOUT_MS / 1000;
+	tv.tv_usec = (REPLY_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (sendto(fd, cmd, len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("sendto(<control-socket>)");
+		unlink(local.sun_path);
+		exit(1);
+	}
+
+	n = recv(fd, reply, sizeof(reply) - 1, 0);
+
+	close(fd);
+	unlink(local.sun_path);
+
+	if (n < 0) {
+		printf("No reply from imu\n");
+		exit(1);
+	}
+
+	reply[n] = 0;
+	printf("%s", reply);
+
+	// replies to failed commands start with "error"
+	return strncmp(reply, "error", 5) ? 0 : 1;
+}
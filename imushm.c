@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Example reader for the imu shared memory ring. Prints the newest sample
+// a few times a second or, with -a, every sample as it arrives.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "shmring.h"
+#include "local_defaults.h"
+
+#define RAD_TO_DEGREE	(180.0f / 3.14159265f)
+
+void print_sample(shmslot_t *s);
+void register_sig_handler();
+void sigint_handler(int sig);
+
+int done;
+
+void usage(char *argv_0)
+{
+	printf("\nUsage: %s [options]\n", argv_0);
+	printf("  -n <name>             Shared memory name. The default is %s\n", DEFAULT_SHM_NAME);
+	printf("  -a                    Print every sample instead of the latest\n");
+	printf("  -h                    Show this help\n");
+
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, all = 0;
+	char *name = DEFAULT_SHM_NAME;
+	shmring_t *ring;
+	shmslot_t s;
+	uint32_t next;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "n:ah")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+
+		case 'a':
+			all = 1;
+			break;
+
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+
+	ring = shmring_open(name);
+
+	if (!ring)
+		exit(1);
+
+	register_sig_handler();
+
+	next = shmring_head(ring);
+
+	while (!done) {
+		if (!all) {
+			if (shmring_read_latest(ring, &s) == 0)
+				print_sample(&s);
+
+			usleep(100000);
+			continue;
+		}
+
+		rc = shmring_read(ring, next, &s);
+
+		if (rc == -1) {
+			usleep(1000);
+			continue;
+		}
+
+		if (rc == -2) {
+			printf("lost samples %u to %u\n", next, shmring_head(ring) - ring->num_slots);
+			next = shmring_head(ring) - 1;
+			continue;
+		}
+
+		print_sample(&s);
+		next++;
+	}
+
+	shmring_close(ring);
+
+	return 0;
+}
+
+void print_sample(shmslot_t *s)
+{
+	printf("%u  W: %0.2f X: %0.2f Y: %0.2f Z: %0.2f  Euler %0.0f %0.0f %0.0f\n",
+		s->index,
+		s->fused_quat[0], s->fused_quat[1], s->fused_quat[2], s->fused_quat[3],
+		s->fused_euler[0] * RAD_TO_DEGREE,
+		s->fused_euler[1] * RAD_TO_DEGREE,
+		s->fused_euler[2] * RAD_TO_DEGREE);
+}
+
+void register_sig_handler()
+{
+	struct sigaction sia;
+
+	memset(&sia, 0, sizeof sia);
+	sia.sa_handler = sigint_handler;
+
+	if (sigaction(SIGINT, &sia, NULL) < 0) {
+		perror("sigaction(SIGINT)");
+		exit(1);
+	} 
+}
+
+void sigint_handler(int sig)
+{
+	done = 1;
+}
@@ -43,5 +43,60 @@
 
 #define DEFAULT_YAW_MIX_FACTOR 4
 
+// Batch mode: let the FIFO collect samples for up to this many ms and
+// drain them in one burst. 0 reads one sample per wakeup.
+#define DEFAULT_BATCH_LATENCY_MS 0
+
+// Wake-on-motion: after this many seconds without motion drop to the
+// accel-only low power mode until the motion interrupt fires. 0 disables.
+#define DEFAULT_STILL_PERIOD_S 0
+
+// Motion interrupt threshold in mg (32 mg steps on the MPU-9150), the
+// accel wake-up rate in Hz while in low power mode and how often the
+// interrupt status is polled.
+#define DEFAULT_WOM_THRESH_MG 64
+#define DEFAULT_WOM_LPA_HZ 5
+#define DEFAULT_WOM_POLL_MS 100
+
+// Binary recorder: records per segment file (104 bytes each, 65536 is
+// about 5 minutes at 200 Hz) and how many segments to keep, 0 keeps all.
+#define DEFAULT_REC_SEGMENT_RECORDS 65536
+#define DEFAULT_REC_MAX_SEGMENTS 16
+
+// Shared memory ring for local readers, see imushm
+#define DEFAULT_SHM_NAME "/mpu9150"
+#define DEFAULT_SHM_SLOTS 256
+
+// UDP sink: samples per frame (max 13), how long a sample may wait for
+// its frame to fill and the multicast TTL
+#define DEFAULT_UDP_BATCH 10
+#define DEFAULT_UDP_LATENCY_MS 50
+#define DEFAULT_UDP_TTL 1
+
+// How often imu prints the latest sample, 0 is the same as -q
+#define DEFAULT_DISPLAY_HZ 4
+
+// How often the metrics file is rewritten, see imu -k
+#define DEFAULT_METRICS_INTERVAL_S 10
+
+// Where the I2C trace ring goes on exit, kill -USR2 or imuctl trace dump
+#define DEFAULT_I2C_TRACE_FILE "/tmp/imu-i2c.trace"
+
+// MQTT connection, all of these can be changed in the config file
+#define DEFAULT_MQTT_BROKER "tcp://m2m.eclipse.org:1883"
+#define DEFAULT_MQTT_CLIENT_ID "RPi_71"
+#define DEFAULT_MQTT_TOPIC "MQTT_MPU"
+#define DEFAULT_MQTT_EVENT_TOPIC "MQTT_MPU/events"
+#define DEFAULT_MQTT_QOS 1
+#define DEFAULT_MQTT_EVENT_QOS 1
+#define DEFAULT_MQTT_KEEPALIVE_S 700
+
+// imu reads this at startup if there is no -c option, a missing file is
+// not an error
+#define DEFAULT_CONFIG_FILE "./imu.conf"
+
+// Unix datagram socket for runtime control, see imuctl. Empty disables.
+#define DEFAULT_CONTROL_SOCKET "/tmp/imu.ctl"
+
 #endif /* LOCAL_DEFAULTS_H */
 
@@ -28,13 +28,22 @@
 #include "inv_mpu.h"
 #include "inv_mpu_dmp_motion_driver.h"
 #include "mpu9150.h"
+#include "metrics.h"
+#include "replay.h"
 
 static int data_ready();
 static void calibrate_data(mpudata_t *mpu);
 static void tilt_compensate(quaternion_t magQ, quaternion_t unfusedQ);
 static int data_fusion(mpudata_t *mpu);
+static int read_fifo_packet(mpudata_t *mpu, unsigned char *more);
+static void read_temperature(mpudata_t *mpu);
+static int fuse_sample(mpudata_t *mpu);
 static unsigned short inv_row_2_scale(const signed char *row);
 static unsigned short inv_orientation_matrix_to_scalar(const signed char *mtx);
+static void tap_cb(unsigned char direction, unsigned char count);
+static void android_orient_cb(unsigned char orientation);
+static void queue_event(unsigned char type, unsigned char arg0, unsigned char arg1, unsigned long value);
+static void backdate_events(unsigned long queued, unsigned long ms);
 
 int debug_on;
 int yaw_mixing_factor;
@@ -45,16 +54,55 @@ caldata_t accel_cal_data;
 int use_mag_cal;
 caldata_t mag_cal_data;
 
+static int fifo_rate;
+static int replay_mode;
+
+// DMP gesture and pedometer events
+#define EVENT_QUEUE_SIZE 16
+#define PEDOMETER_POLL_MS 1000
+
+static int events_on;
+static mpuevent_t event_queue[EVENT_QUEUE_SIZE];
+static int event_head;
+static int event_count;
+static unsigned long events_queued;
+static unsigned long last_step_count;
+static unsigned long last_step_poll;
+
+// batch mode state
+static int batch_size;
+static int batch_latency;
+static float batch_sample_ms;
+static unsigned long batch_last_drain;
+
+// set by the caller to cut a blocking wait short, see mpu9150_set_stop_flag()
+static volatile int *stop_flag;
+
 void mpu9150_set_debug(int on)
 {
 	debug_on = on;
 }
 
+// Call before mpu9150_init() to have the DMP run tap, orientation and
+// pedometer detection. Events are collected with mpu9150_get_event().
+void mpu9150_set_events(int on)
+{
+	events_on = on;
+}
+
+// Blocking waits in here give up early once *stop is non-zero, so a
+// signal handler setting it is seen without waiting out a whole batch.
+void mpu9150_set_stop_flag(volatile int *stop)
+{
+	stop_flag = stop;
+}
+
 int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
 {
 	signed char gyro_orientation[9] = { 1, 0, 0,
                                         0, 1, 0,
                                         0, 0, 1 };
+	unsigned short features;
 
 	if (i2c_bus < MIN_I2C_BUS || i2c_bus > MAX_I2C_BUS) {
 		printf("Invalid I2C bus %d\n", i2c_bus);
@@ -72,6 +120,9 @@ int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
 	}
 
 	yaw_mixing_factor = mix_factor;
+	fifo_rate = sample_rate;
+	batch_size = 1;
+	batch_sample_ms = 1000.0f / sample_rate;
 
 	linux_set_i2c_bus(i2c_bus);
 
@@ -134,8 +185,16 @@ int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
 	printf(".");
 	fflush(stdout);
 
-  	if (dmp_enable_feature(DMP_FEATURE_6X_LP_QUAT | DMP_FEATURE_SEND_RAW_ACCEL 
-						| DMP_FEATURE_SEND_CAL_GYRO | DMP_FEATURE_GYRO_CAL)) {
+	features = DMP_FEATURE_6X_LP_QUAT | DMP_FEATURE_SEND_RAW_ACCEL 
+			| DMP_FEATURE_SEND_CAL_GYRO | DMP_FEATURE_GYRO_CAL;
+
+	if (events_on) {
+		features |= DMP_FEATURE_TAP | DMP_FEATURE_ANDROID_ORIENT;
+		dmp_register_tap_cb(tap_cb);
+		dmp_register_android_orient_cb(android_orient_cb);
+	}
+
+  	if (dmp_enable_feature(features)) {
 		printf("\ndmp_enable_feature() failed\n");
 		return -1;
 	}
@@ -156,13 +215,63 @@ int mpu9150_init(int i2c_bus, int sample_rate, int mix_factor)
 		return -1;
 	}
 
+	// realign on the next good packet after an I2C glitch instead of
+	// throwing away everything queued in the FIFO
+	if (dmp_set_fifo_resync(1)) {
+		printf("\ndmp_set_fifo_resync() failed\n");
+		return -1;
+	}
+
 	printf(" done\n\n");
 
 	return 0;
 }
 
+// Run the pipeline from a replay log instead of the sensor. Nothing is
+// done on the I2C bus, mpu9150_read() returns the next logged sample.
+int mpu9150_init_replay(const char *path, int realtime, int sample_rate, int mix_factor)
+{
+	if (sample_rate < MIN_SAMPLE_RATE || sample_rate > MAX_SAMPLE_RATE) {
+		printf("Invalid sample rate %d\n", sample_rate);
+		return -1;
+	}
+
+	if (mix_factor < 0 || mix_factor > 100) {
+		printf("Invalid mag mixing factor %d\n", mix_factor);
+		return -1;
+	}
+
+	yaw_mixing_factor = mix_factor;
+
+	fifo_rate = sample_rate;
+	batch_size = 1;
+	batch_sample_ms = 1000.0f / sample_rate;
+
+	// gestures and steps need the DMP
+	events_on = 0;
+
+	if (replay_open(path, realtime))
+		return -1;
+
+	printf("\nReplaying %s %s\n", path, realtime ? "in real time" : "as fast as possible");
+
+	replay_mode = 1;
+
+	return 0;
+}
+
+int mpu9150_replay_done()
+{
+	return replay_mode && replay_eof();
+}
+
 void mpu9150_exit()
 {
+	if (replay_mode) {
+		replay_close();
+		return;
+	}
+
 	// turn off the DMP on exit 
 	if (mpu_set_dmp_state(0))
 		printf("mpu_set_dmp_state(0) failed\n");
@@ -238,20 +347,21 @@ void mpu9150_set_mag_cal(caldata_t *cal)
 
 int mpu9150_read_dmp(mpudata_t *mpu)
 {
-	short sensors;
 	unsigned char more;
 
 	if (!data_ready())
 		return -1;
 
-	if (dmp_read_fifo(mpu->rawGyro, mpu->rawAccel, mpu->rawQuat, &mpu->dmpTimestamp, &sensors, &more) < 0) {
+	if (read_fifo_packet(mpu, &more) < 0) {
 		printf("dmp_read_fifo() failed\n");
 		return -1;
 	}
 
 	while (more) {
-		// Fell behind, reading again
-		if (dmp_read_fifo(mpu->rawGyro, mpu->rawAccel, mpu->rawQuat, &mpu->dmpTimestamp, &sensors, &more) < 0) {
+		// Fell behind, reading again and losing the previous packet
+		metrics_count(MET_DROPPED_SAMPLES, 1);
+
+		if (read_fifo_packet(mpu, &more) < 0) {
 			printf("dmp_read_fifo() failed\n");
 			return -1;
 		}
@@ -270,19 +380,372 @@ int mpu9150_read_mag(mpudata_t *mpu)
 	return 0;
 }
 
+// Pick the number of packets to collect in the FIFO before waking up so
+// that the oldest sample in a batch is never more than latency_ms old.
+// Returns the batch size, 1 means no batching.
+int mpu9150_set_batch_latency(int latency_ms)
+{
+	if (latency_ms < 0) {
+		printf("Invalid batch latency %d\n", latency_ms);
+		return -1;
+	}
+
+	batch_latency = latency_ms;
+	batch_size = (latency_ms * fifo_rate) / 1000;
+
+	if (batch_size < 1)
+		batch_size = 1;
+	else if (batch_size > MAX_BATCH_SIZE)
+		batch_size = MAX_BATCH_SIZE;
+
+	batch_sample_ms = 1000.0f / fifo_rate;
+	linux_get_ms(&batch_last_drain);
+
+	if (debug_on)
+		printf("batch size %d (%d ms latency at %d Hz)\n", batch_size, latency_ms, fifo_rate);
+
+	return batch_size;
+}
+
+// Change the output rate while running. Only the DMP rate divider and the
+// compass rate are written, the firmware and FIFO setup are left alone so
+// there is no gap in the quaternion. The batch size is rescaled to keep
+// the same latency. Returns the new batch size or -1.
+int mpu9150_set_sample_rate(int sample_rate)
+{
+	if (sample_rate < MIN_SAMPLE_RATE || sample_rate > MAX_SAMPLE_RATE) {
+		printf("Invalid sample rate %d\n", sample_rate);
+		return -1;
+	}
+
+	if (!replay_mode) {
+		if (dmp_set_fifo_rate(sample_rate)) {
+			printf("dmp_set_fifo_rate() failed\n");
+			return -1;
+		}
+
+		if (mpu_set_compass_sample_rate(sample_rate)) {
+			printf("mpu_set_compass_sample_rate() failed\n");
+			return -1;
+		}
+	}
+
+	fifo_rate = sample_rate;
+
+	return mpu9150_set_batch_latency(batch_latency);
+}
+
+// Sleep until the FIFO should hold batch_size packets, check with a single
+// FIFO_COUNT read and drain them in one burst. The mag is read once per
+// batch. Every packet is calibrated and fused in order, mpu is left with
+// the newest sample and each one is copied to samples.
+// Returns the number of samples or -1.
+int mpu9150_read_batch(mpudata_t *mpu, mpudata_t *samples, int max_samples)
+{
+	unsigned short count;
+	unsigned long now, due, start, limit, wait;
+	unsigned char more;
+	unsigned long queued;
+	float elapsed;
+	int n, stalled;
+
+	if (max_samples < 1)
+		return -1;
+
+	if (replay_mode) {
+		n = 0;
+
+		for (count = 0; count < batch_size && n < max_samples; count++) {
+			if (replay_read(mpu) != 0)
+				break;
+
+			if (fuse_sample(mpu) == 0)
+				memcpy(&samples[n++], mpu, sizeof(mpudata_t));
+		}
+
+		return n > 0 ? n : -1;
+	}
+
+	linux_get_ms(&now);
+	due = batch_last_drain + (unsigned long)(batch_size * batch_sample_ms);
+
+	if (due > now)
+		linux_delay_ms(due - now);
+
+	if (dmp_get_fifo_packet_count(&count) < 0) {
+		printf("dmp_get_fifo_packet_count() failed\n");
+		return -1;
+	}
+
+	// Woke up early, sleep for the packets still missing. Bounded so a FIFO
+	// that stopped filling (brown-out, DMP stall) can't hold the caller here.
+	linux_get_ms(&start);
+	limit = 2 * (unsigned long)(batch_size * batch_sample_ms);
+	stalled = 0;
+
+	while (count < batch_size) {
+		linux_get_ms(&now);
+
+		if ((stop_flag && *stop_flag) || now - start >= limit) {
+			stalled = 1;
+			break;
+		}
+
+		wait = 1 + (unsigned long)((batch_size - count) * batch_sample_ms);
+
+		if (wait > limit - (now - start))
+			wait = limit - (now - start);
+
+		linux_delay_ms(wait);
+
+		if (dmp_get_fifo_packet_count(&count) < 0) {
+			printf("dmp_get_fifo_packet_count() failed\n");
+			return -1;
+		}
+	}
+
+	if (stalled && !(stop_flag && *stop_flag))
+		metrics_count(MET_FIFO_STALLS, 1);
+
+	// nothing to drain, let the caller get on with its other work
+	if (count == 0) {
+		linux_get_ms(&batch_last_drain);
+		return -1;
+	}
+
+	if (mpu9150_read_mag(mpu) != 0)
+		return -1;
+
+	read_temperature(mpu);
+
+	n = 0;
+
+	do {
+		queued = events_queued;
+
+		if (read_fifo_packet(mpu, &more) < 0) {
+			printf("dmp_read_fifo() failed\n");
+			break;
+		}
+
+		// the stamp is the read time, the packets still queued behind
+		// this one were produced after it, same for the gestures in it
+		mpu->dmpTimestamp -= (unsigned long)(more * batch_sample_ms);
+		backdate_events(queued, (unsigned long)(more * batch_sample_ms));
+
+		if (fuse_sample(mpu) == 0)
+			memcpy(&samples[n++], mpu, sizeof(mpudata_t));
+
+	} while (more && n < max_samples);
+
+	// Track the real DMP output rate so the next sleep lands on the batch.
+	// Only when the FIFO was emptied, otherwise n undercounts what arrived,
+	// and not after a short batch where the time was spent waiting.
+	linux_get_ms(&now);
+
+	if (n > 0 && !more && !stalled && now > batch_last_drain) {
+		elapsed = (float)(now - batch_last_drain) / n;
+		batch_sample_ms = ((7.0f * batch_sample_ms) + elapsed) / 8.0f;
+
+		// don't let a stall somewhere else in the loop skew it for long
+		if (batch_sample_ms > 2000.0f / fifo_rate)
+			batch_sample_ms = 2000.0f / fifo_rate;
+		else if (batch_sample_ms < 500.0f / fifo_rate)
+			batch_sample_ms = 500.0f / fifo_rate;
+	}
+
+	batch_last_drain = now;
+
+	return n > 0 ? n : -1;
+}
+
+// Drop to accel-only low power cycle mode with the motion interrupt armed.
+// Gyro, compass and the DMP are off until mpu9150_motion_wait_stop().
+int mpu9150_motion_wait_start(unsigned short thresh_mg, unsigned char lpa_hz)
+{
+	short status;
+
+	if (mpu_lp_motion_interrupt(thresh_mg, 1, lpa_hz)) {
+		printf("mpu_lp_motion_interrupt() failed\n");
+		return -1;
+	}
+
+	// clear anything latched before the switch
+	mpu_get_int_status(&status);
+
+	return 0;
+}
+
+// Poll for the motion interrupt. Reading the status clears it.
+int mpu9150_motion_detected()
+{
+	short status;
+
+	if (mpu_get_int_status(&status) < 0) {
+		printf("mpu_get_int_status() failed\n");
+		return 0;
+	}
+
+	return (status & MPU_INT_STATUS_MOT) ? 1 : 0;
+}
+
+// Restore the full gyro/accel/compass config and restart the DMP
+int mpu9150_motion_wait_stop()
+{
+	if (mpu_lp_motion_interrupt(0, 0, 0)) {
+		printf("mpu_lp_motion_interrupt(0) failed\n");
+		return -1;
+	}
+
+	linux_get_ms(&batch_last_drain);
+
+	return 0;
+}
+
+// Pop the oldest DMP event. Gestures are queued while FIFO packets are
+// parsed, the step count is read from DMP memory every PEDOMETER_POLL_MS.
+// Returns 1 if ev was filled, 0 if there is nothing to report.
+int mpu9150_get_event(mpuevent_t *ev)
+{
+	unsigned long now, steps;
+
+	if (!events_on)
+		return 0;
+
+	linux_get_ms(&now);
+
+	if (now - last_step_poll >= PEDOMETER_POLL_MS) {
+		last_step_poll = now;
+
+		if (dmp_get_pedometer_step_count(&steps) == 0 && steps != last_step_count) {
+			last_step_count = steps;
+			queue_event(MPU_EVENT_STEPS, 0, 0, steps);
+		}
+	}
+
+	if (event_count == 0)
+		return 0;
+
+	memcpy(ev, &event_queue[event_head], sizeof(mpuevent_t));
+	event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+	event_count--;
+
+	return 1;
+}
+
+static void queue_event(unsigned char type, unsigned char arg0, unsigned char arg1, unsigned long value)
+{
+	mpuevent_t *ev;
+
+	// drop the oldest if nobody is reading
+	if (event_count == EVENT_QUEUE_SIZE) {
+		event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+		event_count--;
+	}
+
+	ev = &event_queue[(event_head + event_count) % EVENT_QUEUE_SIZE];
+	ev->type = type;
+	ev->arg0 = arg0;
+	ev->arg1 = arg1;
+	ev->value = value;
+	linux_get_ms(&ev->timestamp);
+
+	event_count++;
+	events_queued++;
+}
+
+// Move the events queued since events_queued was 'queued' back by ms
+static void backdate_events(unsigned long queued, unsigned long ms)
+{
+	unsigned long i, n;
+
+	n = events_queued - queued;
+
+	if (n > (unsigned long)event_count)
+		n = event_count;
+
+	for (i = 0; i < n; i++)
+		event_queue[(event_head + event_count - 1 - i) % EVENT_QUEUE_SIZE].timestamp -= ms;
+}
+
+static void tap_cb(unsigned char direction, unsigned char count)
+{
+	queue_event(MPU_EVENT_TAP, direction, count, 0);
+}
+
+static void android_orient_cb(unsigned char orientation)
+{
+	queue_event(MPU_EVENT_ORIENT, orientation, 0, 0);
+}
+
 int mpu9150_read(mpudata_t *mpu)
 {
+	if (replay_mode) {
+		if (replay_read(mpu) != 0)
+			return -1;
+
+		return fuse_sample(mpu);
+	}
+
 	if (mpu9150_read_dmp(mpu) != 0)
 		return -1;
 
 	if (mpu9150_read_mag(mpu) != 0)
 		return -1;
 
+	read_temperature(mpu);
+
+	return fuse_sample(mpu);
+}
+
+// The per sample steps of mpu9150_read() on their own, for feeding raw
+// data from somewhere else through the same code, e.g. the benchmarks
+void mpu9150_calibrate(mpudata_t *mpu)
+{
 	calibrate_data(mpu);
+}
 
+int mpu9150_fuse(mpudata_t *mpu)
+{
 	return data_fusion(mpu);
 }
 
+static int read_fifo_packet(mpudata_t *mpu, unsigned char *more)
+{
+	short sensors;
+	int rc;
+
+	METRICS_TIME(MET_DMP_FIFO,
+		rc = dmp_read_fifo(mpu->rawGyro, mpu->rawAccel, mpu->rawQuat, &mpu->dmpTimestamp, &sensors, more));
+
+	return rc;
+}
+
+// Raw die temperature into Temp[0], the last value is kept if the read fails
+static void read_temperature(mpudata_t *mpu)
+{
+	short temperature;
+
+	if (mpu_get_temperature(&temperature, NULL) == 0)
+		mpu->Temp[0] = temperature;
+}
+
+// Calibration and fusion. A sample that can't be fused is dropped.
+static int fuse_sample(mpudata_t *mpu)
+{
+	uint64_t start;
+	int rc;
+
+	start = metrics_now_ns();
+	calibrate_data(mpu);
+	rc = data_fusion(mpu);
+	metrics_record(MET_FUSION, metrics_now_ns() - start);
+
+	metrics_count(rc ? MET_DROPPED_SAMPLES : MET_SAMPLES, 1);
+
+	return rc;
+}
+
 int data_ready()
 {
 	short status;
@@ -382,6 +845,7 @@ int data_fusion(mpudata_t *mpu)
 	newMagYaw = -atan2f(magQuat[QUAT_Y], magQuat[QUAT_X]);
 
 	if (newMagYaw != newMagYaw) {
+		metrics_count(MET_NAN_YAW, 1);
 		printf("newMagYaw NAN\n");
 		return -1;
 	}
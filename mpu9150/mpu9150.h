@@ -40,6 +40,11 @@
 #define MIN_SAMPLE_RATE 2
 #define MAX_SAMPLE_RATE 100
 
+// Upper limit on the number of DMP packets drained per wakeup in batch
+// mode. With quaternion, accel, gyro and gesture data a packet is 32 bytes,
+// so this keeps a full batch within half of the 1024 byte FIFO.
+#define MAX_BATCH_SIZE 16
+
 typedef struct {
 	short offset[3];
 	short range[3];
@@ -67,12 +72,38 @@ typedef struct {
 } mpudata_t;
 
 
+// DMP events, see mpu9150_set_events()
+#define MPU_EVENT_TAP		1	// arg0 = TAP_X_UP..TAP_Z_DOWN, arg1 = tap count
+#define MPU_EVENT_ORIENT	2	// arg0 = ANDROID_ORIENT_xxx
+#define MPU_EVENT_STEPS		3	// value = pedometer step count
+
+typedef struct {
+	unsigned char type;
+	unsigned char arg0;
+	unsigned char arg1;
+	unsigned long value;
+	unsigned long timestamp;
+} mpuevent_t;
+
 void mpu9150_set_debug(int on);
+void mpu9150_set_events(int on);
+void mpu9150_set_stop_flag(volatile int *stop);
+int mpu9150_get_event(mpuevent_t *ev);
 int mpu9150_init(int i2c_bus, int sample_rate, int yaw_mixing_factor);
+int mpu9150_init_replay(const char *path, int realtime, int sample_rate, int yaw_mixing_factor);
+int mpu9150_replay_done();
 void mpu9150_exit();
 int mpu9150_read(mpudata_t *mpu);
 int mpu9150_read_dmp(mpudata_t *mpu);
 int mpu9150_read_mag(mpudata_t *mpu);
+void mpu9150_calibrate(mpudata_t *mpu);
+int mpu9150_fuse(mpudata_t *mpu);
+int mpu9150_set_sample_rate(int sample_rate);
+int mpu9150_set_batch_latency(int latency_ms);
+int mpu9150_motion_wait_start(unsigned short thresh_mg, unsigned char lpa_hz);
+int mpu9150_motion_detected();
+int mpu9150_motion_wait_stop();
+int mpu9150_read_batch(mpudata_t *mpu, mpudata_t *samples, int max_samples);
 void mpu9150_set_accel_cal(caldata_t *cal);
 void mpu9150_set_mag_cal(caldata_t *cal);
 
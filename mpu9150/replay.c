@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "linux_glue.h"
+#include "replay.h"
+#include "recorder.h"
+
+static FILE *replay_file;
+static int replay_realtime;
+static int replay_at_eof;
+static unsigned long replay_first_ts;
+static unsigned long replay_start_ms;
+static unsigned long replay_line;
+
+// binary recorder segment instead of text
+static int replay_binary;
+static unsigned long replay_records;
+
+int replay_open(const char *path, int realtime)
+{
+	rechdr_t hdr;
+
+	replay_file = fopen(path, "r");
+
+	if (!replay_file) {
+		perror("open(<replay-file>)");
+		return -1;
+	}
+
+	replay_binary = 0;
+
+	if (fread(&hdr, sizeof(hdr), 1, replay_file) == 1 && !memcmp(hdr.magic, REC_MAGIC, sizeof(REC_MAGIC))) {
+		if (hdr.version != REC_VERSION || hdr.record_size != sizeof(recsample_t)) {
+			printf("Unsupported record segment version %u\n", hdr.version);
+			fclose(replay_file);
+			replay_file = NULL;
+			return -1;
+		}
+
+		fseek(replay_file, hdr.header_size, SEEK_SET);
+		replay_binary = 1;
+		replay_records = hdr.count;
+	}
+	else {
+		rewind(replay_file);
+	}
+
+	replay_realtime = realtime;
+	replay_at_eof = 0;
+	replay_first_ts = 0;
+	replay_start_ms = 0;
+	replay_line = 0;
+
+	return 0;
+}
+
+void replay_close()
+{
+	if (replay_file) {
+		fclose(replay_file);
+		replay_file = NULL;
+	}
+}
+
+int replay_eof()
+{
+	return replay_at_eof;
+}
+
+// Fill the raw fields of mpu with the next logged sample. In real time
+// mode this sleeps until the sample is due according to its DMP timestamp.
+int replay_read(mpudata_t *mpu)
+{
+	char buff[256];
+	unsigned long now, due;
+	int n;
+
+	if (!replay_file || replay_at_eof)
+		return -1;
+
+	if (replay_binary) {
+		recsample_t rec;
+
+		if (replay_line >= replay_records || fread(&rec, sizeof(rec), 1, replay_file) != 1) {
+			replay_at_eof = 1;
+			return -1;
+		}
+
+		replay_line++;
+		recsample_to_mpudata(&rec, mpu);
+	}
+
+	while (!replay_binary) {
+		if (!fgets(buff, sizeof(buff), replay_file)) {
+			replay_at_eof = 1;
+			return -1;
+		}
+
+		replay_line++;
+
+		if (buff[0] == '#' || buff[0] == '\n' || buff[0] == '\r')
+			continue;
+
+		n = sscanf(buff, "%lu %ld %ld %ld %ld %hd %hd %hd %hd %hd %hd %lu %hd %hd %hd %hd",
+				&mpu->dmpTimestamp,
+				&mpu->rawQuat[0], &mpu->rawQuat[1], &mpu->rawQuat[2], &mpu->rawQuat[3],
+				&mpu->rawAccel[0], &mpu->rawAccel[1], &mpu->rawAccel[2],
+				&mpu->rawGyro[0], &mpu->rawGyro[1], &mpu->rawGyro[2],
+				&mpu->magTimestamp,
+				&mpu->rawMag[0], &mpu->rawMag[1], &mpu->rawMag[2],
+				&mpu->Temp[0]);
+
+		// temperature is optional
+		if (n == 15)
+			mpu->Temp[0] = 0;
+		else if (n != 16) {
+			printf("Bad replay record at line %lu\n", replay_line);
+			continue;
+		}
+
+		break;
+	}
+
+	if (!replay_realtime)
+		return 0;
+
+	linux_get_ms(&now);
+
+	if (!replay_start_ms) {
+		replay_start_ms = now;
+		replay_first_ts = mpu->dmpTimestamp;
+		return 0;
+	}
+
+	if (mpu->dmpTimestamp > replay_first_ts) {
+		due = replay_start_ms + (mpu->dmpTimestamp - replay_first_ts);
+
+		if (due > now)
+			linux_delay_ms(due - now);
+	}
+
+	return 0;
+}
+
+int replay_write_header(FILE *f)
+{
+	if (fprintf(f, "# dmpTimestamp qw qx qy qz ax ay az gx gy gz magTimestamp mx my mz temp\n") < 0)
+		return -1;
+
+	return 0;
+}
+
+int replay_write(FILE *f, mpudata_t *mpu)
+{
+	int n;
+
+	n = fprintf(f, "%lu %ld %ld %ld %ld %d %d %d %d %d %d %lu %d %d %d %d\n",
+			mpu->dmpTimestamp,
+			mpu->rawQuat[0], mpu->rawQuat[1], mpu->rawQuat[2], mpu->rawQuat[3],
+			mpu->rawAccel[0], mpu->rawAccel[1], mpu->rawAccel[2],
+			mpu->rawGyro[0], mpu->rawGyro[1], mpu->rawGyro[2],
+			mpu->magTimestamp,
+			mpu->rawMag[0], mpu->rawMag[1], mpu->rawMag[2],
+			mpu->Temp[0]);
+
+	if (n < 0) {
+		perror("write(<replay-file>)");
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,312 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+
+// catch layout changes at compile time, the files outlive the code
+typedef char rechdr_size_check[(sizeof(rechdr_t) == REC_HEADER_SIZE) ? 1 : -1];
+typedef char recsample_size_check[(sizeof(recsample_t) == 104) ? 1 : -1];
+
+static char rec_prefix[256];
+static unsigned long rec_capacity;
+static int rec_max_segments;
+
+static int rec_fd = -1;
+static unsigned char *rec_map;
+static size_t rec_map_len;
+static rechdr_t *rec_hdr;
+static recsample_t *rec_data;
+
+static uint32_t rec_segment;
+static uint32_t rec_seq;
+
+static int segment_open(uint32_t segment);
+static void segment_close();
+static void segment_name(uint32_t segment, char *buff, int len);
+static int segment_last(uint32_t *segment);
+
+int recorder_open(const char *prefix, unsigned long segment_records, int max_segments)
+{
+	if (!prefix || strlen(prefix) > sizeof(rec_prefix) - 16) {
+		printf("Invalid recorder prefix\n");
+		return -1;
+	}
+
+	if (segment_records < 1) {
+		printf("Invalid recorder segment size %lu\n", segment_records);
+		return -1;
+	}
+
+	strcpy(rec_prefix, prefix);
+	rec_capacity = segment_records;
+	rec_max_segments = max_segments;
+	rec_seq = 0;
+
+	// carry on after an earlier run with the same prefix, never over it
+	if (segment_last(&rec_segment))
+		rec_segment++;
+	else
+		rec_segment = 0;
+
+	return segment_open(rec_segment);
+}
+
+void recorder_close()
+{
+	segment_close();
+}
+
+int recorder_write(mpudata_t *mpu)
+{
+	recsample_t *rec;
+
+	if (!rec_hdr)
+		return -1;
+
+	if (rec_hdr->count >= rec_hdr->capacity) {
+		segment_close();
+
+		if (segment_open(rec_segment + 1))
+			return -1;
+	}
+
+	rec = &rec_data[rec_hdr->count];
+
+	recsample_from_mpudata(mpu, rec);
+	rec->seq = rec_seq++;
+
+	// publish the record only after it is complete
+	__sync_synchronize();
+	rec_hdr->count++;
+
+	return 0;
+}
+
+void recsample_from_mpudata(mpudata_t *mpu, recsample_t *rec)
+{
+	struct timeval tv;
+	int i;
+
+	// vDSO call, no syscall
+	gettimeofday(&tv, NULL);
+
+	rec->seq = 0;
+	rec->dmp_timestamp = mpu->dmpTimestamp;
+	rec->host_us = ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+	rec->mag_timestamp = mpu->magTimestamp;
+
+	for (i = 0; i < 4; i++) {
+		rec->raw_quat[i] = mpu->rawQuat[i];
+		rec->fused_quat[i] = mpu->fusedQuat[i];
+	}
+
+	for (i = 0; i < 3; i++) {
+		rec->raw_accel[i] = mpu->rawAccel[i];
+		rec->raw_gyro[i] = mpu->rawGyro[i];
+		rec->raw_mag[i] = mpu->rawMag[i];
+		rec->cal_accel[i] = mpu->calibratedAccel[i];
+		rec->cal_mag[i] = mpu->calibratedMag[i];
+		rec->fused_euler[i] = mpu->fusedEuler[i];
+	}
+
+	rec->temp = mpu->Temp[0];
+	rec->reserved[0] = 0;
+	rec->reserved[1] = 0;
+}
+
+void recsample_to_mpudata(recsample_t *rec, mpudata_t *mpu)
+{
+	int i;
+
+	mpu->dmpTimestamp = rec->dmp_timestamp;
+	mpu->magTimestamp = rec->mag_timestamp;
+
+	for (i = 0; i < 4; i++)
+		mpu->rawQuat[i] = rec->raw_quat[i];
+
+	for (i = 0; i < 3; i++) {
+		mpu->rawAccel[i] = rec->raw_accel[i];
+		mpu->rawGyro[i] = rec->raw_gyro[i];
+		mpu->rawMag[i] = rec->raw_mag[i];
+	}
+
+	mpu->Temp[0] = rec->temp;
+}
+
+static void segment_name(uint32_t segment, char *buff, int len)
+{
+	snprintf(buff, len, "%s-%06u.rec", rec_prefix, segment);
+}
+
+// Find the highest numbered <prefix>-NNNNNN.rec already on disk.
+// Returns 1 if there is one.
+static int segment_last(uint32_t *segment)
+{
+	char dir[256];
+	const char *base;
+	struct dirent *de;
+	DIR *d;
+	size_t base_len;
+	unsigned long n;
+	char *end;
+	int found;
+
+	base = strrchr(rec_prefix, '/');
+
+	if (base) {
+		snprintf(dir, sizeof(dir), "%.*s", (int)(base - rec_prefix), rec_prefix);
+		base++;
+
+		if (!dir[0])
+			strcpy(dir, "/");
+	}
+	else {
+		strcpy(dir, ".");
+		base = rec_prefix;
+	}
+
+	d = opendir(dir);
+
+	if (!d)
+		return 0;
+
+	base_len = strlen(base);
+	found = 0;
+
+	while ((de = readdir(d)) != NULL) {
+		if (strlen(de->d_name) != base_len + 11 || strncmp(de->d_name, base, base_len)
+				|| de->d_name[base_len] != '-' || strcmp(de->d_name + base_len + 7, ".rec"))
+			continue;
+
+		n = strtoul(de->d_name + base_len + 1, &end, 10);
+
+		if (end != de->d_name + base_len + 7)
+			continue;
+
+		if (!found || n > *segment)
+			*segment = n;
+
+		found = 1;
+	}
+
+	closedir(d);
+
+	return found;
+}
+
+// Create and map a segment at full size up front so appends never have
+// to extend the file
+static int segment_open(uint32_t segment)
+{
+	char name[300];
+	struct timeval tv;
+	int err;
+
+	segment_name(segment, name, sizeof(name));
+
+	// an existing segment is someone's capture, fail rather than reuse it
+	rec_fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (rec_fd < 0) {
+		perror("open(<record-segment>)");
+		return -1;
+	}
+
+	rec_map_len = REC_HEADER_SIZE + (rec_capacity * sizeof(recsample_t));
+
+	err = posix_fallocate(rec_fd, 0, rec_map_len);
+
+	// not every filesystem can, fall back to a sparse file
+	if (err && ftruncate(rec_fd, rec_map_len) < 0) {
+		perror("ftruncate(<record-segment>)");
+		goto segment_fail;
+	}
+
+	rec_map = mmap(NULL, rec_map_len, PROT_READ | PROT_WRITE, MAP_SHARED, rec_fd, 0);
+
+	if (rec_map == MAP_FAILED) {
+		perror("mmap(<record-segment>)");
+		rec_map = NULL;
+		goto segment_fail;
+	}
+
+	rec_hdr = (rechdr_t *)rec_map;
+	rec_data = (recsample_t *)(rec_map + REC_HEADER_SIZE);
+
+	gettimeofday(&tv, NULL);
+
+	memset(rec_hdr, 0, sizeof(rechdr_t));
+	strcpy(rec_hdr->magic, REC_MAGIC);
+	rec_hdr->version = REC_VERSION;
+	rec_hdr->header_size = REC_HEADER_SIZE;
+	rec_hdr->record_size = sizeof(recsample_t);
+	rec_hdr->capacity = rec_capacity;
+	rec_hdr->count = 0;
+	rec_hdr->segment = segment;
+	rec_hdr->start_us = ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+
+	rec_segment = segment;
+
+	// keep a bounded number of segments on disk
+	if (rec_max_segments > 0 && segment >= (uint32_t)rec_max_segments) {
+		segment_name(segment - rec_max_segments, name, sizeof(name));
+
+		if (unlink(name) < 0 && errno != ENOENT)
+			perror("unlink(<record-segment>)");
+	}
+
+	return 0;
+
+segment_fail:
+	close(rec_fd);
+	rec_fd = -1;
+	return -1;
+}
+
+static void segment_close()
+{
+	if (rec_map) {
+		msync(rec_map, rec_map_len, MS_ASYNC);
+		munmap(rec_map, rec_map_len);
+		rec_map = NULL;
+		rec_hdr = NULL;
+		rec_data = NULL;
+	}
+
+	if (rec_fd >= 0) {
+		close(rec_fd);
+		rec_fd = -1;
+	}
+}
@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#include "mpu9150.h"
+
+// Samples are appended to preallocated segment files <prefix>-NNNNNN.rec
+// that are mmap'd, so a write is a memcpy. Numbering carries on from the
+// highest segment already on disk, existing files are never reused. A
+// segment starts with a rechdr_t followed by fixed size recsample_t
+// records, all in host byte order. hdr.count is the number of valid records.
+
+#define REC_MAGIC		"MPUREC1"
+#define REC_VERSION		1
+#define REC_HEADER_SIZE		64
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t capacity;
+	uint32_t count;
+	uint32_t segment;
+	uint64_t start_us;
+	uint8_t reserved[24];
+} rechdr_t;
+
+typedef struct {
+	uint32_t seq;
+	uint32_t dmp_timestamp;
+	uint64_t host_us;
+	uint32_t mag_timestamp;
+	int32_t raw_quat[4];
+	int16_t raw_accel[3];
+	int16_t raw_gyro[3];
+	int16_t raw_mag[3];
+	int16_t temp;
+	int16_t cal_accel[3];
+	int16_t cal_mag[3];
+	float fused_quat[4];
+	float fused_euler[3];
+	uint32_t reserved[2];
+} recsample_t;
+
+int recorder_open(const char *prefix, unsigned long segment_records, int max_segments);
+int recorder_write(mpudata_t *mpu);
+void recorder_close();
+
+void recsample_from_mpudata(mpudata_t *mpu, recsample_t *rec);
+void recsample_to_mpudata(recsample_t *rec, mpudata_t *mpu);
+
+#endif /* RECORDER_H */
@@ -0,0 +1,251 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "shmring.h"
+
+// a reader gives up on a slot the writer keeps lapping
+#define SHMRING_READ_RETRIES	100
+
+static char ring_name[64];
+static shmring_t *ring;
+static size_t ring_len;
+
+int shmring_create(const char *name, int num_slots)
+{
+	int fd;
+
+	if (!name || name[0] != '/' || strlen(name) >= sizeof(ring_name)) {
+		printf("Invalid shared memory name, it must start with '/'\n");
+		return -1;
+	}
+
+	if (num_slots < 2) {
+		printf("Invalid shared memory ring size %d\n", num_slots);
+		return -1;
+	}
+
+	ring_len = sizeof(shmring_t) + (num_slots * sizeof(shmslot_t));
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0) {
+		perror("shm_open");
+		return -1;
+	}
+
+	if (ftruncate(fd, ring_len) < 0) {
+		perror("ftruncate(<shm>)");
+		close(fd);
+		shm_unlink(name);
+		return -1;
+	}
+
+	ring = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	// the mapping stays valid without the descriptor
+	close(fd);
+
+	if (ring == MAP_FAILED) {
+		perror("mmap(<shm>)");
+		ring = NULL;
+		shm_unlink(name);
+		return -1;
+	}
+
+	memset(ring, 0, ring_len);
+	ring->version = SHMRING_VERSION;
+	ring->slot_size = sizeof(shmslot_t);
+	ring->num_slots = num_slots;
+	ring->writer_pid = getpid();
+
+	// readers check the magic last
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	strcpy(ring->magic, SHMRING_MAGIC);
+
+	strcpy(ring_name, name);
+
+	return 0;
+}
+
+int shmring_write(shmslot_t *sample)
+{
+	shmslot_t *slot;
+	uint32_t head, seq;
+
+	if (!ring)
+		return -1;
+
+	head = ring->head;
+	slot = &ring->slots[head % ring->num_slots];
+	seq = slot->seq;
+
+	__atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy((char *)slot + sizeof(slot->seq), (char *)sample + sizeof(sample->seq),
+		sizeof(shmslot_t) - sizeof(slot->seq));
+	slot->index = head;
+
+	__atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void shmring_destroy()
+{
+	if (!ring)
+		return;
+
+	munmap(ring, ring_len);
+	ring = NULL;
+
+	// readers that have it mapped keep their view
+	shm_unlink(ring_name);
+}
+
+shmring_t *shmring_open(const char *name)
+{
+	shmring_t *r;
+	struct stat st;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd < 0) {
+		perror("shm_open");
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(shmring_t)) {
+		printf("Shared memory ring %s not ready\n", name);
+		close(fd);
+		return NULL;
+	}
+
+	r = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (r == MAP_FAILED) {
+		perror("mmap(<shm>)");
+		return NULL;
+	}
+
+	if (memcmp(r->magic, SHMRING_MAGIC, sizeof(SHMRING_MAGIC))) {
+		printf("Shared memory ring %s not ready\n", name);
+		munmap(r, st.st_size);
+		return NULL;
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (r->version != SHMRING_VERSION || r->slot_size != sizeof(shmslot_t)
+		|| st.st_size < (off_t)(sizeof(shmring_t) + r->num_slots * sizeof(shmslot_t))) {
+		printf("Shared memory ring %s has an unsupported layout\n", name);
+		munmap(r, st.st_size);
+		return NULL;
+	}
+
+	return r;
+}
+
+void shmring_close(shmring_t *r)
+{
+	if (r)
+		munmap(r, sizeof(shmring_t) + r->num_slots * sizeof(shmslot_t));
+}
+
+uint32_t shmring_head(shmring_t *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+// Copy sample number index out of the ring.
+// Returns 0 on success, -1 if it hasn't been written yet and -2 if it has
+// already been overwritten.
+int shmring_read(shmring_t *r, uint32_t index, shmslot_t *sample)
+{
+	shmslot_t *slot;
+	uint32_t head, seq1, seq2;
+	int tries;
+
+	slot = &r->slots[index % r->num_slots];
+
+	for (tries = 0; tries < SHMRING_READ_RETRIES; tries++) {
+		head = shmring_head(r);
+
+		// unsigned math handles the counter wrapping
+		if (head - index - 1 >= 0x80000000u)
+			return -1;
+
+		if (head - index > r->num_slots)
+			return -2;
+
+		seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+		if (seq1 & 1)
+			continue;
+
+		memcpy(sample, slot, sizeof(shmslot_t));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+		if (seq1 != seq2)
+			continue;
+
+		if (sample->index != index)
+			return -2;
+
+		return 0;
+	}
+
+	return -2;
+}
+
+// Copy the newest sample. Returns 0 on success, -1 if there is none yet.
+int shmring_read_latest(shmring_t *r, shmslot_t *sample)
+{
+	uint32_t head;
+	int tries;
+
+	for (tries = 0; tries < SHMRING_READ_RETRIES; tries++) {
+		head = shmring_head(r);
+
+		if (head == 0)
+			return -1;
+
+		if (shmring_read(r, head - 1, sample) == 0)
+			return 0;
+	}
+
+	return -1;
+}
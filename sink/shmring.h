@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+
+// Latest fused samples in a POSIX shared memory ring for local readers.
+// One writer (imu), any number of readers. Each slot is protected by its
+// own sequence counter: odd while the writer is in the slot, bumped by
+// two for every completed write. A reader copies the slot and retries if
+// the counter moved or was odd. Readers never block the writer.
+//
+// Reader side is this header plus shmring.o, no other dependencies.
+
+#define SHMRING_MAGIC		"MPUSHM1"
+#define SHMRING_VERSION		1
+
+typedef struct {
+	uint32_t seq;
+	uint32_t index;
+	uint64_t host_us;
+	uint32_t dmp_timestamp;
+	float fused_quat[4];
+	float fused_euler[3];
+	int32_t raw_quat[4];
+	int16_t raw_accel[3];
+	int16_t raw_gyro[3];
+	int16_t raw_mag[3];
+	int16_t cal_accel[3];
+	int16_t cal_mag[3];
+	int16_t temp;
+} shmslot_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_size;
+	uint32_t num_slots;
+	uint32_t writer_pid;
+	// number of samples written, slot of sample i is i % num_slots
+	uint32_t head;
+	uint32_t reserved;
+	shmslot_t slots[];
+} shmring_t;
+
+// writer
+int shmring_create(const char *name, int num_slots);
+int shmring_write(shmslot_t *sample);
+void shmring_destroy();
+
+// reader
+shmring_t *shmring_open(const char *name);
+void shmring_close(shmring_t *ring);
+uint32_t shmring_head(shmring_t *ring);
+int shmring_read(shmring_t *ring, uint32_t index, shmslot_t *sample);
+int shmring_read_latest(shmring_t *ring, shmslot_t *sample);
+
+#endif /* SHMRING_H */
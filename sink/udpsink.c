@@ -0,0 +1,217 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "udpsink.h"
+
+typedef struct {
+	udphdr_t hdr;
+	recsample_t samples[UDP_MAX_BATCH];
+} udpframe_t;
+
+static int udp_fd = -1;
+static struct sockaddr_in udp_addr;
+static int udp_batch;
+static unsigned long udp_max_latency_us;
+
+static udpframe_t frame;
+static uint64_t frame_start_us;
+static uint32_t sample_seq;
+static udpstats_t stats;
+
+static uint64_t now_us();
+
+// dest is <ipv4-address>:<port>, multicast groups are detected by address
+int udpsink_open(const char *dest, int batch, int max_latency_ms, int ttl)
+{
+	char host[64];
+	char *p;
+	int port;
+	unsigned char mttl;
+
+	if (!dest || strlen(dest) >= sizeof(host)) {
+		printf("Invalid UDP destination\n");
+		return -1;
+	}
+
+	strcpy(host, dest);
+	p = strrchr(host, ':');
+
+	if (!p) {
+		printf("UDP destination must be <address>:<port>\n");
+		return -1;
+	}
+
+	*p++ = 0;
+	port = strtol(p, NULL, 0);
+
+	if (port < 1 || port > 65535) {
+		printf("Invalid UDP port %s\n", p);
+		return -1;
+	}
+
+	if (batch < 1 || batch > UDP_MAX_BATCH) {
+		printf("Invalid UDP batch size %d, range 1-%d\n", batch, UDP_MAX_BATCH);
+		return -1;
+	}
+
+	memset(&udp_addr, 0, sizeof(udp_addr));
+	udp_addr.sin_family = AF_INET;
+	udp_addr.sin_port = htons(port);
+
+	if (inet_pton(AF_INET, host, &udp_addr.sin_addr) != 1) {
+		printf("Invalid UDP address %s\n", host);
+		return -1;
+	}
+
+	udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (udp_fd < 0) {
+		perror("socket(<udp>)");
+		return -1;
+	}
+
+	if (IN_MULTICAST(ntohl(udp_addr.sin_addr.s_addr))) {
+		mttl = ttl;
+
+		if (setsockopt(udp_fd, IPPROTO_IP, IP_MULTICAST_TTL, &mttl, sizeof(mttl)) < 0)
+			perror("setsockopt(IP_MULTICAST_TTL)");
+	}
+
+	udp_batch = batch;
+	udp_max_latency_us = max_latency_ms * 1000UL;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.hdr.magic = UDP_MAGIC;
+	frame.hdr.version = UDP_VERSION;
+	frame.hdr.record_size = sizeof(recsample_t);
+
+	sample_seq = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	return 0;
+}
+
+// Add a sample to the current frame, the frame goes out when it is full
+// or its oldest sample has waited max_latency_ms
+int udpsink_write(mpudata_t *mpu)
+{
+	recsample_t *rec;
+
+	if (udp_fd < 0)
+		return -1;
+
+	rec = &frame.samples[frame.hdr.count];
+	recsample_from_mpudata(mpu, rec);
+	rec->seq = sample_seq++;
+
+	if (frame.hdr.count++ == 0)
+		frame_start_us = rec->host_us;
+
+	if (frame.hdr.count >= udp_batch)
+		return udpsink_flush();
+
+	if (rec->host_us - frame_start_us >= udp_max_latency_us)
+		return udpsink_flush();
+
+	return 0;
+}
+
+int udpsink_flush()
+{
+	size_t len;
+	ssize_t sent;
+
+	if (udp_fd < 0 || frame.hdr.count == 0)
+		return 0;
+
+	frame.hdr.host_us = now_us();
+	len = sizeof(udphdr_t) + frame.hdr.count * sizeof(recsample_t);
+
+	// never hold up acquisition, a full socket buffer drops the frame
+	sent = sendto(udp_fd, &frame, len, MSG_DONTWAIT, (struct sockaddr *)&udp_addr, sizeof(udp_addr));
+
+	stats.frames++;
+	stats.samples += frame.hdr.count;
+
+	frame.hdr.frame_seq++;
+	frame.hdr.count = 0;
+
+	if (sent < 0) {
+		stats.dropped_frames++;
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != ECONNREFUSED) {
+			perror("sendto(<udp>)");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Call between samples so a partial frame still goes out on time when
+// samples stop coming, e.g. a FIFO stall
+int udpsink_poll()
+{
+	if (udp_fd < 0 || frame.hdr.count == 0)
+		return 0;
+
+	if (now_us() - frame_start_us < udp_max_latency_us)
+		return 0;
+
+	return udpsink_flush();
+}
+
+void udpsink_close()
+{
+	if (udp_fd < 0)
+		return;
+
+	udpsink_flush();
+	close(udp_fd);
+	udp_fd = -1;
+}
+
+void udpsink_get_stats(udpstats_t *s)
+{
+	memcpy(s, &stats, sizeof(stats));
+}
+
+static uint64_t now_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  This file is part of linux-mpu9150
+//
+//  Copyright (c) 2013 Pansenti, LLC
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of 
+//  this software and associated documentation files (the "Software"), to deal in 
+//  the Software without restriction, including without limitation the rights to use, 
+//  copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the 
+//  Software, and to permit persons to whom the Software is furnished to do so, 
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all 
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, 
+//  INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A 
+//  PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT 
+//  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION 
+//  OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+//  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef UDPSINK_H
+#define UDPSINK_H
+
+#include <stdint.h>
+
+#include "mpu9150.h"
+#include "recorder.h"
+
+// Samples are sent to a unicast or multicast UDP destination in frames of
+// up to UDP_MAX_BATCH recsample_t records. Frames carry their own sequence
+// number so receivers can spot loss, and every record keeps its sample
+// number. Host byte order (little endian on all supported boards).
+
+#define UDP_MAGIC		0x5544504D	// "MPDU" little endian
+#define UDP_VERSION		1
+
+// keeps a full frame under a 1500 byte MTU
+#define UDP_MAX_BATCH		13
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	uint32_t frame_seq;
+	uint32_t record_size;
+	uint64_t host_us;
+} udphdr_t;
+
+typedef struct {
+	unsigned long frames;
+	unsigned long samples;
+	unsigned long dropped_frames;
+} udpstats_t;
+
+int udpsink_open(const char *dest, int batch, int max_latency_ms, int ttl);
+int udpsink_write(mpudata_t *mpu);
+int udpsink_flush();
+int udpsink_poll();
+void udpsink_close();
+void udpsink_get_stats(udpstats_t *stats);
+
+#endif /* UDPSINK_H */